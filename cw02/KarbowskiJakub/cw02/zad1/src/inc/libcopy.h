@@ -5,6 +5,10 @@
 #define IMPL_LIB
 #endif
 
+#include "linefilter.h"
+
+#define FILTER_BUF_SIZE (1024 * 1024)
+
 /**
  * Copy contents of input file
  * into output file
@@ -16,4 +20,17 @@
  */
 int copy_file(const char *in_path, const char *out_path);
 
+/**
+ * Copy contents of input file
+ * into output file
+ * passing every line through filter chain.
+ * File is read once in FILTER_BUF_SIZE blocks.
+ *
+ * @param in_path Input file path.
+ * @param out_path Output file path.
+ * @param chain Compiled filters.
+ * @return 0 or negative error.
+ */
+int filter_copy(const char *in_path, const char *out_path, filter_chain_t *chain);
+
 #endif
@@ -0,0 +1,77 @@
+#ifndef JK_02_01_LINEFILTER_H
+#define JK_02_01_LINEFILTER_H
+
+#include <stddef.h>
+
+#define FILTER_PREFIX_MAX (16)
+
+typedef enum filter_kind_t
+{
+    // drop lines containing only whitespace
+    FILTER_BLANK,
+    // remove whitespace at the end of line
+    FILTER_RTRIM,
+    // drop line equal to the previous one
+    FILTER_SQUEEZE,
+    // drop lines starting with prefix after leading whitespace
+    FILTER_COMMENT,
+    // replace \r\n with \n
+    FILTER_CRLF,
+} filter_kind_t;
+
+typedef struct filter_t
+{
+    filter_kind_t kind;
+    char prefix[FILTER_PREFIX_MAX];
+    size_t prefix_len;
+
+    // last line passed by squeeze
+    char *last;
+    size_t last_len;
+    size_t last_cap;
+    int has_last;
+} filter_t;
+
+/**
+ * Filters applied to every line in order.
+ */
+typedef struct filter_chain_t
+{
+    filter_t *filters;
+    int n_filters;
+} filter_chain_t;
+
+/**
+ * Build chain from filter names:
+ * blank, rtrim, squeeze, crlf, comment or comment=PREFIX.
+ *
+ * @param chain Output chain.
+ * @param specs Filter names.
+ * @param n_specs Number of names.
+ * @return 0 or negative error.
+ */
+int filter_chain_compile(filter_chain_t *chain, const char *specs[], int n_specs);
+
+/**
+ * Destroy chain.
+ */
+void filter_chain_free(filter_chain_t *chain);
+
+/**
+ * Filter complete lines from buffer.
+ * Output is the same as running every filter
+ * over the whole input one after another.
+ * Filters only shorten lines, so out needs at most len bytes.
+ *
+ * @param chain Filters.
+ * @param buf Input data.
+ * @param len Size of input data.
+ * @param eof Nonzero if data ends the input,
+ *            then the last line does not need \n.
+ * @param out Output buffer.
+ * @param out_len Output, bytes written to out.
+ * @return Number of consumed input bytes or negative error.
+ */
+long filter_run(filter_chain_t *chain, const char *buf, size_t len, int eof, char *out, size_t *out_len);
+
+#endif
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
 
 int copy_file(const char *in_path, const char *out_path)
 {
@@ -128,4 +129,102 @@ int copy_file(const char *in_path, const char *out_path)
     return err;
 }
 
+int filter_copy(const char *in_path, const char *out_path, filter_chain_t *chain)
+{
+    if (!in_path || !out_path || !chain) return -1;
+
+    int err = 0;
+    size_t buf_size = FILTER_BUF_SIZE;
+    // bytes of incomplete line kept from previous block
+    size_t carry = 0;
+    char *buf = NULL;
+    char *out = NULL;
+    FILE *fin = NULL;
+    FILE *fout = NULL;
+
+    do
+    {
+        buf = malloc(buf_size);
+        out = malloc(buf_size);
+        if (!buf || !out)
+        {
+            err = -1;
+            break;
+        }
+
+        fin = fopen(in_path, "r");
+        if (!fin)
+        {
+            err = -1;
+            break;
+        }
+
+        fout = fopen(out_path, "w");
+        if (!fout)
+        {
+            err = -1;
+            break;
+        }
+
+        int eof = 0;
+        while (!eof)
+        {
+            // line longer than buffer
+            if (carry == buf_size)
+            {
+                buf_size *= 2;
+                char *new_buf = realloc(buf, buf_size);
+                if (!new_buf)
+                {
+                    err = -1;
+                    break;
+                }
+                buf = new_buf;
+                char *new_out = realloc(out, buf_size);
+                if (!new_out)
+                {
+                    err = -1;
+                    break;
+                }
+                out = new_out;
+            }
+
+            size_t n = fread(buf + carry, 1, buf_size - carry, fin);
+            if (ferror(fin))
+            {
+                err = -1;
+                break;
+            }
+            if (feof(fin)) eof = 1;
+
+            size_t len = carry + n;
+            size_t out_len;
+            long used = filter_run(chain, buf, len, eof, out, &out_len);
+            if (used < 0)
+            {
+                err = -1;
+                break;
+            }
+
+            if (fwrite(out, 1, out_len, fout) != out_len)
+            {
+                err = -1;
+                break;
+            }
+
+            carry = len - used;
+            memmove(buf, buf + used, carry);
+        }
+    } while (0);
+
+    if (fin)
+        fclose(fin);
+    if (fout && fclose(fout))
+        err = -1;
+    free(buf);
+    free(out);
+
+    return err;
+}
+
 #endif // IMPL_LIB
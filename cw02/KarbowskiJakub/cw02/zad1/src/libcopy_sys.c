@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <string.h>
 
 int copy_file(const char *in_path, const char *out_path)
 {
@@ -132,4 +133,112 @@ int copy_file(const char *in_path, const char *out_path)
     return err;
 }
 
+/**
+ * Write whole buffer, retrying short writes.
+ */
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int filter_copy(const char *in_path, const char *out_path, filter_chain_t *chain)
+{
+    if (!in_path || !out_path || !chain) return -1;
+
+    int err = 0;
+    size_t buf_size = FILTER_BUF_SIZE;
+    // bytes of incomplete line kept from previous block
+    size_t carry = 0;
+    char *buf = NULL;
+    char *out = NULL;
+    int fin = -1;
+    int fout = -1;
+
+    do
+    {
+        buf = malloc(buf_size);
+        out = malloc(buf_size);
+        if (!buf || !out)
+        {
+            err = -1;
+            break;
+        }
+
+        fin = open(in_path, O_RDONLY);
+        if (fin < 0)
+        {
+            err = -1;
+            break;
+        }
+
+        fout = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0b110110110);
+        if (fout < 0)
+        {
+            err = -1;
+            break;
+        }
+
+        int eof = 0;
+        while (!eof)
+        {
+            // line longer than buffer
+            if (carry == buf_size)
+            {
+                buf_size *= 2;
+                char *new_buf = realloc(buf, buf_size);
+                if (!new_buf)
+                {
+                    err = -1;
+                    break;
+                }
+                buf = new_buf;
+                char *new_out = realloc(out, buf_size);
+                if (!new_out)
+                {
+                    err = -1;
+                    break;
+                }
+                out = new_out;
+            }
+
+            ssize_t n = read(fin, buf + carry, buf_size - carry);
+            if (n < 0)
+            {
+                err = -1;
+                break;
+            }
+            if (n == 0) eof = 1;
+
+            size_t len = carry + n;
+            size_t out_len;
+            long used = filter_run(chain, buf, len, eof, out, &out_len);
+            if (used < 0)
+            {
+                err = -1;
+                break;
+            }
+
+            err = write_all(fout, out, out_len);
+            if (err) break;
+
+            carry = len - used;
+            memmove(buf, buf + used, carry);
+        }
+    } while (0);
+
+    if (fin >= 0) close(fin);
+    if (fout >= 0 && close(fout)) err = -1;
+    free(buf);
+    free(out);
+
+    return err;
+}
+
 #endif // IMPL_SYS
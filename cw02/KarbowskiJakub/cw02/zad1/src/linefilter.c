@@ -0,0 +1,155 @@
+#include "linefilter.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+static int compile_one(filter_t *f, const char *spec)
+{
+    memset(f, 0, sizeof *f);
+
+    if (!strcmp("blank", spec)) f->kind = FILTER_BLANK;
+    else if (!strcmp("rtrim", spec)) f->kind = FILTER_RTRIM;
+    else if (!strcmp("squeeze", spec)) f->kind = FILTER_SQUEEZE;
+    else if (!strcmp("crlf", spec)) f->kind = FILTER_CRLF;
+    else if (!strncmp("comment", spec, 7) && (!spec[7] || spec[7] == '='))
+    {
+        f->kind = FILTER_COMMENT;
+        const char *prefix = spec[7] ? spec + 8 : "#";
+        f->prefix_len = strlen(prefix);
+        if (!f->prefix_len || f->prefix_len >= FILTER_PREFIX_MAX) return -1;
+        memcpy(f->prefix, prefix, f->prefix_len);
+    }
+    else return -1;
+
+    return 0;
+}
+
+int filter_chain_compile(filter_chain_t *chain, const char *specs[], int n_specs)
+{
+    if (!chain || !specs || n_specs < 0) return -1;
+
+    chain->filters = calloc(n_specs ? n_specs : 1, sizeof *chain->filters);
+    if (!chain->filters) return -1;
+    chain->n_filters = n_specs;
+
+    for (int i = 0; i < n_specs; ++i)
+    {
+        if (compile_one(&chain->filters[i], specs[i]))
+        {
+            filter_chain_free(chain);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void filter_chain_free(filter_chain_t *chain)
+{
+    if (!chain || !chain->filters) return;
+
+    for (int i = 0; i < chain->n_filters; ++i)
+        free(chain->filters[i].last);
+    free(chain->filters);
+    chain->filters = NULL;
+    chain->n_filters = 0;
+}
+
+/**
+ * Apply one filter to line in place.
+ * Line includes its \n if present.
+ * Returns new length, -1 to drop the line or -2 on error.
+ */
+static long apply(filter_t *f, char *line, size_t len)
+{
+    int has_nl = len && line[len - 1] == '\n';
+    size_t body = has_nl ? len - 1 : len;
+
+    switch (f->kind)
+    {
+        case FILTER_BLANK:
+            for (size_t i = 0; i < len; ++i)
+                if (!isspace((unsigned char) line[i])) return (long) len;
+            return -1;
+
+        case FILTER_RTRIM:
+            while (body && line[body - 1] != '\n' && isspace((unsigned char) line[body - 1]))
+                body--;
+            if (has_nl) line[body++] = '\n';
+            return (long) body;
+
+        case FILTER_SQUEEZE:
+            // compare without line terminator
+            if (f->has_last && f->last_len == body && !memcmp(f->last, line, body))
+                return -1;
+            if (body > f->last_cap)
+            {
+                size_t cap = f->last_cap ? f->last_cap : 256;
+                while (cap < body) cap *= 2;
+                char *last = realloc(f->last, cap);
+                if (!last) return -2;
+                f->last = last;
+                f->last_cap = cap;
+            }
+            memcpy(f->last, line, body);
+            f->last_len = body;
+            f->has_last = 1;
+            return (long) len;
+
+        case FILTER_COMMENT:
+        {
+            size_t i = 0;
+            while (i < body && isspace((unsigned char) line[i])) i++;
+            if (body - i >= f->prefix_len && !memcmp(line + i, f->prefix, f->prefix_len))
+                return -1;
+            return (long) len;
+        }
+
+        case FILTER_CRLF:
+            if (has_nl && body && line[body - 1] == '\r')
+            {
+                line[body - 1] = '\n';
+                return (long) body;
+            }
+            return (long) len;
+
+        default:
+            return -2;
+    }
+}
+
+long filter_run(filter_chain_t *chain, const char *buf, size_t len, int eof, char *out, size_t *out_len)
+{
+    if (!chain || !buf || !out || !out_len) return -1;
+
+    size_t pos = 0;
+    size_t written = 0;
+
+    while (pos < len)
+    {
+        const char *nl = memchr(buf + pos, '\n', len - pos);
+        size_t line_len;
+        if (nl) line_len = nl - (buf + pos) + 1;
+        else if (eof) line_len = len - pos;
+        // incomplete line, wait for more data
+        else break;
+
+        // work on the line in its output slot
+        char *line = out + written;
+        memcpy(line, buf + pos, line_len);
+        pos += line_len;
+
+        long cur = (long) line_len;
+        for (int i = 0; i < chain->n_filters && cur >= 0; ++i)
+        {
+            cur = apply(&chain->filters[i], line, (size_t) cur);
+            if (cur == -2) return -1;
+        }
+
+        if (cur > 0) written += cur;
+    }
+
+    *out_len = written;
+    return (long) pos;
+}
@@ -7,21 +7,41 @@ static const char HELP[] =
         "Usage:\n"
         "%s              - interactive mode\n"
         "%s INPUT OUTPUT - copy contents of INPUT to OUTPUT "
-        "removing empty lines\n";
+        "removing empty lines\n"
+        "%s INPUT OUTPUT FILTER... - copy contents of INPUT to OUTPUT "
+        "passing lines through filters in order\n"
+        "Filters:\n"
+        "  blank          - remove lines containing only whitespace\n"
+        "  rtrim          - remove whitespace at the end of lines\n"
+        "  squeeze        - remove repeated consecutive lines\n"
+        "  comment[=PFX]  - remove lines starting with PFX (default #)\n"
+        "  crlf           - convert CRLF line endings to LF\n";
 
 int main(int argc, char **argv)
 {
     int err = 0;
 
-    // either 0 or 2 arguments
-    if (argc != 3 && argc != 1)
+    // either 0 or at least 2 arguments
+    if (argc == 2)
     {
-        fprintf(stderr, HELP, argv[0], argv[0]);
+        fprintf(stderr, HELP, argv[0], argv[0], argv[0]);
         return -1;
     }
 
+    // files and filters in arguments
+    if (argc > 3)
+    {
+        filter_chain_t chain;
+        if (filter_chain_compile(&chain, (const char**) argv + 3, argc - 3))
+        {
+            fprintf(stderr, HELP, argv[0], argv[0], argv[0]);
+            return -1;
+        }
+        err = filter_copy(argv[1], argv[2], &chain);
+        filter_chain_free(&chain);
+    }
     // files in arguments
-    if (argc == 3)
+    else if (argc == 3)
     {
         const char *in_file = argv[1];
         const char *out_file = argv[2];
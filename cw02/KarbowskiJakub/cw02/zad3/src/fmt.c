@@ -0,0 +1,332 @@
+#include "fmt.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+static walk_format_t g_format = FORMAT_TEXT;
+
+static const char DAY_NAMES[7][3] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat",
+};
+
+static const char MONTH_NAMES[12][3] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+int walk_dir_set_format(walk_format_t format)
+{
+    switch (format)
+    {
+        case FORMAT_TEXT:
+        case FORMAT_NDJSON:
+        case FORMAT_BINARY:
+            g_format = format;
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Write decimal number, return number of chars.
+ */
+static size_t put_int(char *out, long long val)
+{
+    char tmp[24];
+    char *p = tmp + sizeof tmp;
+    unsigned long long u = val < 0 ? -(unsigned long long) val : (unsigned long long) val;
+
+    while (u >= 100)
+    {
+        p -= 2;
+        memcpy(p, &DIGIT_PAIRS[2 * (u % 100)], 2);
+        u /= 100;
+    }
+    if (u >= 10)
+    {
+        p -= 2;
+        memcpy(p, &DIGIT_PAIRS[2 * u], 2);
+    }
+    else *--p = (char) ('0' + u);
+
+    if (val < 0) *--p = '-';
+
+    size_t n = tmp + sizeof tmp - p;
+    memcpy(out, p, n);
+    return n;
+}
+
+static size_t put_str(char *out, const char *s, size_t n)
+{
+    memcpy(out, s, n);
+    return n;
+}
+
+/**
+ * Write time in ctime format without trailing newline.
+ * Broken-down time is cached per second.
+ */
+static size_t put_time(fmt_writer_t *w, char *out, time_t t)
+{
+    unsigned slot = (unsigned) ((unsigned long long) t % FMT_TIME_CACHE);
+    if (w->cache_valid[slot] && w->cache_time[slot] == t)
+        return put_str(out, w->cache_str[slot], 24);
+
+    struct tm tm;
+    if (!localtime_r(&t, &tm) || tm.tm_year + 1900 < 1000 || tm.tm_year + 1900 > 9999)
+    {
+        // rare dates, let libc format them
+        char buf[64];
+        if (!ctime_r(&t, buf)) return put_str(out, "?", 1);
+        size_t n = strlen(buf);
+        if (n && buf[n - 1] == '\n') n--;
+        return put_str(out, buf, n);
+    }
+
+    char *s = w->cache_str[slot];
+    memcpy(s, DAY_NAMES[tm.tm_wday], 3);
+    s[3] = ' ';
+    memcpy(s + 4, MONTH_NAMES[tm.tm_mon], 3);
+    s[7] = ' ';
+    if (tm.tm_mday < 10)
+    {
+        s[8] = ' ';
+        s[9] = (char) ('0' + tm.tm_mday);
+    }
+    else memcpy(s + 8, &DIGIT_PAIRS[2 * tm.tm_mday], 2);
+    s[10] = ' ';
+    memcpy(s + 11, &DIGIT_PAIRS[2 * tm.tm_hour], 2);
+    s[13] = ':';
+    memcpy(s + 14, &DIGIT_PAIRS[2 * tm.tm_min], 2);
+    s[16] = ':';
+    memcpy(s + 17, &DIGIT_PAIRS[2 * tm.tm_sec], 2);
+    s[19] = ' ';
+    put_int(s + 20, tm.tm_year + 1900);
+
+    w->cache_time[slot] = t;
+    w->cache_valid[slot] = 1;
+
+    return put_str(out, s, 24);
+}
+
+/**
+ * Write JSON string literal.
+ */
+static size_t put_json_str(char *out, const char *s, size_t n)
+{
+    static const char HEX[] = "0123456789abcdef";
+    char *p = out;
+
+    *p++ = '"';
+    for (size_t i = 0; i < n; ++i)
+    {
+        unsigned char c = (unsigned char) s[i];
+        if (c == '"' || c == '\\')
+        {
+            *p++ = '\\';
+            *p++ = (char) c;
+        }
+        else if (c < 0x20)
+        {
+            memcpy(p, "\\u00", 4);
+            p[4] = HEX[c >> 4];
+            p[5] = HEX[c & 0xf];
+            p += 6;
+        }
+        else *p++ = (char) c;
+    }
+    *p++ = '"';
+
+    return p - out;
+}
+
+static unsigned int type_code(const char *type)
+{
+    static const char *TYPES[] = {"fifo", "chr", "dir", "blk", "reg", "link", "sock"};
+    for (unsigned int i = 0; i < sizeof TYPES / sizeof *TYPES; ++i)
+        if (!strcmp(TYPES[i], type)) return i;
+    return (unsigned int) -1;
+}
+
+int fmt_init(fmt_writer_t *w, int fd)
+{
+    if (!w) return -1;
+
+    memset(w, 0, sizeof *w);
+    w->fd = fd;
+    w->format = g_format;
+    w->buf = malloc(FMT_BUF_SIZE);
+    if (!w->buf) return -1;
+
+    return 0;
+}
+
+int fmt_flush(fmt_writer_t *w)
+{
+    int err = 0;
+    size_t done = 0;
+
+    if (w->lock) pthread_mutex_lock(w->lock);
+    while (done < w->len)
+    {
+        ssize_t n = write(w->fd, w->buf + done, w->len - done);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            err = -1;
+            break;
+        }
+        done += n;
+    }
+    if (w->lock) pthread_mutex_unlock(w->lock);
+
+    w->len = 0;
+    return err;
+}
+
+int fmt_free(fmt_writer_t *w)
+{
+    if (!w || !w->buf) return 0;
+
+    int err = fmt_flush(w);
+    free(w->buf);
+    w->buf = NULL;
+
+    return err;
+}
+
+int fmt_entry(fmt_writer_t *w, const char *path, const char *type,
+              long long nlink, long long size, time_t atime, time_t mtime)
+{
+    size_t path_len = strlen(path);
+    // worst case is JSON escaping every byte
+    size_t max_len = 6 * path_len + 256;
+    if (max_len > FMT_BUF_SIZE) return -1;
+    if (FMT_BUF_SIZE - w->len < max_len && fmt_flush(w))
+        return -1;
+
+    char *start = w->buf + w->len;
+    char *p = start;
+
+    switch (w->format)
+    {
+        case FORMAT_TEXT:
+            p += put_str(p, path, path_len);
+            p += put_str(p, ":\n- links: ", 11);
+            p += put_int(p, nlink);
+            p += put_str(p, "\n- type:  ", 10);
+            p += put_str(p, type, strlen(type));
+            p += put_str(p, "\n- size:  ", 10);
+            p += put_int(p, size);
+            p += put_str(p, "B\n- atime: ", 11);
+            p += put_time(w, p, atime);
+            p += put_str(p, "\n- mtime: ", 10);
+            p += put_time(w, p, mtime);
+            *p++ = '\n';
+            break;
+
+        case FORMAT_NDJSON:
+            p += put_str(p, "{\"path\":", 8);
+            p += put_json_str(p, path, path_len);
+            p += put_str(p, ",\"type\":\"", 9);
+            p += put_str(p, type, strlen(type));
+            p += put_str(p, "\",\"links\":", 10);
+            p += put_int(p, nlink);
+            p += put_str(p, ",\"size\":", 8);
+            p += put_int(p, size);
+            p += put_str(p, ",\"atime\":", 9);
+            p += put_int(p, (long long) atime);
+            p += put_str(p, ",\"mtime\":", 9);
+            p += put_int(p, (long long) mtime);
+            p += put_str(p, "}\n", 2);
+            break;
+
+        case FORMAT_BINARY:
+        {
+            fmt_bin_record_t rec = {
+                .rec_len = (unsigned int) (sizeof rec + path_len),
+                .path_len = (unsigned int) path_len,
+                .type = type_code(type),
+                .pad = 0,
+                .nlink = nlink,
+                .size = size,
+                .atime = (long long) atime,
+                .mtime = (long long) mtime,
+            };
+            p += put_str(p, (const char*) &rec, sizeof rec);
+            p += put_str(p, path, path_len);
+            break;
+        }
+
+        default:
+            return -1;
+    }
+
+    w->len += p - start;
+    return 0;
+}
+
+int fmt_du(fmt_writer_t *w, const char *path, long long usage)
+{
+    size_t path_len = strlen(path);
+    size_t max_len = 6 * path_len + 64;
+    if (max_len > FMT_BUF_SIZE) return -1;
+    if (FMT_BUF_SIZE - w->len < max_len && fmt_flush(w))
+        return -1;
+
+    char *start = w->buf + w->len;
+    char *p = start;
+
+    switch (w->format)
+    {
+        case FORMAT_TEXT:
+            p += put_int(p, usage);
+            *p++ = '\t';
+            p += put_str(p, path, path_len);
+            *p++ = '\n';
+            break;
+
+        case FORMAT_NDJSON:
+            p += put_str(p, "{\"path\":", 8);
+            p += put_json_str(p, path, path_len);
+            p += put_str(p, ",\"du\":", 6);
+            p += put_int(p, usage);
+            p += put_str(p, "}\n", 2);
+            break;
+
+        case FORMAT_BINARY:
+        {
+            fmt_bin_record_t rec = {
+                .rec_len = (unsigned int) (sizeof rec + path_len),
+                .path_len = (unsigned int) path_len,
+                .type = FMT_TYPE_DU,
+                .size = usage,
+            };
+            p += put_str(p, (const char*) &rec, sizeof rec);
+            p += put_str(p, path, path_len);
+            break;
+        }
+
+        default:
+            return -1;
+    }
+
+    w->len += p - start;
+    return 0;
+}
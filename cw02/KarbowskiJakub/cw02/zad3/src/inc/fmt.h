@@ -0,0 +1,89 @@
+#ifndef JK_02_03_FMT_H
+#define JK_02_03_FMT_H
+
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include "walkdir.h"
+
+#define FMT_BUF_SIZE (256 * 1024)
+#define FMT_TIME_CACHE (64)
+#define FMT_TYPE_DU (7)
+
+/**
+ * Binary record header (FORMAT_BINARY).
+ * Followed by path_len bytes of path without terminator.
+ * Disk usage records have type FMT_TYPE_DU and usage in size.
+ * Fields are in host byte order.
+ */
+typedef struct fmt_bin_record_t
+{
+    unsigned int rec_len;
+    unsigned int path_len;
+    unsigned int type;
+    unsigned int pad;
+    long long nlink;
+    long long size;
+    long long atime;
+    long long mtime;
+} fmt_bin_record_t;
+
+/**
+ * Output buffer of one walker thread.
+ */
+typedef struct fmt_writer_t
+{
+    int fd;
+    walk_format_t format;
+    char *buf;
+    size_t len;
+    // optional, held while writing to fd
+    pthread_mutex_t *lock;
+
+    // ctime strings of recently seen seconds
+    time_t cache_time[FMT_TIME_CACHE];
+    char cache_str[FMT_TIME_CACHE][24];
+    unsigned char cache_valid[FMT_TIME_CACHE];
+} fmt_writer_t;
+
+/**
+ * Create writer using format selected with walk_dir_set_format.
+ *
+ * @param w Output writer.
+ * @param fd Output file descriptor.
+ * @return 0 or negative error.
+ */
+int fmt_init(fmt_writer_t *w, int fd);
+
+/**
+ * Flush and destroy writer.
+ *
+ * @return 0 or negative error of the final flush.
+ */
+int fmt_free(fmt_writer_t *w);
+
+/**
+ * Write buffered records to the file descriptor.
+ *
+ * @return 0 or negative error.
+ */
+int fmt_flush(fmt_writer_t *w);
+
+/**
+ * Append one entry to the output.
+ *
+ * @param type Entry type name (reg, dir, ...).
+ * @return 0 or negative error.
+ */
+int fmt_entry(fmt_writer_t *w, const char *path, const char *type,
+              long long nlink, long long size, time_t atime, time_t mtime);
+
+/**
+ * Append disk usage of directory to the output.
+ *
+ * @param usage Usage of directory subtree in bytes.
+ * @return 0 or negative error.
+ */
+int fmt_du(fmt_writer_t *w, const char *path, long long usage);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef JK_02_03_INOSET_H
+#define JK_02_03_INOSET_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct ino_key_t
+{
+    unsigned long long dev;
+    unsigned long long ino;
+} ino_key_t;
+
+/**
+ * Open addressing hash set of (dev, ino) pairs.
+ * Zero inode marks an empty slot.
+ */
+typedef struct inoset_t
+{
+    ino_key_t *slots;
+    size_t cap;
+    size_t size;
+} inoset_t;
+
+/**
+ * Create empty set.
+ *
+ * @return 0 or negative error.
+ */
+int inoset_init(inoset_t *set);
+
+/**
+ * Destroy set.
+ */
+void inoset_free(inoset_t *set);
+
+/**
+ * Insert inode if not present.
+ *
+ * @return 1 if inserted, 0 if already present or negative error.
+ */
+int inoset_insert(inoset_t *set, dev_t dev, ino_t ino);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef JK_02_03_URING_H
+#define JK_02_03_URING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/**
+ * Minimal io_uring instance
+ * driven directly through syscalls.
+ */
+typedef struct uring_t
+{
+    int fd;
+    unsigned entries;
+    // submissions waiting for io_uring_enter
+    unsigned to_submit;
+    // tail including entries not yet published to the kernel
+    unsigned sqe_tail;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+} uring_t;
+
+/**
+ * Create ring with given number of submission entries.
+ *
+ * @param ring Output ring.
+ * @param entries Submission queue size.
+ * @return 0 or negative error.
+ */
+int uring_init(uring_t *ring, unsigned entries);
+
+/**
+ * Destroy ring.
+ */
+void uring_free(uring_t *ring);
+
+/**
+ * Get next free submission entry.
+ *
+ * @return Zeroed entry or NULL if queue is full.
+ */
+struct io_uring_sqe* uring_get_sqe(uring_t *ring);
+
+/**
+ * Submit queued entries and wait for completions.
+ *
+ * @param wait_nr Minimum number of completions to wait for.
+ * @return 0 or negative error.
+ */
+int uring_submit_and_wait(uring_t *ring, unsigned wait_nr);
+
+/**
+ * Get next completion without waiting.
+ *
+ * @return Completion or NULL if none is ready.
+ */
+struct io_uring_cqe* uring_peek_cqe(uring_t *ring);
+
+/**
+ * Mark completion returned by uring_peek_cqe as consumed.
+ */
+void uring_cqe_seen(uring_t *ring);
+
+#endif
@@ -16,6 +16,24 @@ typedef struct dir_stats_t
     int n_sock;
 } dir_stats_t;
 
+typedef enum walk_backend_t
+{
+    // one lstat per entry
+    BACKEND_SYNC,
+    // statx of whole directory batched through io_uring
+    BACKEND_URING,
+} walk_backend_t;
+
+typedef enum walk_format_t
+{
+    // human readable listing
+    FORMAT_TEXT,
+    // one JSON object per line
+    FORMAT_NDJSON,
+    // fmt_bin_record_t records
+    FORMAT_BINARY,
+} walk_format_t;
+
 /**
  * Walk directory and save statistics.
  *
@@ -25,4 +43,65 @@ typedef struct dir_stats_t
  */
 int walk_dir(const char *path, dir_stats_t *stats);
 
+/**
+ * Count entries of directory without printing them,
+ * reusing results saved in index file by the previous run.
+ * Directories with unchanged mtime and ctime are not read again,
+ * only their subdirectories are checked.
+ * Index file is created or updated.
+ *
+ * @param path Input directory.
+ * @param stats Output statistics.
+ * @param index_path Index file.
+ * @param n_scanned Optional output, number of directories read.
+ * @return 0 or negative error.
+ */
+int walk_dir_incremental(const char *path, dir_stats_t *stats, const char *index_path, long *n_scanned);
+
+/**
+ * Select how walk_dir gets metadata of entries.
+ * Default is BACKEND_SYNC.
+ *
+ * @param backend Backend to use in subsequent walks.
+ * @return 0 or negative error if backend
+ *         is not available in this build or kernel.
+ */
+int walk_dir_set_backend(walk_backend_t backend);
+
+/**
+ * Enable du mode of walk_dir.
+ * Instead of the entry listing, every directory is printed
+ * with disk usage of its subtree (st_blocks * 512 bytes).
+ * Files with multiple hard links are counted once.
+ *
+ * @param enabled Nonzero to enable.
+ * @return 0 or negative error if not available in this build.
+ */
+int walk_dir_set_du(int enabled);
+
+/**
+ * Select how entries are printed.
+ * Default is FORMAT_TEXT.
+ *
+ * @param format Format to use in subsequent walks.
+ * @return 0 or negative error.
+ */
+int walk_dir_set_format(walk_format_t format);
+
+/**
+ * Walk directory using multiple threads and save statistics.
+ * Pending directories are kept in per-thread deques,
+ * idle threads steal work from the others and sleep
+ * when there is nothing to steal.
+ * Entries are stat'ed with lstat, the backend is not used.
+ *
+ * @param path Input directory.
+ * @param stats Output statistics.
+ * @param n_threads Number of worker threads.
+ * @param sorted If set, entries are printed in the order of walk_dir
+ *               with sync backend, otherwise in unspecified order.
+ * @return 0 or negative error.
+ */
+int walk_dir_parallel(const char *path, dir_stats_t *stats, int n_threads, int sorted);
+
 #endif
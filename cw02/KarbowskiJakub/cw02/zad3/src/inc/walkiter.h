@@ -0,0 +1,92 @@
+#ifndef JK_02_03_WALKITER_H
+#define JK_02_03_WALKITER_H
+
+#include <stddef.h>
+#include <time.h>
+
+typedef enum walk_type_t
+{
+    WALK_FIFO,
+    WALK_CHR,
+    WALK_DIR,
+    WALK_BLK,
+    WALK_REG,
+    WALK_LINK,
+    WALK_SOCK,
+} walk_type_t;
+
+/**
+ * Entry produced by the iterator.
+ * Strings point into the buffer passed to walk_iter_next.
+ */
+typedef struct walk_entry_t
+{
+    // last component of path
+    const char *name;
+    // path relative to walk_iter_rootfd, "." for the root
+    const char *path;
+    // 0 for the root
+    int depth;
+    walk_type_t type;
+    long long nlink;
+    long long size;
+    struct timespec atime;
+    struct timespec mtime;
+} walk_entry_t;
+
+/**
+ * Directory tree iterator.
+ * Iterators share no state, each one may be used
+ * by a different thread at the same time.
+ */
+typedef struct walk_iter_t walk_iter_t;
+
+/**
+ * Start iterating over directory tree.
+ * Entries are returned in pre-order, symbolic links are not followed.
+ * At most WALK_MAX_OPEN directories stay open, names left in
+ * shallower ones are read into memory and their streams closed.
+ *
+ * @param path Root of the tree.
+ * @return Iterator or NULL on error.
+ */
+walk_iter_t* walk_iter_open(const char *path);
+
+/**
+ * Get next batch of entries.
+ * Entry strings are stored in buf and stay valid
+ * until the buffer is reused.
+ *
+ * @param it Iterator.
+ * @param ents Output entries.
+ * @param max_ents Size of ents.
+ * @param buf Storage for entry strings.
+ * @param buf_size Size of buf, at least PATH_MAX guarantees progress.
+ * @return Number of entries, 0 at the end or negative error.
+ */
+int walk_iter_next(walk_iter_t *it, walk_entry_t *ents, int max_ents, char *buf, size_t buf_size);
+
+/**
+ * Get descriptor of the root directory,
+ * entry paths can be passed to openat and fstatat with it.
+ * Valid until walk_iter_close.
+ */
+int walk_iter_rootfd(const walk_iter_t *it);
+
+/**
+ * Finish iteration and release resources.
+ */
+void walk_iter_close(walk_iter_t *it);
+
+/**
+ * Walk directory tree calling cb for every entry.
+ * Walk stops when cb returns nonzero, that value is returned.
+ *
+ * @param path Root of the tree.
+ * @param cb Callback.
+ * @param arg Argument passed to cb.
+ * @return 0, callback's result or negative error.
+ */
+int walk_dir_cb(const char *path, int (*cb)(const walk_entry_t *ent, void *arg), void *arg);
+
+#endif
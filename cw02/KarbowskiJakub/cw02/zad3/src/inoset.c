@@ -0,0 +1,81 @@
+#include "inoset.h"
+
+#include <stdlib.h>
+
+#define INOSET_INIT_CAP (1024)
+
+static size_t hash_key(unsigned long long dev, unsigned long long ino)
+{
+    // splitmix64 finalizer
+    unsigned long long h = ino ^ (dev * 0x9e3779b97f4a7c15ull);
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return (size_t) h;
+}
+
+static void insert_slot(ino_key_t *slots, size_t cap, ino_key_t key)
+{
+    size_t i = hash_key(key.dev, key.ino) & (cap - 1);
+    while (slots[i].ino) i = (i + 1) & (cap - 1);
+    slots[i] = key;
+}
+
+int inoset_init(inoset_t *set)
+{
+    if (!set) return -1;
+
+    set->slots = calloc(INOSET_INIT_CAP, sizeof *set->slots);
+    if (!set->slots) return -1;
+    set->cap = INOSET_INIT_CAP;
+    set->size = 0;
+
+    return 0;
+}
+
+void inoset_free(inoset_t *set)
+{
+    if (!set) return;
+    free(set->slots);
+    set->slots = NULL;
+    set->cap = 0;
+    set->size = 0;
+}
+
+int inoset_insert(inoset_t *set, dev_t dev, ino_t ino)
+{
+    // inode 0 is used as the empty marker
+    if (!ino) return -1;
+
+    ino_key_t key = {(unsigned long long) dev, (unsigned long long) ino};
+
+    size_t i = hash_key(key.dev, key.ino) & (set->cap - 1);
+    while (set->slots[i].ino)
+    {
+        if (set->slots[i].ino == key.ino && set->slots[i].dev == key.dev)
+            return 0;
+        i = (i + 1) & (set->cap - 1);
+    }
+
+    // keep load factor at most 1/2
+    if (2 * (set->size + 1) > set->cap)
+    {
+        size_t cap = 2 * set->cap;
+        ino_key_t *slots = calloc(cap, sizeof *slots);
+        if (!slots) return -1;
+
+        for (size_t j = 0; j < set->cap; ++j)
+            if (set->slots[j].ino) insert_slot(slots, cap, set->slots[j]);
+
+        free(set->slots);
+        set->slots = slots;
+        set->cap = cap;
+        insert_slot(set->slots, set->cap, key);
+    }
+    else set->slots[i] = key;
+
+    set->size++;
+    return 1;
+}
@@ -1,29 +1,137 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
 #include "walkdir.h"
 
 static const char HELP[] =
         "SO Lab2 Zad3 - Jakub Karbowski\n"
         "Usage:\n"
-        "%s DIR - walk DIR and print statistics\n";
+        "%s [-j THREADS] [-s] [-b sync|uring] [-f text|ndjson|bin] [-d] DIR - walk DIR and print statistics\n"
+        "%s -i INDEX DIR - count entries of DIR using INDEX from previous runs\n"
+        "Options:\n"
+        "-b BACKEND - stat entries one by one (sync) or in batches (uring)\n"
+        "-f FORMAT  - entry listing format, summary goes to stderr "
+        "unless FORMAT is text\n"
+        "-d         - print disk usage of directories instead of entries\n"
+        "-i INDEX   - skip unchanged directories, entries are not listed\n"
+        "-j THREADS - walk using THREADS worker threads, "
+        "only with sync backend\n"
+        "-s         - print entries in the same order as the walk "
+        "without -j\n";
 
 int main(int argc, char **argv)
 {
-    if (argc != 2)
+    long n_threads = 0;
+    int sorted = 0;
+    walk_format_t format = FORMAT_TEXT;
+    const char *index_path = NULL;
+    int du = 0;
+    walk_backend_t backend = BACKEND_SYNC;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:sb:f:i:d")) != -1)
+    {
+        char *endptr;
+        switch (opt)
+        {
+            case 'j':
+                n_threads = strtol(optarg, &endptr, 10);
+                if (*endptr || n_threads < 1 || n_threads > 1024)
+                {
+                    fprintf(stderr, "Invalid THREADS: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 's':
+                sorted = 1;
+                break;
+
+            case 'b':
+            {
+                if (!strcmp("sync", optarg)) backend = BACKEND_SYNC;
+                else if (!strcmp("uring", optarg)) backend = BACKEND_URING;
+                else
+                {
+                    fprintf(stderr, "Invalid backend: %s\n", optarg);
+                    return -1;
+                }
+                if (walk_dir_set_backend(backend))
+                {
+                    fprintf(stderr, "Backend not available: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            }
+
+            case 'f':
+                if (!strcmp("text", optarg)) format = FORMAT_TEXT;
+                else if (!strcmp("ndjson", optarg)) format = FORMAT_NDJSON;
+                else if (!strcmp("bin", optarg)) format = FORMAT_BINARY;
+                else
+                {
+                    fprintf(stderr, "Invalid format: %s\n", optarg);
+                    return -1;
+                }
+                walk_dir_set_format(format);
+                break;
+
+            case 'i':
+                index_path = optarg;
+                break;
+
+            case 'd':
+                if (walk_dir_set_du(1))
+                {
+                    fprintf(stderr, "Disk usage not available\n");
+                    return -1;
+                }
+                du = 1;
+                break;
+
+            default:
+                fprintf(stderr, HELP, argv[0], argv[0]);
+                return -1;
+        }
+    }
+
+    // parallel walker stats with lstat only
+    if (argc - optind != 1 || (index_path && (n_threads || sorted))
+        || (backend == BACKEND_URING && (n_threads || sorted))
+        || (du && (n_threads || sorted || index_path)))
     {
-        fprintf(stderr, HELP, argv[0]);
+        fprintf(stderr, HELP, argv[0], argv[0]);
         return -1;
     }
+    const char *path = argv[optind];
+
+    // sorted output is always produced by the parallel walker
+    if (sorted && !n_threads) n_threads = 1;
+
+    // keep machine readable listings clean
+    FILE *info = format == FORMAT_TEXT ? stdout : stderr;
 
     dir_stats_t stats;
-    printf("Walking %s\n", argv[1]);
-    int err = walk_dir(argv[1], &stats);
+    fprintf(info, "Walking %s\n", path);
+    fflush(info);
+    int err;
+    long n_scanned;
+    if (index_path)
+    {
+        err = walk_dir_incremental(path, &stats, index_path, &n_scanned);
+        if (!err) fprintf(info, "Scanned %ld directories\n", n_scanned);
+    }
+    else if (n_threads) err = walk_dir_parallel(path, &stats, (int) n_threads, sorted);
+    else err = walk_dir(path, &stats);
     if (err)
     {
         fprintf(stderr, "Error!\n");
         return -1;
     }
 
-    printf(
+    fprintf(
+        info,
         "\nSummary:\n"
         "reg:  %d\n"
         "dir:  %d\n"
@@ -42,4 +150,4 @@ int main(int argc, char **argv)
     );
 
     return 0;
-}
\ No newline at end of file
+}
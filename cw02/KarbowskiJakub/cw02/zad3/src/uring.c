@@ -0,0 +1,144 @@
+#include "uring.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+int uring_init(uring_t *ring, unsigned entries)
+{
+    if (!ring || !entries) return -1;
+
+    memset(ring, 0, sizeof *ring);
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof params);
+
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return -1;
+
+    ring->entries = params.sq_entries;
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    int single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+    {
+        if (ring->cq_len > ring->sq_len) ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED)
+    {
+        ring->sq_ptr = NULL;
+        uring_free(ring);
+        return -1;
+    }
+
+    if (single_mmap) ring->cq_ptr = ring->sq_ptr;
+    else
+    {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED)
+        {
+            ring->cq_ptr = NULL;
+            uring_free(ring);
+            return -1;
+        }
+    }
+
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        uring_free(ring);
+        return -1;
+    }
+
+    char *sq = ring->sq_ptr;
+    ring->sq_head = (unsigned*) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*) (sq + params.sq_off.array);
+    ring->sqe_tail = *ring->sq_tail;
+
+    char *cq = ring->cq_ptr;
+    ring->cq_head = (unsigned*) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+void uring_free(uring_t *ring)
+{
+    if (!ring) return;
+
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_len);
+    if (ring->sq_ptr) munmap(ring->sq_ptr, ring->sq_len);
+    if (ring->fd >= 0) close(ring->fd);
+
+    memset(ring, 0, sizeof *ring);
+    ring->fd = -1;
+}
+
+struct io_uring_sqe* uring_get_sqe(uring_t *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = ring->sqe_tail;
+    if (tail - head >= ring->entries) return NULL;
+
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof *sqe);
+
+    ring->sq_array[idx] = idx;
+    // published in uring_submit_and_wait, after caller fills the entry
+    ring->sqe_tail = tail + 1;
+    ring->to_submit++;
+
+    return sqe;
+}
+
+int uring_submit_and_wait(uring_t *ring, unsigned wait_nr)
+{
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+
+    // publish filled entries to the kernel
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+    for (;;)
+    {
+        long n = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit,
+                         wait_nr, flags, NULL, 0);
+        if (n >= 0)
+        {
+            ring->to_submit -= (unsigned) n;
+            return 0;
+        }
+        if (errno != EINTR) return -1;
+    }
+}
+
+struct io_uring_cqe* uring_peek_cqe(uring_t *ring)
+{
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) return NULL;
+
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(uring_t *ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
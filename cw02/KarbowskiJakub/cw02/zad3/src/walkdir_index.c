@@ -0,0 +1,589 @@
+#include "walkdir.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define INDEX_MAGIC (0x49574b4au) // "JKWI"
+#define INDEX_VERSION (2u)
+
+/**
+ * Index file layout, all fields in host byte order:
+ *
+ * header:  u32 magic, u32 version, i64 created_sec, u32 n_records
+ * record:  u32 path_len, path,
+ *          i64 mtime_sec, i64 mtime_nsec, i64 ctime_sec, i64 ctime_nsec,
+ *          dir_stats_t own,
+ *          u32 n_subdirs, n_subdirs * (u32 name_len, name)
+ *
+ * Records are written in post-order, strings are not terminated.
+ */
+
+typedef struct index_rec_t
+{
+    const char *path;
+    uint32_t path_len;
+    struct timespec mtime;
+    struct timespec ctime;
+    // counts of direct children
+    dir_stats_t own;
+    uint32_t n_subdirs;
+    // position of subdir names in the file
+    const char *subdirs;
+} index_rec_t;
+
+typedef struct index_t
+{
+    char *data;
+    size_t size;
+    long long created;
+    index_rec_t *recs;
+    uint32_t n_recs;
+    // open addressing table of record indices + 1
+    uint32_t *table;
+    size_t table_size;
+} index_t;
+
+typedef struct index_ctx_t
+{
+    index_t old;
+    FILE *out;
+    uint32_t n_written;
+    long n_scanned;
+} index_ctx_t;
+
+static uint64_t hash_path(const char *path, size_t len)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char) path[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/**
+ * Read bytes at cursor with bounds check.
+ */
+static int take(const char **cur, const char *end, void *out, size_t n)
+{
+    if ((size_t) (end - *cur) < n) return -1;
+    if (out) memcpy(out, *cur, n);
+    *cur += n;
+    return 0;
+}
+
+static int take_ts(const char **cur, const char *end, struct timespec *ts)
+{
+    int64_t sec, nsec;
+    if (take(cur, end, &sec, sizeof sec)) return -1;
+    if (take(cur, end, &nsec, sizeof nsec)) return -1;
+    ts->tv_sec = (time_t) sec;
+    ts->tv_nsec = (long) nsec;
+    return 0;
+}
+
+static void index_free(index_t *idx)
+{
+    free(idx->data);
+    free(idx->recs);
+    free(idx->table);
+    memset(idx, 0, sizeof *idx);
+}
+
+static int index_parse(index_t *idx)
+{
+    const char *cur = idx->data;
+    const char *end = idx->data + idx->size;
+
+    uint32_t magic, version, n_recs;
+    int64_t created;
+    if (take(&cur, end, &magic, sizeof magic)) return -1;
+    if (take(&cur, end, &version, sizeof version)) return -1;
+    if (take(&cur, end, &created, sizeof created)) return -1;
+    if (take(&cur, end, &n_recs, sizeof n_recs)) return -1;
+    if (magic != INDEX_MAGIC || version != INDEX_VERSION) return -1;
+
+    idx->created = created;
+    idx->recs = malloc((n_recs ? n_recs : 1) * sizeof *idx->recs);
+    if (!idx->recs) return -1;
+
+    for (uint32_t i = 0; i < n_recs; ++i)
+    {
+        index_rec_t *rec = &idx->recs[i];
+
+        if (take(&cur, end, &rec->path_len, sizeof rec->path_len)) return -1;
+        rec->path = cur;
+        if (take(&cur, end, NULL, rec->path_len)) return -1;
+        if (take_ts(&cur, end, &rec->mtime)) return -1;
+        if (take_ts(&cur, end, &rec->ctime)) return -1;
+        if (take(&cur, end, &rec->own, sizeof rec->own)) return -1;
+        if (take(&cur, end, &rec->n_subdirs, sizeof rec->n_subdirs)) return -1;
+
+        rec->subdirs = cur;
+        for (uint32_t j = 0; j < rec->n_subdirs; ++j)
+        {
+            uint32_t len;
+            if (take(&cur, end, &len, sizeof len)) return -1;
+            if (take(&cur, end, NULL, len)) return -1;
+        }
+    }
+    idx->n_recs = n_recs;
+
+    idx->table_size = 16;
+    while (idx->table_size < 2 * (size_t) n_recs) idx->table_size *= 2;
+    idx->table = calloc(idx->table_size, sizeof *idx->table);
+    if (!idx->table) return -1;
+
+    for (uint32_t i = 0; i < n_recs; ++i)
+    {
+        size_t slot = hash_path(idx->recs[i].path, idx->recs[i].path_len) & (idx->table_size - 1);
+        while (idx->table[slot]) slot = (slot + 1) & (idx->table_size - 1);
+        idx->table[slot] = i + 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Load index file, missing file gives empty index.
+ */
+static int index_load(index_t *idx, const char *index_path)
+{
+    memset(idx, 0, sizeof *idx);
+
+    FILE *f = fopen(index_path, "r");
+    if (!f) return 0;
+
+    int err = 0;
+    do
+    {
+        if (fseek(f, 0, SEEK_END))
+        {
+            err = -1;
+            break;
+        }
+        long size = ftell(f);
+        if (size < 0 || fseek(f, 0, SEEK_SET))
+        {
+            err = -1;
+            break;
+        }
+
+        idx->size = (size_t) size;
+        idx->data = malloc(idx->size ? idx->size : 1);
+        if (!idx->data)
+        {
+            err = -1;
+            break;
+        }
+        if (fread(idx->data, 1, idx->size, f) != idx->size)
+        {
+            err = -1;
+            break;
+        }
+
+        err = index_parse(idx);
+    } while (0);
+
+    fclose(f);
+
+    // unreadable index is rebuilt from scratch
+    if (err) index_free(idx);
+
+    return 0;
+}
+
+static const index_rec_t* index_find(const index_t *idx, const char *path)
+{
+    if (!idx->n_recs) return NULL;
+
+    size_t len = strlen(path);
+    size_t slot = hash_path(path, len) & (idx->table_size - 1);
+    while (idx->table[slot])
+    {
+        const index_rec_t *rec = &idx->recs[idx->table[slot] - 1];
+        if (rec->path_len == len && !memcmp(rec->path, path, len))
+            return rec;
+        slot = (slot + 1) & (idx->table_size - 1);
+    }
+    return NULL;
+}
+
+static int ts_equal(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+static void stats_add(dir_stats_t *dst, const dir_stats_t *src)
+{
+    dst->n_fifo += src->n_fifo;
+    dst->n_chr += src->n_chr;
+    dst->n_dir += src->n_dir;
+    dst->n_blk += src->n_blk;
+    dst->n_reg += src->n_reg;
+    dst->n_link += src->n_link;
+    dst->n_sock += src->n_sock;
+}
+
+static int count_mode(dir_stats_t *stats, mode_t mode)
+{
+    if (S_ISFIFO(mode)) stats->n_fifo++;
+    else if (S_ISCHR(mode)) stats->n_chr++;
+    else if (S_ISDIR(mode)) stats->n_dir++;
+    else if (S_ISBLK(mode)) stats->n_blk++;
+    else if (S_ISREG(mode)) stats->n_reg++;
+    else if (S_ISLNK(mode)) stats->n_link++;
+    else if (S_ISSOCK(mode)) stats->n_sock++;
+    else return -1;
+    return 0;
+}
+
+/**
+ * Name list of subdirectories found while scanning.
+ */
+typedef struct name_list_t
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    uint32_t n;
+} name_list_t;
+
+static int name_list_add(name_list_t *list, const char *name)
+{
+    uint32_t len = (uint32_t) strlen(name);
+    size_t need = list->len + sizeof len + len;
+    if (need > list->cap)
+    {
+        size_t cap = list->cap ? 2 * list->cap : 256;
+        while (cap < need) cap *= 2;
+        char *data = realloc(list->data, cap);
+        if (!data) return -1;
+        list->data = data;
+        list->cap = cap;
+    }
+
+    memcpy(list->data + list->len, &len, sizeof len);
+    memcpy(list->data + list->len + sizeof len, name, len);
+    list->len = need;
+    list->n++;
+
+    return 0;
+}
+
+/**
+ * Read directory and count its direct children by type.
+ */
+static int scan_dir(const char *path, dir_stats_t *own, name_list_t *subdirs)
+{
+    DIR *dir = opendir(path);
+    if (!dir) return -1;
+
+    int err = 0;
+    for (;;)
+    {
+        struct dirent *ent = readdir(dir);
+        if (!ent) break;
+
+        // skip . and ..
+        if (!strcmp(".", ent->d_name) || !strcmp("..", ent->d_name))
+            continue;
+
+        mode_t mode;
+        switch (ent->d_type)
+        {
+            case DT_FIFO: mode = S_IFIFO; break;
+            case DT_CHR: mode = S_IFCHR; break;
+            case DT_DIR: mode = S_IFDIR; break;
+            case DT_BLK: mode = S_IFBLK; break;
+            case DT_REG: mode = S_IFREG; break;
+            case DT_LNK: mode = S_IFLNK; break;
+            case DT_SOCK: mode = S_IFSOCK; break;
+
+            default:
+            {
+                // filesystem does not report types
+                struct stat st;
+                if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW))
+                {
+                    err = -1;
+                    break;
+                }
+                mode = st.st_mode;
+                break;
+            }
+        }
+        if (err) break;
+
+        err = count_mode(own, mode);
+        if (err) break;
+
+        if (S_ISDIR(mode))
+        {
+            err = name_list_add(subdirs, ent->d_name);
+            if (err) break;
+        }
+    }
+
+    closedir(dir);
+
+    return err;
+}
+
+static int write_ts(FILE *f, const struct timespec *ts)
+{
+    int64_t sec = ts->tv_sec;
+    int64_t nsec = ts->tv_nsec;
+    if (fwrite(&sec, sizeof sec, 1, f) != 1) return -1;
+    if (fwrite(&nsec, sizeof nsec, 1, f) != 1) return -1;
+    return 0;
+}
+
+static int write_record(index_ctx_t *ctx, const char *path, const struct stat *st,
+                        const dir_stats_t *own,
+                        uint32_t n_subdirs, const char *subdirs, size_t subdirs_len)
+{
+    FILE *f = ctx->out;
+    uint32_t path_len = (uint32_t) strlen(path);
+
+    if (fwrite(&path_len, sizeof path_len, 1, f) != 1) return -1;
+    if (fwrite(path, 1, path_len, f) != path_len) return -1;
+    if (write_ts(f, &st->st_mtim)) return -1;
+    if (write_ts(f, &st->st_ctim)) return -1;
+    if (fwrite(own, sizeof *own, 1, f) != 1) return -1;
+    if (fwrite(&n_subdirs, sizeof n_subdirs, 1, f) != 1) return -1;
+    if (fwrite(subdirs, 1, subdirs_len, f) != subdirs_len) return -1;
+
+    ctx->n_written++;
+    return 0;
+}
+
+/**
+ * Check if cached record still describes directory.
+ * Directories modified within a second of the previous run
+ * are rescanned, their changes could share the timestamp.
+ */
+static int record_valid(const index_ctx_t *ctx, const index_rec_t *rec, const struct stat *st)
+{
+    if (!rec) return 0;
+    if (!ts_equal(&rec->mtime, &st->st_mtim)) return 0;
+    if (!ts_equal(&rec->ctime, &st->st_ctim)) return 0;
+    if (st->st_ctim.tv_sec >= ctx->old.created - 1) return 0;
+    return 1;
+}
+
+static int index_dir(index_ctx_t *ctx, const char *path, const struct stat *st, dir_stats_t *subtree);
+
+/**
+ * Walk subdirectories from a name list.
+ * Returns 1 if a listed name is no longer a directory.
+ */
+static int index_subdirs(index_ctx_t *ctx, const char *path, uint32_t n, const char *names, dir_stats_t *subtree)
+{
+    const char *cur = names;
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        uint32_t len;
+        memcpy(&len, cur, sizeof len);
+        cur += sizeof len;
+
+        size_t path_len = strlen(path);
+        if (path_len + len + 2 > PATH_MAX) return -1;
+
+        char sub_path[PATH_MAX];
+        memcpy(sub_path, path, path_len);
+        sub_path[path_len] = '/';
+        memcpy(sub_path + path_len + 1, cur, len);
+        sub_path[path_len + 1 + len] = 0;
+        cur += len;
+
+        struct stat sub_st;
+        if (lstat(sub_path, &sub_st) || !S_ISDIR(sub_st.st_mode))
+            return 1;
+
+        dir_stats_t sub;
+        int err = index_dir(ctx, sub_path, &sub_st, &sub);
+        if (err) return err;
+        stats_add(subtree, &sub);
+    }
+
+    return 0;
+}
+
+/**
+ * Count all descendants of directory,
+ * reusing its cached children if it did not change.
+ */
+static int index_dir(index_ctx_t *ctx, const char *path, const struct stat *st, dir_stats_t *subtree)
+{
+    const index_rec_t *rec = index_find(&ctx->old, path);
+    int reuse = record_valid(ctx, rec, st);
+
+    for (;;)
+    {
+        int err = 0;
+        dir_stats_t own = {0};
+        name_list_t scanned = {0};
+        uint32_t n_subdirs;
+        const char *subdirs;
+        size_t subdirs_len;
+
+        if (reuse)
+        {
+            own = rec->own;
+            n_subdirs = rec->n_subdirs;
+            subdirs = rec->subdirs;
+            // names end where the next record starts
+            const char *cur = subdirs;
+            for (uint32_t i = 0; i < n_subdirs; ++i)
+            {
+                uint32_t len;
+                memcpy(&len, cur, sizeof len);
+                cur += sizeof len + len;
+            }
+            subdirs_len = cur - subdirs;
+        }
+        else
+        {
+            ctx->n_scanned++;
+            err = scan_dir(path, &own, &scanned);
+            if (err)
+            {
+                free(scanned.data);
+                return -1;
+            }
+            n_subdirs = scanned.n;
+            subdirs = scanned.data;
+            subdirs_len = scanned.len;
+        }
+
+        // records of subdirectories are dropped if this one is read again
+        long rec_pos = ftell(ctx->out);
+        uint32_t n_written = ctx->n_written;
+        long n_scanned = ctx->n_scanned;
+        if (rec_pos < 0)
+        {
+            free(scanned.data);
+            return -1;
+        }
+
+        *subtree = own;
+        err = index_subdirs(ctx, path, n_subdirs, subdirs, subtree);
+
+        if (err == 1 && reuse)
+        {
+            // tree changed under a cached directory, read it again
+            free(scanned.data);
+            if (fseek(ctx->out, rec_pos, SEEK_SET)) return -1;
+            ctx->n_written = n_written;
+            ctx->n_scanned = n_scanned;
+            reuse = 0;
+            continue;
+        }
+
+        if (!err)
+            err = write_record(ctx, path, st, &own, n_subdirs, subdirs, subdirs_len);
+
+        free(scanned.data);
+        return err ? -1 : 0;
+    }
+}
+
+int walk_dir_incremental(const char *path, dir_stats_t *stats, const char *index_path, long *n_scanned)
+{
+    if (!path || !stats || !index_path) return -1;
+
+    memset(stats, 0, sizeof *stats);
+
+    char abs_path[PATH_MAX];
+    if (realpath(path, abs_path) != abs_path)
+        return -1;
+
+    struct stat st;
+    if (lstat(abs_path, &st)) return -1;
+    if (!S_ISDIR(st.st_mode))
+    {
+        // nothing to index
+        if (n_scanned) *n_scanned = 0;
+        return count_mode(stats, st.st_mode);
+    }
+
+    size_t index_len = strlen(index_path);
+    if (index_len + 5 > PATH_MAX) return -1;
+    char tmp_path[PATH_MAX];
+    memcpy(tmp_path, index_path, index_len);
+    memcpy(tmp_path + index_len, ".tmp", 5);
+
+    index_ctx_t ctx = {0};
+    if (index_load(&ctx.old, index_path)) return -1;
+
+    int err = 0;
+    do
+    {
+        ctx.out = fopen(tmp_path, "w");
+        if (!ctx.out)
+        {
+            err = -1;
+            break;
+        }
+
+        // header, record count is patched at the end
+        uint32_t magic = INDEX_MAGIC;
+        uint32_t version = INDEX_VERSION;
+        int64_t created = (int64_t) time(NULL);
+        uint32_t n_recs = 0;
+        if (fwrite(&magic, sizeof magic, 1, ctx.out) != 1
+            || fwrite(&version, sizeof version, 1, ctx.out) != 1
+            || fwrite(&created, sizeof created, 1, ctx.out) != 1
+            || fwrite(&n_recs, sizeof n_recs, 1, ctx.out) != 1)
+        {
+            err = -1;
+            break;
+        }
+
+        err = index_dir(&ctx, abs_path, &st, stats);
+        if (err) break;
+
+        // root itself is a directory too
+        stats->n_dir++;
+
+        // drop leftovers of records written again after a rescan
+        long end_pos = ftell(ctx.out);
+        if (end_pos < 0 || fflush(ctx.out) || ftruncate(fileno(ctx.out), end_pos))
+        {
+            err = -1;
+            break;
+        }
+
+        n_recs = ctx.n_written;
+        long count_pos = sizeof magic + sizeof version + sizeof created;
+        if (fseek(ctx.out, count_pos, SEEK_SET)
+            || fwrite(&n_recs, sizeof n_recs, 1, ctx.out) != 1)
+        {
+            err = -1;
+            break;
+        }
+    } while (0);
+
+    if (ctx.out && fclose(ctx.out)) err = -1;
+    if (!err && rename(tmp_path, index_path)) err = -1;
+    if (err && ctx.out) unlink(tmp_path);
+
+    index_free(&ctx.old);
+
+    if (n_scanned) *n_scanned = ctx.n_scanned;
+
+    return err;
+}
@@ -10,25 +10,18 @@
 #include <stdlib.h>
 #include <ftw.h>
 #include <time.h>
+#include <unistd.h>
+#include "fmt.h"
 
 #define NOPENFD (20)
 
-static dir_stats_t *GLOBAL_STATS;
+// nftw has no user argument, thread local state keeps walks
+// in different threads apart
+static __thread dir_stats_t *GLOBAL_STATS;
+static __thread fmt_writer_t *GLOBAL_OUT;
 
 static int nftw_callback(const char *fpath, const struct stat *sb, int typeflag, struct FTW *ftwbuf)
 {
-    char atime[26];
-    if (ctime_r(&sb->st_atime, atime) != atime)
-        return -1;
-
-    char mtime[26];
-    if (ctime_r(&sb->st_mtime, mtime) != mtime)
-        return -1;
-
-    // remove \n
-    atime[24] = 0;
-    mtime[24] = 0;
-
     const char *type;
 
     if (S_ISFIFO(sb->st_mode))
@@ -68,22 +61,27 @@ static int nftw_callback(const char *fpath, const struct stat *sb, int typeflag,
     }
     else return -1;
 
-    printf(
-        "%s:\n"
-        "- links: %lld\n"
-        "- type:  %s\n"
-        "- size:  %lldB\n"
-        "- atime: %s\n"
-        "- mtime: %s\n",
+    return fmt_entry(
+        GLOBAL_OUT,
         fpath,
-        (long long) sb->st_nlink,
         type,
+        (long long) sb->st_nlink,
         (long long) sb->st_size,
-        atime,
-        mtime
+        sb->st_atime,
+        sb->st_mtime
     );
+}
 
-    return 0;
+int walk_dir_set_backend(walk_backend_t backend)
+{
+    // nftw always stats entries itself
+    return backend == BACKEND_SYNC ? 0 : -1;
+}
+
+int walk_dir_set_du(int enabled)
+{
+    // nftw cannot sum subtrees in a single pass
+    return enabled ? -1 : 0;
 }
 
 int walk_dir(const char *path, dir_stats_t *stats)
@@ -94,10 +92,24 @@ int walk_dir(const char *path, dir_stats_t *stats)
     if (realpath(path, abs_path) != abs_path)
         return -1;
 
+    fmt_writer_t out;
+    if (fmt_init(&out, STDOUT_FILENO)) return -1;
+
+    // restored afterwards in case of nested walks
+    dir_stats_t *prev_stats = GLOBAL_STATS;
+    fmt_writer_t *prev_out = GLOBAL_OUT;
+
     memset(stats, 0, sizeof *stats);
     GLOBAL_STATS = stats;
+    GLOBAL_OUT = &out;
+
+    int err = nftw(abs_path, nftw_callback, NOPENFD, FTW_PHYS);
+    if (fmt_free(&out)) err = -1;
+
+    GLOBAL_STATS = prev_stats;
+    GLOBAL_OUT = prev_out;
 
-    return nftw(abs_path, nftw_callback, NOPENFD, FTW_PHYS);
+    return err;
 }
 
 #endif // IMPL_NFTW
@@ -0,0 +1,601 @@
+#include "walkdir.h"
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "fmt.h"
+
+#define DEQUE_INIT_CAP (64)
+
+// bytes of one readdir index in record key
+#define KEY_STEP (4)
+
+/**
+ * Directory waiting to be read.
+ */
+typedef struct work_t
+{
+    char *path;
+    // key of directory's record, owned by the record
+    const unsigned char *key;
+    size_t key_len;
+} work_t;
+
+/**
+ * Double ended queue of pending directories.
+ * Owner pushes and pops at the tail,
+ * thieves steal from the head.
+ */
+typedef struct deque_t
+{
+    pthread_mutex_t lock;
+    work_t *items;
+    size_t cap;
+    size_t head;
+    size_t size;
+} deque_t;
+
+/**
+ * Entry saved for sorted output.
+ * Key holds readdir indices of the path components,
+ * KEY_STEP big endian bytes each.
+ */
+typedef struct record_t
+{
+    char *path;
+    unsigned char *key;
+    size_t key_len;
+    const char *type;
+    long long nlink;
+    long long size;
+    time_t atime;
+    time_t mtime;
+} record_t;
+
+struct walk_ctx_t;
+
+typedef struct worker_t
+{
+    struct walk_ctx_t *ctx;
+    int id;
+    pthread_t thread;
+    deque_t dq;
+    dir_stats_t stats;
+
+    // unsorted output
+    fmt_writer_t out;
+
+    // sorted output
+    record_t *records;
+    size_t n_records;
+    size_t records_cap;
+} worker_t;
+
+typedef struct walk_ctx_t
+{
+    worker_t *workers;
+    int n_workers;
+    int sorted;
+    pthread_mutex_t out_lock;
+    // directories pushed but not yet processed
+    long pending;
+    int err;
+    // workers without work sleep here
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    int n_idle;
+} walk_ctx_t;
+
+static int deque_init(deque_t *dq)
+{
+    dq->items = malloc(DEQUE_INIT_CAP * sizeof *dq->items);
+    if (!dq->items) return -1;
+    dq->cap = DEQUE_INIT_CAP;
+    dq->head = 0;
+    dq->size = 0;
+    pthread_mutex_init(&dq->lock, NULL);
+    return 0;
+}
+
+static void deque_free(deque_t *dq)
+{
+    if (!dq->items) return;
+    for (size_t i = 0; i < dq->size; ++i)
+        free(dq->items[(dq->head + i) % dq->cap].path);
+    free(dq->items);
+    dq->items = NULL;
+    pthread_mutex_destroy(&dq->lock);
+}
+
+static int deque_push(deque_t *dq, const work_t *item)
+{
+    int err = 0;
+    pthread_mutex_lock(&dq->lock);
+
+    if (dq->size == dq->cap)
+    {
+        // grow and unwrap the ring
+        work_t *items = malloc(2 * dq->cap * sizeof *items);
+        if (items)
+        {
+            for (size_t i = 0; i < dq->size; ++i)
+                items[i] = dq->items[(dq->head + i) % dq->cap];
+            free(dq->items);
+            dq->items = items;
+            dq->cap *= 2;
+            dq->head = 0;
+        }
+        else err = -1;
+    }
+
+    if (!err)
+    {
+        dq->items[(dq->head + dq->size) % dq->cap] = *item;
+        dq->size++;
+    }
+
+    pthread_mutex_unlock(&dq->lock);
+    return err;
+}
+
+/**
+ * @return 0 or -1 if deque is empty.
+ */
+static int deque_pop(deque_t *dq, work_t *item)
+{
+    int err = -1;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->size)
+    {
+        dq->size--;
+        *item = dq->items[(dq->head + dq->size) % dq->cap];
+        err = 0;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return err;
+}
+
+/**
+ * @return 0 or -1 if deque is empty.
+ */
+static int deque_steal(deque_t *dq, work_t *item)
+{
+    int err = -1;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->size)
+    {
+        *item = dq->items[dq->head];
+        dq->head = (dq->head + 1) % dq->cap;
+        dq->size--;
+        err = 0;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return err;
+}
+
+static void wake_all(walk_ctx_t *ctx)
+{
+    pthread_mutex_lock(&ctx->idle_lock);
+    pthread_cond_broadcast(&ctx->idle_cond);
+    pthread_mutex_unlock(&ctx->idle_lock);
+}
+
+static const char* classify(mode_t mode, dir_stats_t *stats)
+{
+    if (S_ISFIFO(mode))
+    {
+        stats->n_fifo++;
+        return "fifo";
+    }
+    if (S_ISCHR(mode))
+    {
+        stats->n_chr++;
+        return "chr";
+    }
+    if (S_ISDIR(mode))
+    {
+        stats->n_dir++;
+        return "dir";
+    }
+    if (S_ISBLK(mode))
+    {
+        stats->n_blk++;
+        return "blk";
+    }
+    if (S_ISREG(mode))
+    {
+        stats->n_reg++;
+        return "reg";
+    }
+    if (S_ISLNK(mode))
+    {
+        stats->n_link++;
+        return "link";
+    }
+    if (S_ISSOCK(mode))
+    {
+        stats->n_sock++;
+        return "sock";
+    }
+    return NULL;
+}
+
+/**
+ * Print or save entry depending on output mode.
+ * Key of saved record is stored to *key.
+ */
+static int emit_entry(worker_t *w, const char *path, const struct stat *st, const char *type,
+                      const work_t *parent, unsigned index, const unsigned char **key)
+{
+    record_t rec = {
+        .path = (char*) path,
+        .type = type,
+        .nlink = (long long) st->st_nlink,
+        .size = (long long) st->st_size,
+        .atime = st->st_atime,
+        .mtime = st->st_mtime,
+    };
+
+    if (w->ctx->sorted)
+    {
+        if (w->n_records == w->records_cap)
+        {
+            size_t cap = w->records_cap ? 2 * w->records_cap : 256;
+            record_t *records = realloc(w->records, cap * sizeof *records);
+            if (!records) return -1;
+            w->records = records;
+            w->records_cap = cap;
+        }
+
+        rec.key_len = parent ? parent->key_len + KEY_STEP : 0;
+        rec.key = malloc(rec.key_len ? rec.key_len : 1);
+        if (!rec.key) return -1;
+        if (parent)
+        {
+            memcpy(rec.key, parent->key, parent->key_len);
+            for (int i = 0; i < KEY_STEP; ++i)
+                rec.key[rec.key_len - 1 - i] = (unsigned char) (index >> (8 * i));
+        }
+
+        rec.path = strdup(path);
+        if (!rec.path)
+        {
+            free(rec.key);
+            return -1;
+        }
+        w->records[w->n_records++] = rec;
+        *key = rec.key;
+        return 0;
+    }
+
+    return fmt_entry(&w->out, rec.path, rec.type, rec.nlink, rec.size, rec.atime, rec.mtime);
+}
+
+/**
+ * Stat path, count and print it.
+ * Directories are pushed onto worker's deque.
+ *
+ * @param parent Directory containing path, NULL for the root.
+ * @param index Position of path in readdir order of parent.
+ */
+static int visit_path(worker_t *w, const char *path, const work_t *parent, unsigned index)
+{
+    walk_ctx_t *ctx = w->ctx;
+    struct stat st;
+    if (lstat(path, &st)) return -1;
+
+    const char *type = classify(st.st_mode, &w->stats);
+    if (!type) return -1;
+
+    work_t work = {0};
+    if (emit_entry(w, path, &st, type, parent, index, &work.key)) return -1;
+    work.key_len = parent ? parent->key_len + KEY_STEP : 0;
+
+    if (S_ISDIR(st.st_mode))
+    {
+        work.path = strdup(path);
+        if (!work.path) return -1;
+
+        __atomic_add_fetch(&ctx->pending, 1, __ATOMIC_SEQ_CST);
+        if (deque_push(&w->dq, &work))
+        {
+            __atomic_sub_fetch(&ctx->pending, 1, __ATOMIC_SEQ_CST);
+            free(work.path);
+            return -1;
+        }
+
+        // waiter counts itself before looking at the deques
+        if (__atomic_load_n(&ctx->n_idle, __ATOMIC_SEQ_CST))
+        {
+            pthread_mutex_lock(&ctx->idle_lock);
+            pthread_cond_signal(&ctx->idle_cond);
+            pthread_mutex_unlock(&ctx->idle_lock);
+        }
+    }
+
+    return 0;
+}
+
+static int process_dir(worker_t *w, const work_t *work)
+{
+    int err = 0;
+    const char *root_path = work->path;
+    DIR *root_dir = opendir(root_path);
+    if (!root_dir) return -1;
+
+    size_t root_len = strlen(root_path);
+    unsigned index = 0;
+
+    for (;;)
+    {
+        struct dirent *ent = readdir(root_dir);
+        if (!ent) break;
+
+        // skip . and ..
+        if (!strcmp(".", ent->d_name) || !strcmp("..", ent->d_name))
+            continue;
+
+        size_t name_len = strlen(ent->d_name);
+        if (root_len + name_len + 2 > PATH_MAX)
+        {
+            err = -1;
+            break;
+        }
+        char ent_path[PATH_MAX];
+        memcpy(ent_path, root_path, root_len);
+        ent_path[root_len] = '/';
+        memcpy(ent_path + root_len + 1, ent->d_name, name_len + 1);
+
+        err = visit_path(w, ent_path, work, index++);
+        if (err) break;
+    }
+
+    closedir(root_dir);
+
+    return err;
+}
+
+/**
+ * Take work from own deque or steal from others.
+ *
+ * @return 0 or -1 if there is none.
+ */
+static int find_work(worker_t *w, work_t *work)
+{
+    if (!deque_pop(&w->dq, work)) return 0;
+
+    walk_ctx_t *ctx = w->ctx;
+    for (int i = 1; i < ctx->n_workers; ++i)
+    {
+        worker_t *victim = &ctx->workers[(w->id + i) % ctx->n_workers];
+        if (!deque_steal(&victim->dq, work)) return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * Sleep until work shows up.
+ *
+ * @return 0 or -1 when the walk is over.
+ */
+static int wait_work(worker_t *w, work_t *work)
+{
+    walk_ctx_t *ctx = w->ctx;
+    int err = 0;
+
+    pthread_mutex_lock(&ctx->idle_lock);
+    __atomic_add_fetch(&ctx->n_idle, 1, __ATOMIC_SEQ_CST);
+    while (find_work(w, work))
+    {
+        if (__atomic_load_n(&ctx->err, __ATOMIC_SEQ_CST)
+            || !__atomic_load_n(&ctx->pending, __ATOMIC_SEQ_CST))
+        {
+            err = -1;
+            break;
+        }
+        pthread_cond_wait(&ctx->idle_cond, &ctx->idle_lock);
+    }
+    __atomic_sub_fetch(&ctx->n_idle, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ctx->idle_lock);
+
+    return err;
+}
+
+static void* worker_task(void *arg)
+{
+    worker_t *w = arg;
+    walk_ctx_t *ctx = w->ctx;
+
+    while (!__atomic_load_n(&ctx->err, __ATOMIC_SEQ_CST))
+    {
+        work_t work;
+        if (find_work(w, &work) && wait_work(w, &work)) break;
+
+        int err = process_dir(w, &work);
+        free(work.path);
+
+        if (err)
+        {
+            __atomic_store_n(&ctx->err, 1, __ATOMIC_SEQ_CST);
+            wake_all(ctx);
+            break;
+        }
+
+        // last directory done, release sleeping workers
+        if (!__atomic_sub_fetch(&ctx->pending, 1, __ATOMIC_SEQ_CST))
+            wake_all(ctx);
+    }
+
+    if (fmt_flush(&w->out))
+        __atomic_store_n(&ctx->err, 1, __ATOMIC_SEQ_CST);
+
+    return NULL;
+}
+
+/**
+ * Order of the serial walk: readdir order,
+ * directories after their contents.
+ */
+static int compare_records(const void *a, const void *b)
+{
+    const record_t *ra = a;
+    const record_t *rb = b;
+
+    size_t len = ra->key_len < rb->key_len ? ra->key_len : rb->key_len;
+    int res = memcmp(ra->key, rb->key, len);
+    if (res) return res;
+
+    return (ra->key_len < rb->key_len) - (ra->key_len > rb->key_len);
+}
+
+/**
+ * Merge records of all workers, sort and print them.
+ */
+static int print_sorted(walk_ctx_t *ctx)
+{
+    size_t n = 0;
+    for (int i = 0; i < ctx->n_workers; ++i)
+        n += ctx->workers[i].n_records;
+
+    record_t *all = malloc((n ? n : 1) * sizeof *all);
+    if (!all) return -1;
+
+    n = 0;
+    for (int i = 0; i < ctx->n_workers; ++i)
+    {
+        worker_t *w = &ctx->workers[i];
+        memcpy(all + n, w->records, w->n_records * sizeof *all);
+        n += w->n_records;
+    }
+
+    qsort(all, n, sizeof *all, compare_records);
+
+    fmt_writer_t out;
+    if (fmt_init(&out, STDOUT_FILENO))
+    {
+        free(all);
+        return -1;
+    }
+
+    int err = 0;
+    for (size_t i = 0; i < n && !err; ++i)
+    {
+        record_t *rec = &all[i];
+        err = fmt_entry(&out, rec->path, rec->type, rec->nlink, rec->size, rec->atime, rec->mtime);
+    }
+
+    if (fmt_free(&out)) err = -1;
+    free(all);
+    return err;
+}
+
+int walk_dir_parallel(const char *path, dir_stats_t *stats, int n_threads, int sorted)
+{
+    if (!path || !stats || n_threads < 1) return -1;
+
+    memset(stats, 0, sizeof *stats);
+
+    char abs_path[PATH_MAX];
+    if (realpath(path, abs_path) != abs_path)
+        return -1;
+
+    walk_ctx_t ctx = {
+        .n_workers = n_threads,
+        .sorted = sorted,
+        .pending = 0,
+        .err = 0,
+    };
+
+    ctx.workers = calloc(n_threads, sizeof *ctx.workers);
+    if (!ctx.workers) return -1;
+    pthread_mutex_init(&ctx.out_lock, NULL);
+    pthread_mutex_init(&ctx.idle_lock, NULL);
+    pthread_cond_init(&ctx.idle_cond, NULL);
+
+    int err = 0;
+    int n_started = 0;
+
+    do
+    {
+        for (int i = 0; i < n_threads; ++i)
+        {
+            worker_t *w = &ctx.workers[i];
+            w->ctx = &ctx;
+            w->id = i;
+
+            if (deque_init(&w->dq))
+            {
+                err = -1;
+                break;
+            }
+
+            if (!sorted)
+            {
+                if (fmt_init(&w->out, STDOUT_FILENO))
+                {
+                    err = -1;
+                    break;
+                }
+                // one flush at a time keeps records apart
+                w->out.lock = &ctx.out_lock;
+            }
+        }
+        if (err) break;
+
+        // root is visited by the first worker before threads start
+        err = visit_path(&ctx.workers[0], abs_path, NULL, 0);
+        if (err) break;
+
+        for (; n_started < n_threads; ++n_started)
+        {
+            worker_t *w = &ctx.workers[n_started];
+            if (pthread_create(&w->thread, NULL, worker_task, w)) break;
+        }
+        // started threads steal from deques of the others
+        if (!n_started) err = -1;
+    } while (0);
+
+    for (int i = 0; i < n_started; ++i)
+        pthread_join(ctx.workers[i].thread, NULL);
+
+    if (ctx.err) err = -1;
+
+    if (!err && sorted)
+        err = print_sorted(&ctx);
+
+    for (int i = 0; i < n_threads; ++i)
+    {
+        worker_t *w = &ctx.workers[i];
+
+        stats->n_fifo += w->stats.n_fifo;
+        stats->n_chr += w->stats.n_chr;
+        stats->n_dir += w->stats.n_dir;
+        stats->n_blk += w->stats.n_blk;
+        stats->n_reg += w->stats.n_reg;
+        stats->n_link += w->stats.n_link;
+        stats->n_sock += w->stats.n_sock;
+
+        for (size_t j = 0; j < w->n_records; ++j)
+        {
+            free(w->records[j].path);
+            free(w->records[j].key);
+        }
+        free(w->records);
+        if (fmt_free(&w->out)) err = -1;
+        deque_free(&w->dq);
+    }
+    free(ctx.workers);
+    pthread_mutex_destroy(&ctx.out_lock);
+    pthread_mutex_destroy(&ctx.idle_lock);
+    pthread_cond_destroy(&ctx.idle_cond);
+
+    return err;
+}
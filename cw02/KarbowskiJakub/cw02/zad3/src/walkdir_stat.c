@@ -2,106 +2,271 @@
 
 #ifdef IMPL_STAT
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <string.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <time.h>
+#include "uring.h"
+#include "fmt.h"
+#include "inoset.h"
 
-int process_dir(const char *root_path, dir_stats_t *stats);
+#define URING_ENTRIES (256)
+#define STATX_MASK (STATX_TYPE | STATX_NLINK | STATX_SIZE | STATX_ATIME | STATX_MTIME)
+#define STATX_MASK_DU (STATX_MASK | STATX_BLOCKS | STATX_INO)
 
-static int process_path(const char *path, dir_stats_t *stats)
+typedef struct walk_ctx_t
 {
-    if (!path || !stats) return -1;
+    dir_stats_t *stats;
+    fmt_writer_t *out;
+    // NULL for synchronous backend
+    uring_t *ring;
+    // inodes with multiple links already counted, NULL unless du mode
+    inoset_t *seen;
+} walk_ctx_t;
 
-    int err;
-    struct stat stat;
+static walk_backend_t g_backend = BACKEND_SYNC;
+static int g_du = 0;
 
-    err = lstat(path, &stat);
-    if (err) return -1;
+static int process_dir(const char *root_path, walk_ctx_t *ctx, long long *du);
 
-    char atime[26];
-    if (ctime_r(&stat.st_atime, atime) != atime)
-        return -1;
-    if (atime[strlen(atime) - 1] == '\n')
-        atime[strlen(atime) - 1] = 0;
+/**
+ * Count and print entry with known metadata.
+ * Directories are walked before being printed.
+ * In du mode disk usage of entry is added to *du
+ * and only directories are printed, with usage of their subtree.
+ */
+static int process_entry(const char *path, const struct stat *stat, walk_ctx_t *ctx, long long *du)
+{
+    int err = 0;
+    dir_stats_t *stats = ctx->stats;
 
-    char mtime[26];
-    if (ctime_r(&stat.st_mtime, mtime) != mtime)
-        return -1;
-    if (mtime[strlen(mtime) - 1] == '\n')
-        mtime[strlen(mtime) - 1] = 0;
+    long long usage = 0;
+    if (ctx->seen)
+    {
+        usage = (long long) stat->st_blocks * 512;
+        // hardlinked files count only at their first occurrence
+        if (!S_ISDIR(stat->st_mode) && stat->st_nlink > 1)
+        {
+            int inserted = inoset_insert(ctx->seen, stat->st_dev, stat->st_ino);
+            if (inserted < 0) return -1;
+            if (!inserted) usage = 0;
+        }
+    }
 
     const char *type;
 
-    if (S_ISFIFO(stat.st_mode))
+    if (S_ISFIFO(stat->st_mode))
     {
         stats->n_fifo++;
         type = "fifo";
     }
-    else if (S_ISCHR(stat.st_mode))
+    else if (S_ISCHR(stat->st_mode))
     {
         stats->n_chr++;
         type = "chr";
     }
-    else if (S_ISDIR(stat.st_mode))
+    else if (S_ISDIR(stat->st_mode))
     {
-        err = process_dir(path, stats);
+        err = process_dir(path, ctx, &usage);
         if (err) return -1;
         stats->n_dir++;
         type = "dir";
     }
-    else if (S_ISBLK(stat.st_mode))
+    else if (S_ISBLK(stat->st_mode))
     {
         stats->n_blk++;
         type = "blk";
     }
-    else if (S_ISREG(stat.st_mode))
+    else if (S_ISREG(stat->st_mode))
     {
         stats->n_reg++;
         type = "reg";
     }
-    else if (S_ISLNK(stat.st_mode))
+    else if (S_ISLNK(stat->st_mode))
     {
         stats->n_link++;
         type = "link";
     }
-    else if (S_ISSOCK(stat.st_mode))
+    else if (S_ISSOCK(stat->st_mode))
     {
         stats->n_sock++;
         type = "sock";
     }
     else return -1;
 
-    printf(
-        "%s:\n"
-        "- links: %lld\n"
-        "- type:  %s\n"
-        "- size:  %lldB\n"
-        "- atime: %s\n"
-        "- mtime: %s\n",
+    *du += usage;
+
+    if (ctx->seen)
+        return S_ISDIR(stat->st_mode) ? fmt_du(ctx->out, path, usage) : 0;
+
+    return fmt_entry(
+        ctx->out,
         path,
-        (long long) stat.st_nlink,
         type,
-        (long long) stat.st_size,
-        atime,
-        mtime
+        (long long) stat->st_nlink,
+        (long long) stat->st_size,
+        stat->st_atime,
+        stat->st_mtime
     );
+}
 
-    return err;
+static int process_path(const char *path, walk_ctx_t *ctx, long long *du)
+{
+    if (!path || !ctx) return -1;
+
+    struct stat stat;
+    if (lstat(path, &stat)) return -1;
+
+    return process_entry(path, &stat, ctx, du);
+}
+
+static void statx_to_stat(const struct statx *stx, struct stat *stat)
+{
+    memset(stat, 0, sizeof *stat);
+    stat->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    stat->st_ino = (ino_t) stx->stx_ino;
+    stat->st_mode = stx->stx_mode;
+    stat->st_nlink = stx->stx_nlink;
+    stat->st_size = (off_t) stx->stx_size;
+    stat->st_blocks = (blkcnt_t) stx->stx_blocks;
+    stat->st_atime = stx->stx_atime.tv_sec;
+    stat->st_mtime = stx->stx_mtime.tv_sec;
 }
 
-int process_dir(const char *root_path, dir_stats_t *stats)
+static int join_path(char *out, const char *root_path, const char *name)
 {
-    if (!root_path || !stats) return -1;
+    if (strlen(root_path) + strlen(name) + 2 > PATH_MAX)
+        return -1;
+
+    strcpy(out, root_path);
+    strcat(out, "/");
+    strcat(out, name);
 
+    return 0;
+}
+
+/**
+ * Stat all entries of a directory with one io_uring submission stream.
+ * Entries are handled as their completions arrive,
+ * subdirectories are walked after the whole batch is done.
+ */
+static int process_entries_uring(const char *root_path, int root_fd, char **names, size_t n,
+                                 walk_ctx_t *ctx, long long *du)
+{
     int err = 0;
-    DIR *root_dir = opendir(root_path);
-    if (!root_dir) return -1;
+    uring_t *ring = ctx->ring;
+
+    struct statx *stx = malloc((n ? n : 1) * sizeof *stx);
+    if (!stx) return -1;
+
+    // indices of subdirectories to walk afterwards
+    size_t *dirs = malloc((n ? n : 1) * sizeof *dirs);
+    if (!dirs)
+    {
+        free(stx);
+        return -1;
+    }
+    size_t n_dirs = 0;
+
+    size_t submitted = 0;
+    size_t inflight = 0;
+
+    while (submitted < n || inflight)
+    {
+        // keep ring filled, completion queue must never overflow
+        while (submitted < n && inflight < ring->entries && !err)
+        {
+            struct io_uring_sqe *sqe = uring_get_sqe(ring);
+            if (!sqe) break;
+
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = root_fd;
+            sqe->addr = (unsigned long) names[submitted];
+            sqe->len = ctx->seen ? STATX_MASK_DU : STATX_MASK;
+            sqe->off = (unsigned long) &stx[submitted];
+            sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+            sqe->user_data = submitted;
+
+            submitted++;
+            inflight++;
+        }
+
+        if (uring_submit_and_wait(ring, 1))
+        {
+            // in-flight requests may still write to stx,
+            // so it is leaked instead of freed
+            free(dirs);
+            return -1;
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(ring)))
+        {
+            size_t i = (size_t) cqe->user_data;
+            int res = cqe->res;
+            uring_cqe_seen(ring);
+            inflight--;
+
+            if (err) continue;
+            if (res < 0)
+            {
+                err = -1;
+                continue;
+            }
+
+            if (S_ISDIR(stx[i].stx_mode))
+            {
+                dirs[n_dirs++] = i;
+                continue;
+            }
+
+            char ent_path[PATH_MAX];
+            struct stat stat;
+            statx_to_stat(&stx[i], &stat);
+
+            err = join_path(ent_path, root_path, names[i]);
+            if (!err) err = process_entry(ent_path, &stat, ctx, du);
+        }
+
+        // stop submitting, drain what is in flight
+        if (err) n = submitted;
+    }
+
+    for (size_t k = 0; k < n_dirs && !err; ++k)
+    {
+        size_t i = dirs[k];
+        char ent_path[PATH_MAX];
+        struct stat stat;
+        statx_to_stat(&stx[i], &stat);
+
+        err = join_path(ent_path, root_path, names[i]);
+        if (!err) err = process_entry(ent_path, &stat, ctx, du);
+    }
+
+    free(dirs);
+    free(stx);
+
+    return err;
+}
+
+/**
+ * Read all names of a directory and stat them in one batch.
+ */
+static int process_dir_uring(const char *root_path, DIR *root_dir, walk_ctx_t *ctx, long long *du)
+{
+    int err = 0;
+    char **names = NULL;
+    size_t n = 0;
+    size_t cap = 0;
 
     for (;;)
     {
@@ -112,17 +277,66 @@ int process_dir(const char *root_path, dir_stats_t *stats)
         if (!strcmp(".", ent->d_name) || !strcmp("..", ent->d_name))
             continue;
 
-        if (strlen(root_path) + strlen(ent->d_name) + 2 > PATH_MAX)
+        if (n == cap)
+        {
+            cap = cap ? 2 * cap : 64;
+            char **new_names = realloc(names, cap * sizeof *names);
+            if (!new_names)
+            {
+                err = -1;
+                break;
+            }
+            names = new_names;
+        }
+
+        names[n] = strdup(ent->d_name);
+        if (!names[n])
         {
             err = -1;
             break;
         }
+        n++;
+    }
+
+    if (!err)
+        err = process_entries_uring(root_path, dirfd(root_dir), names, n, ctx, du);
+
+    for (size_t i = 0; i < n; ++i)
+        free(names[i]);
+    free(names);
+
+    return err;
+}
+
+static int process_dir(const char *root_path, walk_ctx_t *ctx, long long *du)
+{
+    if (!root_path || !ctx) return -1;
+
+    int err = 0;
+    DIR *root_dir = opendir(root_path);
+    if (!root_dir) return -1;
+
+    if (ctx->ring)
+    {
+        err = process_dir_uring(root_path, root_dir, ctx, du);
+        closedir(root_dir);
+        return err;
+    }
+
+    for (;;)
+    {
+        struct dirent *ent = readdir(root_dir);
+        if (!ent) break;
+
+        // skip . and ..
+        if (!strcmp(".", ent->d_name) || !strcmp("..", ent->d_name))
+            continue;
+
         char ent_path[PATH_MAX];
-        strcpy(ent_path, root_path);
-        strcat(ent_path, "/");
-        strcat(ent_path, ent->d_name);
+        err = join_path(ent_path, root_path, ent->d_name);
+        if (err) break;
 
-        err = process_path(ent_path, stats);
+        err = process_path(ent_path, ctx, du);
         if (err) break;
     }
 
@@ -131,6 +345,36 @@ int process_dir(const char *root_path, dir_stats_t *stats)
     return err;
 }
 
+int walk_dir_set_backend(walk_backend_t backend)
+{
+    switch (backend)
+    {
+        case BACKEND_SYNC:
+            break;
+
+        case BACKEND_URING:
+        {
+            // check if kernel allows io_uring
+            uring_t ring;
+            if (uring_init(&ring, 1)) return -1;
+            uring_free(&ring);
+            break;
+        }
+
+        default:
+            return -1;
+    }
+
+    g_backend = backend;
+    return 0;
+}
+
+int walk_dir_set_du(int enabled)
+{
+    g_du = enabled;
+    return 0;
+}
+
 int walk_dir(const char *path, dir_stats_t *stats)
 {
     if (!path || !stats) return -1;
@@ -141,7 +385,47 @@ int walk_dir(const char *path, dir_stats_t *stats)
     if (realpath(path, abs_path) != abs_path)
         return -1;
 
-    return process_path(abs_path, stats);
+    fmt_writer_t out;
+    if (fmt_init(&out, STDOUT_FILENO)) return -1;
+
+    uring_t ring;
+    inoset_t seen;
+    walk_ctx_t ctx = {
+        .stats = stats,
+        .out = &out,
+        .ring = NULL,
+        .seen = NULL,
+    };
+
+    if (g_du)
+    {
+        if (inoset_init(&seen))
+        {
+            fmt_free(&out);
+            return -1;
+        }
+        ctx.seen = &seen;
+    }
+
+    if (g_backend == BACKEND_URING)
+    {
+        if (uring_init(&ring, URING_ENTRIES))
+        {
+            if (ctx.seen) inoset_free(ctx.seen);
+            fmt_free(&out);
+            return -1;
+        }
+        ctx.ring = &ring;
+    }
+
+    long long du = 0;
+    int err = process_path(abs_path, &ctx, &du);
+
+    if (ctx.ring) uring_free(ctx.ring);
+    if (ctx.seen) inoset_free(ctx.seen);
+    if (fmt_free(&out)) err = -1;
+
+    return err;
 }
 
 #endif // IMPL_STAT
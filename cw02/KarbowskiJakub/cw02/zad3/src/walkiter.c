@@ -0,0 +1,377 @@
+#include "walkiter.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+
+#define FRAMES_INIT_CAP (16)
+#define CB_BATCH (64)
+#define CB_BUF_SIZE (64 * 1024)
+// directory streams kept open, like NOPENFD of nftw
+#ifndef WALK_MAX_OPEN
+#define WALK_MAX_OPEN (32)
+#endif
+
+typedef struct walk_frame_t
+{
+    // NULL once remaining names are read into names
+    DIR *dir;
+    // length of directory's relative path
+    size_t path_len;
+    // null terminated names not returned yet
+    char *names;
+    size_t names_len;
+    size_t names_off;
+} walk_frame_t;
+
+struct walk_iter_t
+{
+    int root_fd;
+    int started;
+    // error hit after entries were already returned
+    int err;
+
+    walk_frame_t *frames;
+    int n_frames;
+    int cap_frames;
+    // frames below this one have no open stream
+    int n_spilled;
+
+    // relative path of directory on top of the stack
+    char dir_path[PATH_MAX];
+
+    // entry fetched but not returned yet
+    int has_pending;
+    walk_entry_t pending;
+    char pending_path[PATH_MAX];
+    size_t pending_len;
+    size_t pending_name;
+};
+
+static int push_frame(walk_iter_t *it, int fd, size_t path_len)
+{
+    if (it->n_frames == it->cap_frames)
+    {
+        int cap = it->cap_frames ? 2 * it->cap_frames : FRAMES_INIT_CAP;
+        walk_frame_t *frames = realloc(it->frames, cap * sizeof *frames);
+        if (!frames)
+        {
+            close(fd);
+            return -1;
+        }
+        it->frames = frames;
+        it->cap_frames = cap;
+    }
+
+    DIR *dir = fdopendir(fd);
+    if (!dir)
+    {
+        close(fd);
+        return -1;
+    }
+
+    walk_frame_t *f = &it->frames[it->n_frames];
+    memset(f, 0, sizeof *f);
+    f->dir = dir;
+    f->path_len = path_len;
+    it->n_frames++;
+
+    return 0;
+}
+
+static void pop_frame(walk_iter_t *it)
+{
+    walk_frame_t *f = &it->frames[--it->n_frames];
+    if (f->dir) closedir(f->dir);
+    free(f->names);
+    if (it->n_spilled > it->n_frames) it->n_spilled = it->n_frames;
+}
+
+/**
+ * Read remaining names of the oldest open directory and close it.
+ */
+static int spill_frame(walk_iter_t *it)
+{
+    walk_frame_t *f = &it->frames[it->n_spilled];
+    size_t cap = 0;
+
+    for (;;)
+    {
+        errno = 0;
+        struct dirent *ent = readdir(f->dir);
+        if (!ent)
+        {
+            if (errno) return -1;
+            break;
+        }
+
+        if (!strcmp(".", ent->d_name) || !strcmp("..", ent->d_name))
+            continue;
+
+        size_t need = f->names_len + strlen(ent->d_name) + 1;
+        if (need > cap)
+        {
+            cap = cap ? 2 * cap : 1024;
+            while (cap < need) cap *= 2;
+            char *names = realloc(f->names, cap);
+            if (!names) return -1;
+            f->names = names;
+        }
+        strcpy(f->names + f->names_len, ent->d_name);
+        f->names_len = need;
+    }
+
+    closedir(f->dir);
+    f->dir = NULL;
+    it->n_spilled++;
+
+    return 0;
+}
+
+/**
+ * Get next name of directory.
+ *
+ * @return Name or NULL at the end, errno is set on error.
+ */
+static const char* frame_next(walk_frame_t *f)
+{
+    errno = 0;
+    if (f->dir)
+    {
+        struct dirent *ent = readdir(f->dir);
+        return ent ? ent->d_name : NULL;
+    }
+
+    if (f->names_off == f->names_len) return NULL;
+    const char *name = f->names + f->names_off;
+    f->names_off += strlen(name) + 1;
+    return name;
+}
+
+static int mode_type(mode_t mode, walk_type_t *type)
+{
+    if (S_ISFIFO(mode)) *type = WALK_FIFO;
+    else if (S_ISCHR(mode)) *type = WALK_CHR;
+    else if (S_ISDIR(mode)) *type = WALK_DIR;
+    else if (S_ISBLK(mode)) *type = WALK_BLK;
+    else if (S_ISREG(mode)) *type = WALK_REG;
+    else if (S_ISLNK(mode)) *type = WALK_LINK;
+    else if (S_ISSOCK(mode)) *type = WALK_SOCK;
+    else return -1;
+    return 0;
+}
+
+static int fill_pending(walk_iter_t *it, const struct stat *st, int depth)
+{
+    walk_entry_t *ent = &it->pending;
+    if (mode_type(st->st_mode, &ent->type)) return -1;
+
+    ent->depth = depth;
+    ent->nlink = (long long) st->st_nlink;
+    ent->size = (long long) st->st_size;
+    ent->atime = st->st_atim;
+    ent->mtime = st->st_mtim;
+    it->has_pending = 1;
+
+    return 0;
+}
+
+/**
+ * Fetch next entry into it->pending.
+ * Returns 1 on success, 0 at the end or negative error.
+ */
+static int fetch(walk_iter_t *it)
+{
+    if (!it->started)
+    {
+        it->started = 1;
+
+        struct stat st;
+        if (fstat(it->root_fd, &st)) return -1;
+
+        strcpy(it->pending_path, ".");
+        it->pending_len = 1;
+        it->pending_name = 0;
+        if (fill_pending(it, &st, 0)) return -1;
+
+        // separate descriptor, fdopendir takes ownership
+        int fd = openat(it->root_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return -1;
+        if (push_frame(it, fd, 0)) return -1;
+        it->dir_path[0] = 0;
+
+        return 1;
+    }
+
+    while (it->n_frames)
+    {
+        walk_frame_t *top = &it->frames[it->n_frames - 1];
+
+        const char *ent_name = frame_next(top);
+        if (!ent_name)
+        {
+            if (errno) return -1;
+
+            pop_frame(it);
+            if (it->n_frames)
+                it->dir_path[it->frames[it->n_frames - 1].path_len] = 0;
+            continue;
+        }
+
+        // skip . and ..
+        if (!strcmp(".", ent_name) || !strcmp("..", ent_name))
+            continue;
+
+        size_t name_len = strlen(ent_name);
+        size_t prefix = top->path_len ? top->path_len + 1 : 0;
+        if (prefix + name_len + 1 > PATH_MAX) return -1;
+
+        memcpy(it->pending_path, it->dir_path, top->path_len);
+        if (prefix) it->pending_path[top->path_len] = '/';
+        memcpy(it->pending_path + prefix, ent_name, name_len + 1);
+        it->pending_len = prefix + name_len;
+        it->pending_name = prefix;
+        const char *name = it->pending_path + prefix;
+
+        // closed directories are reached from the root
+        struct stat st;
+        if (fstatat(top->dir ? dirfd(top->dir) : it->root_fd, top->dir ? name : it->pending_path,
+                    &st, AT_SYMLINK_NOFOLLOW))
+        {
+            // removed since readdir
+            if (errno == ENOENT) continue;
+            return -1;
+        }
+        if (fill_pending(it, &st, it->n_frames)) return -1;
+
+        if (S_ISDIR(st.st_mode))
+        {
+            // may close top, ent_name is not used after it
+            if (it->n_frames - it->n_spilled >= WALK_MAX_OPEN && spill_frame(it)) return -1;
+
+            int fd = openat(top->dir ? dirfd(top->dir) : it->root_fd,
+                            top->dir ? name : it->pending_path,
+                            O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (fd < 0) return -1;
+            // top may move when frames grow
+            if (push_frame(it, fd, it->pending_len)) return -1;
+            memcpy(it->dir_path, it->pending_path, it->pending_len + 1);
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+walk_iter_t* walk_iter_open(const char *path)
+{
+    if (!path) return NULL;
+
+    walk_iter_t *it = calloc(1, sizeof *it);
+    if (!it) return NULL;
+
+    it->root_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (it->root_fd < 0)
+    {
+        free(it);
+        return NULL;
+    }
+
+    return it;
+}
+
+int walk_iter_next(walk_iter_t *it, walk_entry_t *ents, int max_ents, char *buf, size_t buf_size)
+{
+    if (!it || !ents || !buf) return -1;
+    if (it->err) return -1;
+
+    int n = 0;
+    size_t used = 0;
+
+    while (n < max_ents)
+    {
+        if (!it->has_pending)
+        {
+            int res = fetch(it);
+            if (res < 0)
+            {
+                it->has_pending = 0;
+                // report after returning what was collected
+                if (n) it->err = 1;
+                else return -1;
+                break;
+            }
+            if (!res) break;
+        }
+
+        size_t need = it->pending_len + 1;
+        if (buf_size - used < need)
+        {
+            // entry waits for the next call
+            if (!n) return -1;
+            break;
+        }
+
+        char *path = buf + used;
+        memcpy(path, it->pending_path, need);
+        used += need;
+
+        ents[n] = it->pending;
+        ents[n].path = path;
+        ents[n].name = path + it->pending_name;
+        it->has_pending = 0;
+        n++;
+    }
+
+    return n;
+}
+
+int walk_iter_rootfd(const walk_iter_t *it)
+{
+    return it ? it->root_fd : -1;
+}
+
+void walk_iter_close(walk_iter_t *it)
+{
+    if (!it) return;
+
+    while (it->n_frames) pop_frame(it);
+    free(it->frames);
+    close(it->root_fd);
+    free(it);
+}
+
+int walk_dir_cb(const char *path, int (*cb)(const walk_entry_t *ent, void *arg), void *arg)
+{
+    if (!path || !cb) return -1;
+
+    walk_iter_t *it = walk_iter_open(path);
+    if (!it) return -1;
+
+    int ret = 0;
+    walk_entry_t ents[CB_BATCH];
+    char *buf = malloc(CB_BUF_SIZE);
+    if (!buf) ret = -1;
+
+    while (!ret)
+    {
+        int n = walk_iter_next(it, ents, CB_BATCH, buf, CB_BUF_SIZE);
+        if (n < 0) ret = -1;
+        if (n <= 0) break;
+
+        for (int i = 0; i < n && !ret; ++i)
+            ret = cb(&ents[i], arg);
+    }
+
+    free(buf);
+    walk_iter_close(it);
+
+    return ret;
+}
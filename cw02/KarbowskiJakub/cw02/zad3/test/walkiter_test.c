@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "walkiter.h"
+
+// depth of nested directories, deeper than WALK_MAX_OPEN
+#define DEPTH (12)
+// files in wide directory
+#define WIDE (200)
+#define MAX_ENTS (1024)
+
+typedef struct expected_t
+{
+    char path[PATH_MAX];
+    walk_type_t type;
+    long long size;
+    int seen;
+} expected_t;
+
+static expected_t EXPECTED[MAX_ENTS];
+static int N_EXPECTED;
+
+static char SEEN[MAX_ENTS][PATH_MAX];
+static int N_SEEN;
+// entries returned by walk_dir_cb
+static char ORDER[MAX_ENTS][PATH_MAX];
+
+static int BASE_FDS;
+static int MAX_FDS;
+
+static int FAILED;
+
+#define CHECK(cond, ...) do { if (!(cond)) { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); FAILED = 1; } } while (0)
+
+static int count_fds(void)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) return -1;
+    int n = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir))) if (ent->d_name[0] != '.') n++;
+    closedir(dir);
+    // descriptor of dir itself
+    return n - 1;
+}
+
+static void expect(const char *path, walk_type_t type, long long size)
+{
+    expected_t *e = &EXPECTED[N_EXPECTED++];
+    strcpy(e->path, path);
+    e->type = type;
+    e->size = size;
+}
+
+static int make_file(const char *path, long long size)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    int res = ftruncate(fd, size);
+    close(fd);
+    if (res) return -1;
+    expect(path, WALK_REG, size);
+    return 0;
+}
+
+/**
+ * Create fixture tree in current directory.
+ */
+static int make_tree(void)
+{
+    char path[PATH_MAX] = "";
+    expect(".", WALK_DIR, -1);
+
+    for (int i = 0; i < DEPTH; ++i)
+    {
+        char name[32];
+        sprintf(name, "%sd%d", i ? "/" : "", i);
+        strcat(path, name);
+        if (mkdir(path, 0755)) return -1;
+        expect(path, WALK_DIR, -1);
+
+        char file[PATH_MAX];
+        snprintf(file, sizeof file, "%s/f", path);
+        if (make_file(file, i)) return -1;
+    }
+
+    if (mkdir("d0/d1/wide", 0755)) return -1;
+    expect("d0/d1/wide", WALK_DIR, -1);
+    for (int i = 0; i < WIDE; ++i)
+    {
+        char file[PATH_MAX];
+        snprintf(file, sizeof file, "d0/d1/wide/file%03d", i);
+        if (make_file(file, i)) return -1;
+    }
+
+    if (symlink("d0", "link")) return -1;
+    expect("link", WALK_LINK, -1);
+    if (mkfifo("d0/d1/d2/fifo", 0644)) return -1;
+    expect("d0/d1/d2/fifo", WALK_FIFO, -1);
+
+    return 0;
+}
+
+static int path_depth(const char *path)
+{
+    if (!strcmp(path, ".")) return 0;
+    int depth = 1;
+    for (; *path; ++path) depth += *path == '/';
+    return depth;
+}
+
+static int check_entry(const walk_entry_t *ent, void *arg)
+{
+    int fds = count_fds();
+    if (fds > MAX_FDS) MAX_FDS = fds;
+
+    CHECK(N_SEEN < MAX_ENTS, "too many entries");
+    if (N_SEEN == MAX_ENTS) return 1;
+    strcpy(SEEN[N_SEEN++], ent->path);
+
+    CHECK(ent->depth == path_depth(ent->path), "%s: depth %d", ent->path, ent->depth);
+    const char *slash = strrchr(ent->path, '/');
+    CHECK(!strcmp(ent->name, slash ? slash + 1 : ent->path), "%s: name %s", ent->path, ent->name);
+
+    // parent must come first
+    if (slash)
+    {
+        int found = 0;
+        size_t len = slash - ent->path;
+        for (int i = 0; i < N_SEEN - 1 && !found; ++i)
+            found = strlen(SEEN[i]) == len && !strncmp(SEEN[i], ent->path, len);
+        CHECK(found, "%s: returned before its parent", ent->path);
+    }
+
+    for (int i = 0; i < N_EXPECTED; ++i)
+    {
+        expected_t *e = &EXPECTED[i];
+        if (strcmp(e->path, ent->path)) continue;
+        CHECK(!e->seen, "%s: returned twice", ent->path);
+        CHECK(e->type == ent->type, "%s: type %d, expected %d", ent->path, ent->type, e->type);
+        CHECK(e->size < 0 || e->size == ent->size, "%s: size %lld, expected %lld",
+              ent->path, ent->size, e->size);
+        e->seen = 1;
+        return 0;
+    }
+
+    CHECK(0, "%s: unexpected entry", ent->path);
+    return 0;
+}
+
+static void check_all_seen(const char *what)
+{
+    for (int i = 0; i < N_EXPECTED; ++i)
+    {
+        CHECK(EXPECTED[i].seen, "%s: %s not returned", what, EXPECTED[i].path);
+        EXPECTED[i].seen = 0;
+    }
+
+    // root descriptor of iterator is open too
+    CHECK(MAX_FDS <= BASE_FDS + WALK_MAX_OPEN + 1, "%s: %d descriptors open, limit %d",
+          what, MAX_FDS - BASE_FDS, WALK_MAX_OPEN + 1);
+}
+
+int main(void)
+{
+    char root[] = "/tmp/walkiter_test.XXXXXX";
+    if (!mkdtemp(root) || chdir(root) || make_tree())
+    {
+        perror("fixture");
+        return 1;
+    }
+    BASE_FDS = count_fds();
+
+    // callback walk
+    N_SEEN = 0;
+    MAX_FDS = 0;
+    CHECK(walk_dir_cb(".", check_entry, NULL) == 0, "walk_dir_cb failed");
+    check_all_seen("walk_dir_cb");
+
+    // single entries with smallest buffer, same order expected
+    walk_iter_t *it = walk_iter_open(".");
+    CHECK(it, "walk_iter_open failed");
+    int n_cb = N_SEEN;
+    memcpy(ORDER, SEEN, sizeof ORDER);
+    N_SEEN = 0;
+    MAX_FDS = 0;
+    int n = 0;
+    while (it)
+    {
+        walk_entry_t ent;
+        static char buf[PATH_MAX];
+        int res = walk_iter_next(it, &ent, 1, buf, sizeof buf);
+        CHECK(res >= 0, "walk_iter_next failed");
+        if (res <= 0) break;
+
+        CHECK(n < n_cb && !strcmp(ORDER[n], ent.path), "%s: order differs from walk_dir_cb", ent.path);
+        n++;
+        check_entry(&ent, NULL);
+    }
+    CHECK(n == n_cb, "walk_iter_next returned %d entries, walk_dir_cb %d", n, n_cb);
+    walk_iter_close(it);
+    check_all_seen("walk_iter_next");
+
+    // missing root
+    CHECK(!walk_iter_open("missing"), "walk_iter_open of missing path succeeded");
+
+    // cleanup
+    char cmd[PATH_MAX];
+    snprintf(cmd, sizeof cmd, "rm -rf '%s'", root);
+    if (chdir("/") || system(cmd)) perror("cleanup");
+
+    printf("%s: %d entries\n", FAILED ? "FAIL" : "OK", n_cb);
+    return FAILED;
+}
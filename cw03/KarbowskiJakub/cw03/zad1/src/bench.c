@@ -0,0 +1,122 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// tasks running at once in throughput test
+#define BENCH_WINDOW (256)
+
+static const char *const ENGINE_NAMES[] = {
+        [SPAWN_FORK] = "fork",
+        [SPAWN_VFORK] = "vfork",
+        [SPAWN_POSIX] = "posix_spawn",
+        [SPAWN_POOL] = "pool",
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Start and wait for tasks one at a time.
+ * Returns mean time of task in seconds or negative error.
+ */
+static double measure_latency(spawner_t *sp, int n_tasks)
+{
+    double t0 = now();
+    for (int i = 0; i < n_tasks; ++i)
+    {
+        if (spawn_start(sp, BENCH_ARG)) return -1;
+        if (spawn_wait(sp)) return -1;
+    }
+    return (now() - t0) / n_tasks;
+}
+
+/**
+ * Keep up to BENCH_WINDOW tasks running.
+ * Returns tasks per second or negative error.
+ */
+static double measure_throughput(spawner_t *sp, int n_tasks)
+{
+    int started = 0;
+    int running = 0;
+
+    double t0 = now();
+    while (started < n_tasks || running)
+    {
+        if (started < n_tasks && running < BENCH_WINDOW)
+        {
+            if (spawn_start(sp, BENCH_ARG)) return -1;
+            started++;
+            running++;
+            continue;
+        }
+        if (spawn_wait(sp)) return -1;
+        running--;
+    }
+    return n_tasks / (now() - t0);
+}
+
+static int bench_engine(spawner_t *sp, int n_tasks, long rss_mb)
+{
+    double latency = measure_latency(sp, n_tasks);
+    if (latency < 0) return -1;
+    double throughput = measure_throughput(sp, n_tasks);
+    if (throughput < 0) return -1;
+
+    printf("%s,%ld,%d,%.2f,%.0f\n", ENGINE_NAMES[sp->engine],
+           rss_mb, n_tasks, latency * 1e6, throughput);
+    fflush(stdout);
+    return 0;
+}
+
+int run_bench(spawn_fn_t fn, int n_tasks, long max_rss_mb, int pool_size)
+{
+    if (!fn || n_tasks <= 0 || max_rss_mb < 0) return -1;
+
+    // pool is forked before parent grows
+    spawner_t pool;
+    if (spawner_init(&pool, SPAWN_POOL, fn, pool_size)) return -1;
+
+    printf("engine,rss_mb,tasks,latency_us,throughput_per_s\n");
+
+    int err = 0;
+    char *ballast = NULL;
+    long rss_mb = 0;
+    for (;;)
+    {
+        // touch every page so it is mapped
+        char *mem = realloc(ballast, (rss_mb ? rss_mb : 1) << 20);
+        if (!mem)
+        {
+            err = -1;
+            break;
+        }
+        ballast = mem;
+        memset(ballast, 1, rss_mb << 20);
+
+        for (spawn_engine_t engine = SPAWN_FORK; engine < SPAWN_POOL && !err; ++engine)
+        {
+            spawner_t sp;
+            err = spawner_init(&sp, engine, fn, 0);
+            if (err) break;
+            err = bench_engine(&sp, n_tasks, rss_mb);
+            spawner_free(&sp);
+        }
+        if (!err) err = bench_engine(&pool, n_tasks, rss_mb);
+        if (err) break;
+
+        if (rss_mb == max_rss_mb) break;
+        rss_mb = rss_mb ? rss_mb * 4 : 16;
+        if (rss_mb > max_rss_mb) rss_mb = max_rss_mb;
+    }
+
+    free(ballast);
+    spawner_free(&pool);
+    return err;
+}
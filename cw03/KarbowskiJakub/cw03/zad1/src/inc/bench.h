@@ -0,0 +1,23 @@
+#ifndef JK_03_01_BENCH_H
+#define JK_03_01_BENCH_H
+
+#include "spawner.h"
+
+// argument of benchmark tasks, task should return at once
+#define BENCH_ARG (-1)
+
+/**
+ * Compare spawn engines and print CSV.
+ * Parent memory is grown to 0, 16, 64, ... max_rss_mb MB,
+ * for every size each engine runs n_tasks tasks one by one (latency)
+ * and up to BENCH_WINDOW at once (throughput).
+ *
+ * @param fn Task, called with BENCH_ARG.
+ * @param n_tasks Tasks per measurement.
+ * @param max_rss_mb Largest parent memory.
+ * @param pool_size Workers of SPAWN_POOL.
+ * @return 0 or negative error.
+ */
+int run_bench(spawn_fn_t fn, int n_tasks, long max_rss_mb, int pool_size);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef JK_03_01_SPAWNER_H
+#define JK_03_01_SPAWNER_H
+
+#include <sys/types.h>
+
+// argv[1] of processes started by SPAWN_POSIX
+#define SPAWN_CHILD_ARG "--spawn-child"
+
+typedef enum spawn_engine_t
+{
+    // plain fork, copies page tables of the parent
+    SPAWN_FORK,
+    // clone(CLONE_VM | CLONE_VFORK) on a separate stack,
+    // parent waits until the task finishes
+    SPAWN_VFORK,
+    // posix_spawn of /proc/self/exe
+    SPAWN_POSIX,
+    // processes forked once, tasks sent over a pipe
+    SPAWN_POOL,
+} spawn_engine_t;
+
+/**
+ * Task run in a child, result is its exit status.
+ * SPAWN_VFORK tasks share memory with the parent,
+ * they must not use stdio or malloc, output goes through write(2).
+ */
+typedef int (*spawn_fn_t)(long arg);
+
+typedef struct spawner_t
+{
+    spawn_engine_t engine;
+    spawn_fn_t fn;
+
+    // SPAWN_VFORK
+    char *stack;
+    size_t stack_size;
+    // results of finished vfork tasks not yet waited for
+    long n_done;
+    int n_failed;
+
+    // SPAWN_POOL
+    pid_t *pool;
+    int pool_size;
+    // parent writes task arguments
+    int task_fd;
+    // parent reads task results
+    int result_fd;
+} spawner_t;
+
+/**
+ * Prepare spawner.
+ * SPAWN_POOL forks pool_size workers here,
+ * so it should be created while the parent is still small.
+ *
+ * @param sp Output spawner.
+ * @param engine How children are created.
+ * @param fn Task.
+ * @param pool_size Workers of SPAWN_POOL, ignored otherwise.
+ * @return 0 or negative error.
+ */
+int spawner_init(spawner_t *sp, spawn_engine_t engine, spawn_fn_t fn, int pool_size);
+
+/**
+ * Stop pool workers and release resources.
+ * Tasks should be waited for first.
+ */
+void spawner_free(spawner_t *sp);
+
+/**
+ * Run task with argument arg in a child.
+ *
+ * @return 0 or negative error.
+ */
+int spawn_start(spawner_t *sp, long arg);
+
+/**
+ * Wait for any started task.
+ *
+ * @return 0 if task succeeded, 1 if it failed or negative error.
+ */
+int spawn_wait(spawner_t *sp);
+
+/**
+ * Entry point of SPAWN_POSIX children.
+ * Call at the beginning of main, runs fn and exits
+ * if the process was started by posix_spawn, otherwise returns.
+ */
+void spawn_child_main(int argc, char **argv, spawn_fn_t fn);
+
+#endif
@@ -1,41 +1,138 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <unistd.h>
-#include <sys/wait.h>
+#include "spawner.h"
+#include "bench.h"
 
 static const char HELP[] =
         "SO Lab3 Zad1 - Jakub Karbowski\n"
         "Usage:\n"
-        "%s N - start N processes\n";
+        "%s [-e ENGINE] N - start N processes\n"
+        "%s -B [-n TASKS] [-M MB] - compare engines with parent "
+        "memory up to MB (default 1024), print CSV\n"
+        "ENGINE - fork (default), vfork, spawn (posix_spawn) or pool\n";
 
-static void child_task()
+static int child_task(long arg)
 {
-    printf("Hello from %lld\n", (long long) getpid());
-    exit(0);
+    if (arg == BENCH_ARG) return 0;
+
+    // stdio buffers are shared with the parent under vfork
+    char msg[64];
+    int len = snprintf(msg, sizeof msg, "Hello from %lld\n", (long long) getpid());
+    if (write(STDOUT_FILENO, msg, len) != len) return 1;
+    return 0;
 }
 
-int main(int argc, char **argv)
+static long parse_long(const char *str, const char *name, long min, long max)
 {
-    if (argc != 2)
+    char *endptr;
+    long val = strtol(str, &endptr, 10);
+    if (*endptr || val < min || val > max)
     {
-        fprintf(stderr, HELP, argv[0]);
+        fprintf(stderr, "Invalid %s: %s\n", name, str);
         return -1;
     }
+    return val;
+}
 
-    char *endptr;
-    long n = strtol(argv[1], &endptr, 10);
-    if (*endptr || n < 0)
+int main(int argc, char **argv)
+{
+    spawn_child_main(argc, argv, child_task);
+
+    spawn_engine_t engine = SPAWN_FORK;
+    int bench = 0;
+    long n_tasks = 1000;
+    long max_rss_mb = 1024;
+
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus < 1) n_cpus = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "e:Bn:M:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'e':
+                if (!strcmp("fork", optarg)) engine = SPAWN_FORK;
+                else if (!strcmp("vfork", optarg)) engine = SPAWN_VFORK;
+                else if (!strcmp("spawn", optarg)) engine = SPAWN_POSIX;
+                else if (!strcmp("pool", optarg)) engine = SPAWN_POOL;
+                else
+                {
+                    fprintf(stderr, "Invalid ENGINE: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'B':
+                bench = 1;
+                break;
+
+            case 'n':
+                n_tasks = parse_long(optarg, "TASKS", 1, INT_MAX);
+                if (n_tasks < 0) return -1;
+                break;
+
+            case 'M':
+                max_rss_mb = parse_long(optarg, "MB", 0, LONG_MAX >> 20);
+                if (max_rss_mb < 0) return -1;
+                break;
+
+            default:
+                fprintf(stderr, HELP, argv[0], argv[0]);
+                return -1;
+        }
+    }
+
+    if (bench)
+    {
+        if (optind != argc)
+        {
+            fprintf(stderr, HELP, argv[0], argv[0]);
+            return -1;
+        }
+        int err = run_bench(child_task, (int) n_tasks, max_rss_mb, (int) n_cpus);
+        if (err) fprintf(stderr, "Error!\n");
+        return err;
+    }
+
+    if (argc - optind != 1)
     {
-        fprintf(stderr, "Invalid N: %s\n", argv[1]);
+        fprintf(stderr, HELP, argv[0], argv[0]);
         return -1;
     }
 
+    long n = parse_long(argv[optind], "N", 0, LONG_MAX);
+    if (n < 0) return -1;
+
     printf("Spawning %ld processes\n", n);
-    for (long i = 0; i < n; ++i)
+    // children write past the stdio buffer
+    fflush(stdout);
+
+    spawner_t sp;
+    if (spawner_init(&sp, engine, child_task, n < n_cpus ? (n ? n : 1) : n_cpus))
     {
-        if (!fork()) child_task();
+        fprintf(stderr, "Error!\n");
+        return -1;
     }
-    while (wait(NULL) >= 0);
 
-    return 0;
+    int err = 0;
+    long started = 0;
+    for (; started < n; ++started)
+    {
+        if (spawn_start(&sp, started))
+        {
+            err = -1;
+            break;
+        }
+    }
+    for (long i = 0; i < started; ++i)
+    {
+        if (spawn_wait(&sp)) err = -1;
+    }
+    spawner_free(&sp);
+
+    return err;
 }
@@ -0,0 +1,268 @@
+#define _GNU_SOURCE
+#include "spawner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#define VFORK_STACK_SIZE (64 * 1024)
+#define ARG_LEN (32)
+
+extern char **environ;
+
+typedef struct pool_result_t
+{
+    long arg;
+    int status;
+} pool_result_t;
+
+typedef struct vfork_arg_t
+{
+    spawn_fn_t fn;
+    long arg;
+} vfork_arg_t;
+
+static int vfork_task(void *p)
+{
+    vfork_arg_t *va = p;
+    // memory is shared, no atexit handlers or stdio flush
+    _exit(va->fn(va->arg));
+}
+
+/**
+ * Main loop of pool worker.
+ */
+static void pool_worker(spawner_t *sp)
+{
+    long arg;
+    for (;;)
+    {
+        ssize_t n = read(sp->task_fd, &arg, sizeof arg);
+        // parent closed the pipe
+        if (n <= 0) break;
+        if (n != sizeof arg) exit(-1);
+
+        pool_result_t res = {
+            .arg = arg,
+            .status = sp->fn(arg),
+        };
+        fflush(stdout);
+
+        if (write(sp->result_fd, &res, sizeof res) != sizeof res)
+            exit(-1);
+    }
+    exit(0);
+}
+
+static int pool_init(spawner_t *sp, int pool_size)
+{
+    int task_pipe[2];
+    int result_pipe[2];
+    if (pipe(task_pipe)) return -1;
+    if (pipe(result_pipe))
+    {
+        close(task_pipe[0]);
+        close(task_pipe[1]);
+        return -1;
+    }
+
+    sp->pool = calloc(pool_size, sizeof *sp->pool);
+    if (!sp->pool)
+    {
+        close(task_pipe[0]);
+        close(task_pipe[1]);
+        close(result_pipe[0]);
+        close(result_pipe[1]);
+        return -1;
+    }
+
+    fflush(NULL);
+
+    int err = 0;
+    for (; sp->pool_size < pool_size; ++sp->pool_size)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            err = -1;
+            break;
+        }
+        if (!pid)
+        {
+            close(task_pipe[1]);
+            close(result_pipe[0]);
+            sp->task_fd = task_pipe[0];
+            sp->result_fd = result_pipe[1];
+            pool_worker(sp);
+        }
+        sp->pool[sp->pool_size] = pid;
+    }
+
+    close(task_pipe[0]);
+    close(result_pipe[1]);
+    sp->task_fd = task_pipe[1];
+    sp->result_fd = result_pipe[0];
+
+    return err;
+}
+
+int spawner_init(spawner_t *sp, spawn_engine_t engine, spawn_fn_t fn, int pool_size)
+{
+    if (!sp || !fn) return -1;
+
+    memset(sp, 0, sizeof *sp);
+    sp->engine = engine;
+    sp->fn = fn;
+    sp->task_fd = -1;
+    sp->result_fd = -1;
+
+    switch (engine)
+    {
+        case SPAWN_FORK:
+        case SPAWN_POSIX:
+            return 0;
+
+        case SPAWN_VFORK:
+            // parent is suspended while child runs, one stack is enough
+            sp->stack_size = VFORK_STACK_SIZE;
+            sp->stack = malloc(sp->stack_size);
+            return sp->stack ? 0 : -1;
+
+        case SPAWN_POOL:
+            if (pool_size <= 0) return -1;
+            if (pool_init(sp, pool_size))
+            {
+                spawner_free(sp);
+                return -1;
+            }
+            return 0;
+    }
+
+    return -1;
+}
+
+void spawner_free(spawner_t *sp)
+{
+    if (!sp) return;
+
+    free(sp->stack);
+    sp->stack = NULL;
+
+    if (sp->task_fd >= 0) close(sp->task_fd);
+    if (sp->result_fd >= 0) close(sp->result_fd);
+    sp->task_fd = -1;
+    sp->result_fd = -1;
+
+    // workers exit at end of task pipe
+    for (int i = 0; i < sp->pool_size; ++i)
+        waitpid(sp->pool[i], NULL, 0);
+    free(sp->pool);
+    sp->pool = NULL;
+    sp->pool_size = 0;
+}
+
+int spawn_start(spawner_t *sp, long arg)
+{
+    if (!sp) return -1;
+
+    switch (sp->engine)
+    {
+        case SPAWN_FORK:
+        {
+            // children must not repeat buffered output
+            fflush(NULL);
+            pid_t pid = fork();
+            if (pid < 0) return -1;
+            if (!pid) exit(sp->fn(arg));
+            return 0;
+        }
+
+        case SPAWN_VFORK:
+        {
+            vfork_arg_t va = {
+                .fn = sp->fn,
+                .arg = arg,
+            };
+            // returns after child exits
+            pid_t pid = clone(vfork_task, sp->stack + sp->stack_size,
+                              CLONE_VM | CLONE_VFORK | SIGCHLD, &va);
+            if (pid < 0) return -1;
+
+            int status;
+            if (waitpid(pid, &status, 0) != pid) return -1;
+            sp->n_done++;
+            if (!WIFEXITED(status) || WEXITSTATUS(status)) sp->n_failed++;
+            return 0;
+        }
+
+        case SPAWN_POSIX:
+        {
+            char arg_str[ARG_LEN];
+            snprintf(arg_str, sizeof arg_str, "%ld", arg);
+            char *argv[] = {"spawn-child", SPAWN_CHILD_ARG, arg_str, NULL};
+
+            fflush(NULL);
+            pid_t pid;
+            if (posix_spawn(&pid, "/proc/self/exe", NULL, NULL, argv, environ))
+                return -1;
+            return 0;
+        }
+
+        case SPAWN_POOL:
+            return write(sp->task_fd, &arg, sizeof arg) == sizeof arg ? 0 : -1;
+    }
+
+    return -1;
+}
+
+int spawn_wait(spawner_t *sp)
+{
+    if (!sp) return -1;
+
+    switch (sp->engine)
+    {
+        case SPAWN_FORK:
+        case SPAWN_POSIX:
+        {
+            int status;
+            if (wait(&status) < 0) return -1;
+            return WIFEXITED(status) && !WEXITSTATUS(status) ? 0 : 1;
+        }
+
+        case SPAWN_VFORK:
+            // already reaped in spawn_start
+            if (!sp->n_done) return -1;
+            sp->n_done--;
+            if (sp->n_failed)
+            {
+                sp->n_failed--;
+                return 1;
+            }
+            return 0;
+
+        case SPAWN_POOL:
+        {
+            pool_result_t res;
+            if (read(sp->result_fd, &res, sizeof res) != sizeof res) return -1;
+            return res.status ? 1 : 0;
+        }
+    }
+
+    return -1;
+}
+
+void spawn_child_main(int argc, char **argv, spawn_fn_t fn)
+{
+    if (argc != 3 || strcmp(SPAWN_CHILD_ARG, argv[1])) return;
+
+    char *endptr;
+    long arg = strtol(argv[2], &endptr, 10);
+    if (*endptr) exit(-1);
+
+    exit(fn(arg));
+}
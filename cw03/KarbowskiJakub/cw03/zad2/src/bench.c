@@ -0,0 +1,187 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// strong scaling widths are dx times powers of 10
+#define BENCH_SIZES (3)
+// summation widths are dx divided by powers of 10
+#define BENCH_SUM_SIZES (4)
+// integral of built-in 4/(x^2+1)
+#define BENCH_PI (3.14159265358979323846)
+// tolerance of reference integral of EXPR
+#define BENCH_REF_TOL (1e-14)
+
+typedef struct bench_point_t
+{
+    long long cells;
+    double sum;
+    double t_spawn;
+    double t_compute;
+    double t_reduce;
+    double t_total;
+} bench_point_t;
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *vals, int n)
+{
+    qsort(vals, n, sizeof *vals, compare_double);
+    if (n % 2) return vals[n / 2];
+    return (vals[n / 2 - 1] + vals[n / 2]) / 2;
+}
+
+/**
+ * Run one configuration reps times.
+ */
+static int measure(const calc_config_t *base, double dx, int n_workers, int reps, bench_point_t *pt)
+{
+    calc_config_t cfg = *base;
+    cfg.dx = dx;
+    cfg.n_workers = n_workers;
+
+    // spawn, compute, reduce, total
+    double *samples = malloc(4 * reps * sizeof *samples);
+    if (!samples) return -1;
+
+    int err = 0;
+    for (int r = 0; r < reps && !err; ++r)
+    {
+        calc_result_t res;
+        err = calc_integrate(&cfg, &res);
+        pt->cells = res.evals;
+        pt->sum = res.sum;
+        samples[r] = res.t_spawn;
+        samples[reps + r] = res.t_compute;
+        samples[2 * reps + r] = res.t_reduce;
+        samples[3 * reps + r] = res.t_total;
+    }
+
+    if (!err)
+    {
+        pt->t_spawn = median(samples, reps);
+        pt->t_compute = median(samples + reps, reps);
+        pt->t_reduce = median(samples + 2 * reps, reps);
+        pt->t_total = median(samples + 3 * reps, reps);
+    }
+
+    free(samples);
+    return err;
+}
+
+static void print_point(const char *scaling, const calc_config_t *cfg, int n_workers,
+                        int reps, const bench_point_t *pt, double speedup, double efficiency)
+{
+    printf("%s,%s,%s,%d,%lld,%d,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f\n",
+           scaling,
+           cfg->backend == CALC_THREAD ? "thread" : "fork",
+           cfg->mode == CALC_FILE ? "file" : "shm",
+           n_workers, pt->cells, reps,
+           pt->t_spawn, pt->t_compute, pt->t_reduce, pt->t_total,
+           speedup, efficiency);
+}
+
+/**
+ * Next worker count: powers of 2 and max_workers.
+ */
+static int next_workers(int n, int max_workers)
+{
+    if (n >= max_workers) return 0;
+    if (2 * n > max_workers) return max_workers;
+    return 2 * n;
+}
+
+int run_bench(const calc_config_t *cfg, int max_workers, int reps)
+{
+    if (!cfg || cfg->method != CALC_MIDPOINT || cfg->dx <= 0) return -1;
+    if (max_workers <= 0 || reps <= 0) return -1;
+
+    printf("scaling,backend,mode,workers,cells,reps,"
+           "spawn_s,compute_s,reduce_s,total_s,speedup,efficiency\n");
+
+    bench_point_t pt;
+    bench_point_t base;
+
+    double dx = cfg->dx;
+    for (int size = 0; size < BENCH_SIZES; ++size, dx *= 10)
+    {
+        for (int n = 1; n; n = next_workers(n, max_workers))
+        {
+            if (measure(cfg, dx, n, reps, &pt)) return -1;
+            if (n == 1) base = pt;
+            double speedup = base.t_total / pt.t_total;
+            print_point("strong", cfg, n, reps, &pt, speedup, speedup / n);
+            fflush(stdout);
+        }
+    }
+
+    for (int n = 1; n; n = next_workers(n, max_workers))
+    {
+        // same rectangles per worker
+        if (measure(cfg, cfg->dx * max_workers / n, n, reps, &pt)) return -1;
+        if (n == 1) base = pt;
+        double efficiency = base.t_total / pt.t_total;
+        print_point("weak", cfg, n, reps, &pt, n * efficiency, efficiency);
+        fflush(stdout);
+    }
+
+    return 0;
+}
+
+/**
+ * Integral used to compute errors of summation benchmark.
+ */
+static int reference(const calc_config_t *base, double *ref)
+{
+    if (!base->fun)
+    {
+        *ref = BENCH_PI;
+        return 0;
+    }
+
+    calc_config_t cfg = *base;
+    cfg.method = CALC_GK;
+    cfg.tol = BENCH_REF_TOL;
+    cfg.sum = CALC_SUM_KAHAN;
+
+    calc_result_t res;
+    if (calc_integrate(&cfg, &res)) return -1;
+    *ref = res.sum;
+    return 0;
+}
+
+int run_bench_sum(const calc_config_t *cfg, int n_workers, int reps)
+{
+    if (!cfg || cfg->method != CALC_MIDPOINT || cfg->dx <= 0) return -1;
+    if (n_workers <= 0 || reps <= 0) return -1;
+
+    double ref;
+    if (reference(cfg, &ref)) return -1;
+
+    printf("backend,workers,sum,cells,reps,total_s,cells_per_s,result,abs_error\n");
+
+    double dx = cfg->dx;
+    for (int size = 0; size < BENCH_SUM_SIZES; ++size, dx /= 10)
+    {
+        for (int naive = 0; naive < 2; ++naive)
+        {
+            calc_config_t sum_cfg = *cfg;
+            sum_cfg.sum = naive ? CALC_SUM_NAIVE : CALC_SUM_KAHAN;
+
+            bench_point_t pt;
+            if (measure(&sum_cfg, dx, n_workers, reps, &pt)) return -1;
+            printf("%s,%d,%s,%lld,%d,%.6f,%.6e,%.17g,%.3e\n",
+                   cfg->backend == CALC_THREAD ? "thread" : "fork",
+                   n_workers, naive ? "naive" : "kahan", pt.cells, reps,
+                   pt.t_total, pt.cells / pt.t_total, pt.sum, pt.sum - ref);
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
@@ -2,44 +2,414 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <math.h>
+#include <time.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include "expr.h"
 
 #define X_FROM (0.)
 #define X_TO   (1.)
 
 #define FNAME_LEN (64)
 
+// doubles evaluated at once
+#define LANES (8)
+
+// subintervals per worker for adaptive methods
+#define CHUNKS_PER_WORKER (16)
+// maximum bisections of subinterval
+#define MAX_DEPTH (48)
+
+typedef double vec_t __attribute__((vector_size(LANES * sizeof(double))));
+
+/**
+ * Result of one worker.
+ */
+typedef struct calc_part_t
+{
+    double sum;
+    // estimated absolute error
+    double err;
+    long long evals;
+    // CLOCK_MONOTONIC, common to all processes
+    double t_start;
+    double t_end;
+} calc_part_t;
+
+/**
+ * Memory shared with workers.
+ */
+typedef struct calc_shared_t
+{
+    // next subinterval to take
+    int next_chunk;
+    calc_part_t parts[];
+} calc_shared_t;
+
+/**
+ * Neumaier compensated sum.
+ */
+typedef struct ksum_t
+{
+    double sum;
+    // lost low order bits
+    double c;
+} ksum_t;
+
+typedef struct calc_job_t
+{
+    const calc_config_t *cfg;
+    long long n_cells;
+    int n_chunks;
+    calc_shared_t *shared;
+} calc_job_t;
+
+// Gauss-Kronrod 7-15 nodes and weights
+static const double GK_X[8] = {
+        0.991455371120812639206854697526329,
+        0.949107912342758524526189684047851,
+        0.864864423359769072789712788640926,
+        0.741531185599394439863864773280788,
+        0.586087235467691130294144845693013,
+        0.405845151377397166906606412076961,
+        0.207784955007898467600689403773245,
+        0.000000000000000000000000000000000,
+};
+static const double GK_WK[8] = {
+        0.022935322010529224963732008058970,
+        0.063092092629978553290700663189204,
+        0.104790010322250183839876322541518,
+        0.140653259715525918745189590510238,
+        0.169004726639267902826583426598550,
+        0.190350578064785409913256402421014,
+        0.204432940075298892414161999234649,
+        0.209482141084727828012999174891714,
+};
+// Gauss weights of nodes GK_X[1], GK_X[3], GK_X[5], GK_X[7]
+static const double GK_WG[4] = {
+        0.129484966168869693270611432679082,
+        0.279705391489276667901467771423780,
+        0.381830050505118944950369775488975,
+        0.417959183673469387755102040816327,
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 static double my_fun(double x)
 {
     return 4. / (x*x + 1.);
 }
 
-static void worker_task(int wid, int n_proc, int n_cells)
+/**
+ * Vectors go through pointers, passing them by value
+ * needs AVX-512 registers for the ABI.
+ */
+static void my_fun_vec(vec_t *y, const vec_t *x)
+{
+    *y = 4. / (*x * *x + 1.);
+}
+
+/**
+ * Evaluate integrand, fun or my_fun if NULL.
+ */
+static void fun_eval(const expr_t *fun, const double *x, double *y, int n)
+{
+    if (fun)
+    {
+        expr_eval(fun, x, y, n);
+        return;
+    }
+    for (int i = 0; i < n; ++i) y[i] = my_fun(x[i]);
+}
+
+static void ksum_add(ksum_t *k, double val, calc_sum_t mode)
+{
+    if (mode == CALC_SUM_NAIVE)
+    {
+        k->sum += val;
+        return;
+    }
+
+    double t = k->sum + val;
+    if (fabs(k->sum) >= fabs(val)) k->c += (k->sum - t) + val;
+    else k->c += (val - t) + k->sum;
+    k->sum = t;
+}
+
+static double ksum_get(const ksum_t *k)
+{
+    return k->sum + k->c;
+}
+
+/**
+ * Add values to lane accumulators.
+ * n is a multiple of LANES.
+ */
+static void sum_lanes(vec_t *acc, vec_t *comp, const double *y, int n, calc_sum_t mode)
+{
+    for (int i = 0; i < n; i += LANES)
+    {
+        vec_t v;
+        memcpy(&v, y + i, sizeof v);
+        if (mode == CALC_SUM_NAIVE)
+        {
+            *acc += v;
+        }
+        else
+        {
+            vec_t t = *acc + (v - *comp);
+            *comp = (t - *acc) - (v - *comp);
+            *acc = t;
+        }
+    }
+}
+
+/**
+ * Sum rectangles [begin, end) of n_cells.
+ */
+static double integrate(const expr_t *fun, long long begin, long long end,
+                        long long n_cells, calc_sum_t mode)
+{
+    double dx = (X_TO - X_FROM) / n_cells;
+    double x0 = X_FROM + dx / 2;
+
+    vec_t lane;
+    for (int l = 0; l < LANES; ++l) lane[l] = l;
+
+    vec_t acc = {0};
+    vec_t comp = {0};
+    long long i = begin;
+    if (fun)
+    {
+        // interpreter works on whole batches
+        double xs[EXPR_BATCH];
+        double ys[EXPR_BATCH];
+        for (; end - i >= EXPR_BATCH; i += EXPR_BATCH)
+        {
+            for (int k = 0; k < EXPR_BATCH; ++k)
+                xs[k] = x0 + (double) (i + k) * dx;
+            expr_eval(fun, xs, ys, EXPR_BATCH);
+            sum_lanes(&acc, &comp, ys, EXPR_BATCH, mode);
+        }
+    }
+    else if (mode == CALC_SUM_NAIVE)
+    {
+        for (; end - i >= LANES; i += LANES)
+        {
+            vec_t x = x0 + ((double) i + lane) * dx;
+            vec_t y;
+            my_fun_vec(&y, &x);
+            acc += y;
+        }
+    }
+    else
+    {
+        // Kahan per lane, terms are positive and of similar size
+        for (; end - i >= LANES; i += LANES)
+        {
+            vec_t x = x0 + ((double) i + lane) * dx;
+            vec_t y;
+            my_fun_vec(&y, &x);
+            y -= comp;
+            vec_t t = acc + y;
+            comp = (t - acc) - y;
+            acc = t;
+        }
+    }
+
+    ksum_t result = {0};
+    for (int l = 0; l < LANES; ++l)
+    {
+        ksum_add(&result, acc[l], mode);
+        ksum_add(&result, -comp[l], mode);
+    }
+
+    // remainder
+    for (; i < end; ++i)
+    {
+        double x = x0 + i * dx;
+        double y;
+        fun_eval(fun, &x, &y, 1);
+        ksum_add(&result, y, mode);
+    }
+
+    return ksum_get(&result) * dx;
+}
+
+/**
+ * Adaptive Simpson's rule on [a, b] with known
+ * values at ends and in the middle.
+ */
+static double simpson(const expr_t *fun, double a, double b, double eps, double whole,
+                      double fa, double fm, double fb, int depth, calc_part_t *part)
+{
+    double m = (a + b) / 2;
+    double xs[2] = {(a + m) / 2, (m + b) / 2};
+    double ys[2];
+    fun_eval(fun, xs, ys, 2);
+    double flm = ys[0];
+    double frm = ys[1];
+    part->evals += 2;
+
+    double left = (m - a) / 6 * (fa + 4 * flm + fm);
+    double right = (b - m) / 6 * (fm + 4 * frm + fb);
+    double delta = left + right - whole;
+
+    if (!depth || fabs(delta) <= 15 * eps)
+    {
+        part->err += fabs(delta) / 15;
+        return left + right + delta / 15;
+    }
+
+    return simpson(fun, a, m, eps / 2, left, fa, flm, fm, depth - 1, part)
+         + simpson(fun, m, b, eps / 2, right, fm, frm, fb, depth - 1, part);
+}
+
+static double simpson_start(const expr_t *fun, double a, double b, double eps, calc_part_t *part)
+{
+    double xs[3] = {a, (a + b) / 2, b};
+    double ys[3];
+    fun_eval(fun, xs, ys, 3);
+    part->evals += 3;
+    double whole = (b - a) / 6 * (ys[0] + 4 * ys[1] + ys[2]);
+    return simpson(fun, a, b, eps, whole, ys[0], ys[1], ys[2], MAX_DEPTH, part);
+}
+
+/**
+ * Adaptive Gauss-Kronrod on [a, b].
+ * Difference of 7 and 15 point rules is the error estimate.
+ */
+static double gauss_kronrod(const expr_t *fun, double a, double b, double eps,
+                           int depth, calc_part_t *part)
+{
+    double c = (a + b) / 2;
+    double h = (b - a) / 2;
+
+    // all 15 nodes in one call
+    double xs[15];
+    double ys[15];
+    for (int j = 0; j < 7; ++j)
+    {
+        xs[2 * j] = c - h * GK_X[j];
+        xs[2 * j + 1] = c + h * GK_X[j];
+    }
+    xs[14] = c;
+    fun_eval(fun, xs, ys, 15);
+
+    double res_k = ys[14] * GK_WK[7];
+    double res_g = ys[14] * GK_WG[3];
+    for (int j = 0; j < 7; ++j)
+    {
+        double f = ys[2 * j] + ys[2 * j + 1];
+        res_k += GK_WK[j] * f;
+        if (j % 2) res_g += GK_WG[j / 2] * f;
+    }
+    part->evals += 15;
+
+    double err = fabs(res_k - res_g) * h;
+    if (!depth || err <= eps)
+    {
+        part->err += err;
+        return res_k * h;
+    }
+
+    return gauss_kronrod(fun, a, c, eps / 2, depth - 1, part)
+         + gauss_kronrod(fun, c, b, eps / 2, depth - 1, part);
+}
+
+/**
+ * Compute part of the integral assigned to worker wid.
+ */
+static void work(const calc_job_t *job, int wid, calc_part_t *part)
 {
-    double result = 0.;
-    for (int i = wid; i < n_cells; i += n_proc)
+    const calc_config_t *cfg = job->cfg;
+    part->sum = 0.;
+    part->err = 0.;
+    part->evals = 0;
+    part->t_start = now();
+
+    if (cfg->method == CALC_MIDPOINT)
+    {
+        // first rem workers get one cell more
+        long long per_worker = job->n_cells / cfg->n_workers;
+        long long rem = job->n_cells % cfg->n_workers;
+        long long begin = per_worker * wid + (wid < rem ? wid : rem);
+        long long end = begin + per_worker + (wid < rem);
+        part->sum = integrate(cfg->fun, begin, end, job->n_cells, cfg->sum);
+        part->evals = end - begin;
+        part->t_end = now();
+        return;
+    }
+
+    ksum_t sum = {0};
+
+    double width = (X_TO - X_FROM) / job->n_chunks;
+    // tolerance split proportionally to length
+    double eps = cfg->tol / job->n_chunks;
+
+    for (;;)
     {
-        double dx = (X_TO - X_FROM) / n_cells;
-        double x = dx / 2 + X_FROM + (X_TO - X_FROM) * ((double) i / n_cells);
-        result += my_fun(x) * dx;
+        int chunk = __atomic_fetch_add(&job->shared->next_chunk, 1, __ATOMIC_RELAXED);
+        if (chunk >= job->n_chunks) break;
+
+        double a = X_FROM + chunk * width;
+        double b = chunk + 1 == job->n_chunks ? X_TO : a + width;
+
+        double val;
+        if (cfg->method == CALC_SIMPSON) val = simpson_start(cfg->fun, a, b, eps, part);
+        else val = gauss_kronrod(cfg->fun, a, b, eps, MAX_DEPTH, part);
+        ksum_add(&sum, val, cfg->sum);
     }
 
+    part->sum = ksum_get(&sum);
+    part->t_end = now();
+}
+
+/**
+ * Worker saving its result to file.
+ */
+static void worker_task_file(const calc_job_t *job, int wid)
+{
+    calc_part_t part;
+    work(job, wid, &part);
+
     char fname[FNAME_LEN];
     sprintf(fname, "w%d.txt", wid);
 
     FILE *f = fopen(fname, "w");
     if (!f) exit(-1);
 
-    int err = fwrite(&result, sizeof result, 1, f) == 1 ? 0 : -1;
+    int err = fwrite(&part, sizeof part, 1, f) == 1 ? 0 : -1;
     fclose(f);
 
     exit(err);
 }
 
-static int compute(int n_proc, int n_cells)
+/**
+ * Worker saving its result to slot in shared memory.
+ */
+static void worker_task_shm(const calc_job_t *job, int wid)
+{
+    work(job, wid, &job->shared->parts[wid]);
+    exit(0);
+}
+
+static int compute_fork(const calc_job_t *job)
 {
     int err = 0;
+    int n_proc = job->cfg->n_workers;
+
+    // children must not repeat buffered output
+    fflush(stdout);
 
     for (int wid = 0; wid < n_proc; ++wid)
     {
@@ -49,7 +419,11 @@ static int compute(int n_proc, int n_cells)
             err = -1;
             break;
         }
-        if (!pid) worker_task(wid, n_proc, n_cells);
+        if (!pid)
+        {
+            if (job->cfg->mode == CALC_FILE) worker_task_file(job, wid);
+            else worker_task_shm(job, wid);
+        }
     }
 
     int num_completed = 0;
@@ -72,11 +446,53 @@ static int compute(int n_proc, int n_cells)
     return err;
 }
 
-static int reduce(double *out, int n_proc)
+typedef struct thread_arg_t
+{
+    pthread_t thread;
+    const calc_job_t *job;
+    int wid;
+} thread_arg_t;
+
+static void* thread_task(void *arg)
+{
+    thread_arg_t *t = arg;
+    work(t->job, t->wid, &t->job->shared->parts[t->wid]);
+    return NULL;
+}
+
+static int compute_thread(const calc_job_t *job)
+{
+    int n_threads = job->cfg->n_workers;
+    thread_arg_t *threads = calloc(n_threads, sizeof *threads);
+    if (!threads) return -1;
+
+    int err = 0;
+    int n_started = 0;
+    for (; n_started < n_threads; ++n_started)
+    {
+        thread_arg_t *t = &threads[n_started];
+        t->job = job;
+        t->wid = n_started;
+        if (pthread_create(&t->thread, NULL, thread_task, t))
+        {
+            err = -1;
+            break;
+        }
+    }
+
+    for (int i = 0; i < n_started; ++i)
+        pthread_join(threads[i].thread, NULL);
+
+    free(threads);
+    return err;
+}
+
+static int reduce_file(calc_part_t *out, int n_proc, calc_sum_t mode)
 {
-    double val;
+    calc_part_t val;
     char fname[FNAME_LEN];
-    *out = 0;
+    ksum_t sum = {0};
+    *out = (calc_part_t) {0};
 
     for (int wid = 0; wid < n_proc; ++wid)
     {
@@ -89,34 +505,127 @@ static int reduce(double *out, int n_proc)
         fclose(f);
         if (err) return -1;
 
-        *out += val;
+        ksum_add(&sum, val.sum, mode);
+        out->err += val.err;
+        out->evals += val.evals;
+        if (val.t_start > out->t_start) out->t_start = val.t_start;
+        if (val.t_end > out->t_end) out->t_end = val.t_end;
     }
+    out->sum = ksum_get(&sum);
     return 0;
 }
 
-int run_calculator(double dx, int n_proc)
+static void reduce_mem(calc_part_t *out, const calc_part_t *parts, int n_workers, calc_sum_t mode)
+{
+    ksum_t sum = {0};
+    *out = (calc_part_t) {0};
+    for (int wid = 0; wid < n_workers; ++wid)
+    {
+        ksum_add(&sum, parts[wid].sum, mode);
+        out->err += parts[wid].err;
+        out->evals += parts[wid].evals;
+        if (parts[wid].t_start > out->t_start) out->t_start = parts[wid].t_start;
+        if (parts[wid].t_end > out->t_end) out->t_end = parts[wid].t_end;
+    }
+    out->sum = ksum_get(&sum);
+}
+
+int calc_integrate(const calc_config_t *cfg, calc_result_t *res)
 {
+    if (!cfg || !res || cfg->n_workers <= 0) return -1;
+    if (cfg->method == CALC_MIDPOINT && cfg->dx <= 0) return -1;
+    if (cfg->method != CALC_MIDPOINT && cfg->tol <= 0) return -1;
+
     int err = 0;
+    int n_workers = cfg->n_workers;
+    int use_files = cfg->backend == CALC_FORK && cfg->mode == CALC_FILE;
+    size_t shared_size = sizeof(calc_shared_t) + n_workers * sizeof(calc_part_t);
+
+    calc_job_t job = {
+        .cfg = cfg,
+        .n_chunks = n_workers * CHUNKS_PER_WORKER,
+    };
 
     do
     {
-        int n_cells = (int) ((X_TO - X_FROM) / dx);
-        err = compute(n_proc, n_cells);
+        // visible to children after fork
+        job.shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (job.shared == MAP_FAILED)
+        {
+            job.shared = NULL;
+            err = -1;
+            break;
+        }
+
+        if (cfg->method == CALC_MIDPOINT)
+        {
+            double n_cells = (X_TO - X_FROM) / cfg->dx;
+            // must fit in long long
+            if (n_cells >= 9e18)
+            {
+                err = -1;
+                break;
+            }
+            job.n_cells = (long long) n_cells;
+        }
+
+        double t0 = now();
+
+        if (cfg->backend == CALC_THREAD) err = compute_thread(&job);
+        else err = compute_fork(&job);
         if (err) break;
 
-        double result;
-        err = reduce(&result, n_proc);
+        calc_part_t result;
+        if (use_files) err = reduce_file(&result, n_workers, cfg->sum);
+        else reduce_mem(&result, job.shared->parts, n_workers, cfg->sum);
         if (err) break;
 
-        printf("Result = %lf\n", result);
+        double t1 = now();
+
+        res->sum = result.sum;
+        res->err = result.err;
+        res->evals = result.evals;
+        res->t_total = t1 - t0;
+        res->t_spawn = result.t_start - t0;
+        res->t_reduce = t1 - result.t_end;
+        res->t_compute = res->t_total - res->t_spawn - res->t_reduce;
     } while (0);
 
-    for (int wid = 0; wid < n_proc; ++wid)
+    if (job.shared)
     {
-        char fname[FNAME_LEN];
-        sprintf(fname, "w%d.txt", wid);
-        unlink(fname);
+        munmap(job.shared, shared_size);
+    }
+    if (use_files)
+    {
+        for (int wid = 0; wid < n_workers; ++wid)
+        {
+            char fname[FNAME_LEN];
+            sprintf(fname, "w%d.txt", wid);
+            unlink(fname);
+        }
     }
 
     return err;
 }
+
+int run_calculator(const calc_config_t *cfg)
+{
+    calc_result_t result;
+    int err = calc_integrate(cfg, &result);
+    if (err) return err;
+
+    if (cfg->method == CALC_MIDPOINT && !cfg->verbose)
+    {
+        printf("Result = %lf\n", result.sum);
+    }
+    else
+    {
+        printf("Result = %.15lf\n", result.sum);
+        printf("Evaluations = %lld\n", result.evals);
+        if (cfg->method != CALC_MIDPOINT)
+            printf("Error estimate = %e\n", result.err);
+    }
+
+    return 0;
+}
@@ -0,0 +1,520 @@
+#include "expr.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+
+typedef enum expr_op_t
+{
+    OP_X,
+    OP_CONST,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_POW,
+    // top op constant
+    OP_ADDC,
+    OP_SUBC,
+    OP_MULC,
+    OP_DIVC,
+    OP_POWC,
+    // constant op top
+    OP_RSUBC,
+    OP_RDIVC,
+    OP_NEG,
+    OP_SQR,
+    OP_SIN,
+    OP_COS,
+    OP_TAN,
+    OP_ASIN,
+    OP_ACOS,
+    OP_ATAN,
+    OP_SINH,
+    OP_COSH,
+    OP_TANH,
+    OP_EXP,
+    OP_LOG,
+    OP_SQRT,
+    OP_ABS,
+} expr_op_t;
+
+typedef struct func_t
+{
+    const char *name;
+    expr_op_t op;
+    int n_args;
+} func_t;
+
+static const func_t FUNCS[] = {
+        {"sin", OP_SIN, 1},
+        {"cos", OP_COS, 1},
+        {"tan", OP_TAN, 1},
+        {"asin", OP_ASIN, 1},
+        {"acos", OP_ACOS, 1},
+        {"atan", OP_ATAN, 1},
+        {"sinh", OP_SINH, 1},
+        {"cosh", OP_COSH, 1},
+        {"tanh", OP_TANH, 1},
+        {"exp", OP_EXP, 1},
+        {"log", OP_LOG, 1},
+        {"sqrt", OP_SQRT, 1},
+        {"abs", OP_ABS, 1},
+        {"pow", OP_POW, 2},
+};
+
+typedef struct parser_t
+{
+    const char *src;
+    const char *p;
+    expr_t *expr;
+    int depth;
+    int err;
+} parser_t;
+
+static double apply_unary(expr_op_t op, double a)
+{
+    switch (op)
+    {
+        case OP_NEG: return -a;
+        case OP_SQR: return a * a;
+        case OP_SIN: return sin(a);
+        case OP_COS: return cos(a);
+        case OP_TAN: return tan(a);
+        case OP_ASIN: return asin(a);
+        case OP_ACOS: return acos(a);
+        case OP_ATAN: return atan(a);
+        case OP_SINH: return sinh(a);
+        case OP_COSH: return cosh(a);
+        case OP_TANH: return tanh(a);
+        case OP_EXP: return exp(a);
+        case OP_LOG: return log(a);
+        case OP_SQRT: return sqrt(a);
+        case OP_ABS: return fabs(a);
+        default: return NAN;
+    }
+}
+
+static double apply_binary(expr_op_t op, double a, double b)
+{
+    switch (op)
+    {
+        case OP_ADD: return a + b;
+        case OP_SUB: return a - b;
+        case OP_MUL: return a * b;
+        case OP_DIV: return a / b;
+        case OP_POW: return pow(a, b);
+        default: return NAN;
+    }
+}
+
+static void emit(parser_t *ps, expr_op_t op, int arg)
+{
+    expr_t *e = ps->expr;
+    if (e->n_code == EXPR_MAX_CODE)
+    {
+        ps->err = 1;
+        return;
+    }
+    e->code[e->n_code].op = op;
+    e->code[e->n_code].arg = arg;
+    e->n_code++;
+
+    if (op == OP_X || op == OP_CONST)
+    {
+        ps->depth++;
+        if (ps->depth > e->max_stack) e->max_stack = ps->depth;
+        if (ps->depth > EXPR_MAX_STACK) ps->err = 1;
+    }
+    else if (op >= OP_ADD && op <= OP_POW)
+    {
+        ps->depth--;
+    }
+}
+
+static void emit_const(parser_t *ps, double val)
+{
+    expr_t *e = ps->expr;
+
+    // reuse equal constant
+    int idx = 0;
+    while (idx < e->n_consts && memcmp(&e->consts[idx], &val, sizeof val)) idx++;
+    if (idx == e->n_consts)
+    {
+        if (e->n_consts == EXPR_MAX_CONSTS)
+        {
+            ps->err = 1;
+            return;
+        }
+        e->consts[e->n_consts++] = val;
+    }
+
+    emit(ps, OP_CONST, idx);
+}
+
+/**
+ * Value of instruction i if it pushes a constant.
+ */
+static int const_at(const expr_t *e, int i, double *val)
+{
+    if (i < 0 || i >= e->n_code || e->code[i].op != OP_CONST) return 0;
+    *val = e->consts[e->code[i].arg];
+    return 1;
+}
+
+static void emit_unary(parser_t *ps, expr_op_t op)
+{
+    expr_t *e = ps->expr;
+    double a;
+
+    // fold constant
+    if (const_at(e, e->n_code - 1, &a))
+    {
+        e->n_code--;
+        ps->depth--;
+        emit_const(ps, apply_unary(op, a));
+        return;
+    }
+
+    emit(ps, op, 0);
+}
+
+/**
+ * Emit binary operator.
+ * Operands start at instructions left and right,
+ * constants are folded or turned into constant variants.
+ */
+static void emit_binary(parser_t *ps, expr_op_t op, int left, int right)
+{
+    expr_t *e = ps->expr;
+    double a, b;
+    // operand ending with a constant push is that constant
+    int left_const = right == left + 1 && const_at(e, left, &a);
+    int right_const = const_at(e, e->n_code - 1, &b);
+
+    if (left_const && right_const)
+    {
+        e->n_code -= 2;
+        ps->depth -= 2;
+        emit_const(ps, apply_binary(op, a, b));
+        return;
+    }
+
+    if (right_const)
+    {
+        int arg = e->code[e->n_code - 1].arg;
+        e->n_code--;
+        ps->depth--;
+        switch (op)
+        {
+            case OP_ADD: emit(ps, OP_ADDC, arg); return;
+            case OP_SUB: emit(ps, OP_SUBC, arg); return;
+            case OP_MUL: emit(ps, OP_MULC, arg); return;
+            case OP_DIV: emit(ps, OP_DIVC, arg); return;
+            case OP_POW:
+                if (b == 2.) emit(ps, OP_SQR, 0);
+                else emit(ps, OP_POWC, arg);
+                return;
+            default: break;
+        }
+        // keep the constant
+        e->n_code++;
+        ps->depth++;
+    }
+
+    if (left_const && op != OP_POW)
+    {
+        // drop constant from before the right operand
+        int arg = e->code[left].arg;
+        memmove(&e->code[left], &e->code[left + 1], (e->n_code - left - 1) * sizeof *e->code);
+        e->n_code--;
+        ps->depth--;
+        switch (op)
+        {
+            case OP_ADD: emit(ps, OP_ADDC, arg); break;
+            case OP_SUB: emit(ps, OP_RSUBC, arg); break;
+            case OP_MUL: emit(ps, OP_MULC, arg); break;
+            case OP_DIV: emit(ps, OP_RDIVC, arg); break;
+            default: ps->err = 1; break;
+        }
+        return;
+    }
+
+    emit(ps, op, 0);
+}
+
+static void skip_space(parser_t *ps)
+{
+    while (isspace((unsigned char) *ps->p)) ps->p++;
+}
+
+static int accept(parser_t *ps, char c)
+{
+    skip_space(ps);
+    if (*ps->p != c) return 0;
+    ps->p++;
+    return 1;
+}
+
+static void parse_expr(parser_t *ps);
+static void parse_unary(parser_t *ps);
+
+static void parse_primary(parser_t *ps)
+{
+    skip_space(ps);
+    const char *p = ps->p;
+
+    if (isdigit((unsigned char) *p) || *p == '.')
+    {
+        char *end;
+        double val = strtod(p, &end);
+        if (end == p)
+        {
+            ps->err = 1;
+            return;
+        }
+        ps->p = end;
+        emit_const(ps, val);
+        return;
+    }
+
+    if (isalpha((unsigned char) *p))
+    {
+        size_t len = 0;
+        while (isalnum((unsigned char) p[len])) len++;
+        ps->p += len;
+
+        if (len == 1 && *p == 'x')
+        {
+            emit(ps, OP_X, 0);
+            return;
+        }
+        if (len == 2 && !strncmp("pi", p, 2))
+        {
+            emit_const(ps, M_PI);
+            return;
+        }
+        if (len == 1 && *p == 'e')
+        {
+            emit_const(ps, M_E);
+            return;
+        }
+
+        for (size_t i = 0; i < sizeof FUNCS / sizeof *FUNCS; ++i)
+        {
+            const func_t *f = &FUNCS[i];
+            if (strlen(f->name) != len || strncmp(f->name, p, len)) continue;
+
+            if (!accept(ps, '('))
+            {
+                ps->err = 1;
+                return;
+            }
+            int left = ps->expr->n_code;
+            int right = left;
+            parse_expr(ps);
+            if (f->n_args == 2)
+            {
+                if (ps->err || !accept(ps, ','))
+                {
+                    ps->err = 1;
+                    return;
+                }
+                right = ps->expr->n_code;
+                parse_expr(ps);
+            }
+            if (ps->err || !accept(ps, ')'))
+            {
+                ps->err = 1;
+                return;
+            }
+
+            if (f->n_args == 2) emit_binary(ps, f->op, left, right);
+            else emit_unary(ps, f->op);
+            return;
+        }
+
+        // unknown name
+        ps->p = p;
+        ps->err = 1;
+        return;
+    }
+
+    if (accept(ps, '('))
+    {
+        parse_expr(ps);
+        if (!ps->err && !accept(ps, ')')) ps->err = 1;
+        return;
+    }
+
+    ps->err = 1;
+}
+
+static void parse_power(parser_t *ps)
+{
+    int left = ps->expr->n_code;
+    parse_primary(ps);
+    if (ps->err) return;
+
+    // right associative
+    if (accept(ps, '^'))
+    {
+        int right = ps->expr->n_code;
+        parse_unary(ps);
+        if (!ps->err) emit_binary(ps, OP_POW, left, right);
+    }
+}
+
+static void parse_unary(parser_t *ps)
+{
+    if (accept(ps, '-'))
+    {
+        parse_unary(ps);
+        if (!ps->err) emit_unary(ps, OP_NEG);
+        return;
+    }
+    if (accept(ps, '+'))
+    {
+        parse_unary(ps);
+        return;
+    }
+    parse_power(ps);
+}
+
+static void parse_term(parser_t *ps)
+{
+    int left = ps->expr->n_code;
+    parse_unary(ps);
+
+    while (!ps->err)
+    {
+        expr_op_t op;
+        if (accept(ps, '*')) op = OP_MUL;
+        else if (accept(ps, '/')) op = OP_DIV;
+        else break;
+
+        int right = ps->expr->n_code;
+        parse_unary(ps);
+        if (!ps->err) emit_binary(ps, op, left, right);
+    }
+}
+
+static void parse_expr(parser_t *ps)
+{
+    int left = ps->expr->n_code;
+    parse_term(ps);
+
+    while (!ps->err)
+    {
+        expr_op_t op;
+        if (accept(ps, '+')) op = OP_ADD;
+        else if (accept(ps, '-')) op = OP_SUB;
+        else break;
+
+        int right = ps->expr->n_code;
+        parse_term(ps);
+        if (!ps->err) emit_binary(ps, op, left, right);
+    }
+}
+
+int expr_compile(expr_t *expr, const char *src, int *err_pos)
+{
+    if (!expr || !src) return -1;
+
+    memset(expr, 0, sizeof *expr);
+    parser_t ps = {
+        .src = src,
+        .p = src,
+        .expr = expr,
+    };
+
+    parse_expr(&ps);
+    skip_space(&ps);
+    if (*ps.p) ps.err = 1;
+
+    if (ps.err)
+    {
+        if (err_pos) *err_pos = (int) (ps.p - src);
+        return -1;
+    }
+    return 0;
+}
+
+#define FOR_BATCH(stmt) for (int k = 0; k < EXPR_BATCH; ++k) { stmt; }
+
+/**
+ * Evaluate one full batch.
+ * Fixed length loops are vectorized by the compiler.
+ */
+static void eval_batch(const expr_t *e, const double *x, double *y)
+{
+    double stack[EXPR_MAX_STACK][EXPR_BATCH];
+    int sp = 0;
+
+    for (int i = 0; i < e->n_code; ++i)
+    {
+        expr_instr_t in = e->code[i];
+        double c = e->consts[in.arg];
+        // top of the stack and the slot above it
+        double *a = sp ? stack[sp - 1] : NULL;
+        double *b = stack[sp];
+
+        switch ((expr_op_t) in.op)
+        {
+            case OP_X: memcpy(b, x, sizeof stack[0]); sp++; break;
+            case OP_CONST: FOR_BATCH(b[k] = c) sp++; break;
+
+            case OP_ADD: sp--; a = stack[sp - 1]; b = stack[sp]; FOR_BATCH(a[k] += b[k]) break;
+            case OP_SUB: sp--; a = stack[sp - 1]; b = stack[sp]; FOR_BATCH(a[k] -= b[k]) break;
+            case OP_MUL: sp--; a = stack[sp - 1]; b = stack[sp]; FOR_BATCH(a[k] *= b[k]) break;
+            case OP_DIV: sp--; a = stack[sp - 1]; b = stack[sp]; FOR_BATCH(a[k] /= b[k]) break;
+            case OP_POW: sp--; a = stack[sp - 1]; b = stack[sp]; FOR_BATCH(a[k] = pow(a[k], b[k])) break;
+
+            case OP_ADDC: FOR_BATCH(a[k] += c) break;
+            case OP_SUBC: FOR_BATCH(a[k] -= c) break;
+            case OP_MULC: FOR_BATCH(a[k] *= c) break;
+            case OP_DIVC: FOR_BATCH(a[k] /= c) break;
+            case OP_POWC: FOR_BATCH(a[k] = pow(a[k], c)) break;
+            case OP_RSUBC: FOR_BATCH(a[k] = c - a[k]) break;
+            case OP_RDIVC: FOR_BATCH(a[k] = c / a[k]) break;
+
+            case OP_NEG: FOR_BATCH(a[k] = -a[k]) break;
+            case OP_SQR: FOR_BATCH(a[k] *= a[k]) break;
+            case OP_SIN: FOR_BATCH(a[k] = sin(a[k])) break;
+            case OP_COS: FOR_BATCH(a[k] = cos(a[k])) break;
+            case OP_TAN: FOR_BATCH(a[k] = tan(a[k])) break;
+            case OP_ASIN: FOR_BATCH(a[k] = asin(a[k])) break;
+            case OP_ACOS: FOR_BATCH(a[k] = acos(a[k])) break;
+            case OP_ATAN: FOR_BATCH(a[k] = atan(a[k])) break;
+            case OP_SINH: FOR_BATCH(a[k] = sinh(a[k])) break;
+            case OP_COSH: FOR_BATCH(a[k] = cosh(a[k])) break;
+            case OP_TANH: FOR_BATCH(a[k] = tanh(a[k])) break;
+            case OP_EXP: FOR_BATCH(a[k] = exp(a[k])) break;
+            case OP_LOG: FOR_BATCH(a[k] = log(a[k])) break;
+            case OP_SQRT: FOR_BATCH(a[k] = sqrt(a[k])) break;
+            case OP_ABS: FOR_BATCH(a[k] = fabs(a[k])) break;
+        }
+    }
+
+    memcpy(y, stack[0], sizeof stack[0]);
+}
+
+void expr_eval(const expr_t *expr, const double *x, double *y, int n)
+{
+    int i = 0;
+    for (; n - i >= EXPR_BATCH; i += EXPR_BATCH)
+        eval_batch(expr, x + i, y + i);
+
+    if (i < n)
+    {
+        // pad last batch with its last value
+        double xb[EXPR_BATCH];
+        double yb[EXPR_BATCH];
+        int m = n - i;
+        memcpy(xb, x + i, m * sizeof *xb);
+        for (int k = m; k < EXPR_BATCH; ++k) xb[k] = x[n - 1];
+        eval_batch(expr, xb, yb);
+        memcpy(y + i, yb, m * sizeof *yb);
+    }
+}
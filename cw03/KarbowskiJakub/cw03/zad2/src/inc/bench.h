@@ -0,0 +1,36 @@
+#ifndef JK_03_02_BENCH_H
+#define JK_03_02_BENCH_H
+
+#include "calculator.h"
+
+/**
+ * Measure scaling of midpoint integration and print CSV.
+ * Strong scaling runs rectangle widths dx, 10dx and 100dx
+ * on 1, 2, 4, ... max_workers workers.
+ * Weak scaling keeps rectangles per worker constant,
+ * max_workers workers get width dx.
+ * Every phase is a median over reps runs,
+ * efficiency is computed from median totals.
+ *
+ * @param cfg Backend, mode, summation and integrand, dx is the base width.
+ * @param max_workers Largest number of workers.
+ * @param reps Runs of every point.
+ * @return 0 or negative error.
+ */
+int run_bench(const calc_config_t *cfg, int max_workers, int reps);
+
+/**
+ * Compare accuracy and speed of kahan and naive summation, print CSV.
+ * Midpoint integration runs rectangle widths dx, dx/10, dx/100
+ * and dx/1000 with both summations. Error is measured against pi
+ * for the built-in integrand and adaptive Gauss-Kronrod otherwise.
+ * Time is a median over reps runs.
+ *
+ * @param cfg Backend, mode and integrand, dx is the largest width.
+ * @param n_workers Number of workers.
+ * @param reps Runs of every point.
+ * @return 0 or negative error.
+ */
+int run_bench_sum(const calc_config_t *cfg, int n_workers, int reps);
+
+#endif
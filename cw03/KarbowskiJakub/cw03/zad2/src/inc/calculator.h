@@ -1,6 +1,106 @@
 #ifndef JK_03_02_CALCULATOR_H
 #define JK_03_02_CALCULATOR_H
 
-int run_calculator(double dx, int n_proc);
+#include "expr.h"
+
+/**
+ * How partial results are computed.
+ */
+typedef enum calc_backend_t
+{
+    // worker processes
+    CALC_FORK,
+    // worker threads
+    CALC_THREAD,
+} calc_backend_t;
+
+/**
+ * How worker processes pass partial results to the parent.
+ */
+typedef enum calc_mode_t
+{
+    // shared anonymous mapping
+    CALC_SHM,
+    // one file per worker
+    CALC_FILE,
+} calc_mode_t;
+
+/**
+ * Integration method.
+ */
+typedef enum calc_method_t
+{
+    // fixed midpoint rectangles of width dx
+    CALC_MIDPOINT,
+    // adaptive Simpson's rule
+    CALC_SIMPSON,
+    // adaptive Gauss-Kronrod 7-15
+    CALC_GK,
+} calc_method_t;
+
+/**
+ * How partial sums are accumulated.
+ */
+typedef enum calc_sum_t
+{
+    // compensated: Kahan in kernel, Neumaier elsewhere
+    CALC_SUM_KAHAN,
+    // plain floating point additions
+    CALC_SUM_NAIVE,
+} calc_sum_t;
+
+typedef struct calc_config_t
+{
+    // integrand, NULL for built-in 4/(x^2+1)
+    const expr_t *fun;
+    calc_method_t method;
+    // rectangle width, used by CALC_MIDPOINT
+    double dx;
+    // absolute error tolerance, used by adaptive methods
+    double tol;
+    int n_workers;
+    calc_backend_t backend;
+    // used by CALC_FORK
+    calc_mode_t mode;
+    calc_sum_t sum;
+    // print result with all digits and evaluations
+    int verbose;
+} calc_config_t;
+
+typedef struct calc_result_t
+{
+    double sum;
+    // estimated absolute error, adaptive methods only
+    double err;
+    long long evals;
+
+    // phases in seconds, they add up to t_total
+    // until the last worker started computing
+    double t_spawn;
+    // until the last worker finished
+    double t_compute;
+    // collecting and summing partial results
+    double t_reduce;
+    double t_total;
+} calc_result_t;
+
+/**
+ * Integrate function.
+ * Midpoint workers get contiguous ranges of rectangles,
+ * adaptive workers take subintervals from a shared counter.
+ *
+ * @param cfg Calculation parameters.
+ * @param res Output result.
+ * @return 0 or negative error.
+ */
+int calc_integrate(const calc_config_t *cfg, calc_result_t *res);
+
+/**
+ * Integrate function and print the result.
+ *
+ * @param cfg Calculation parameters.
+ * @return 0 or negative error.
+ */
+int run_calculator(const calc_config_t *cfg);
 
 #endif
@@ -0,0 +1,54 @@
+#ifndef JK_03_02_EXPR_H
+#define JK_03_02_EXPR_H
+
+#define EXPR_MAX_CODE (256)
+#define EXPR_MAX_CONSTS (64)
+#define EXPR_MAX_STACK (16)
+// values evaluated by one pass over the code
+#define EXPR_BATCH (128)
+
+typedef struct expr_instr_t
+{
+    unsigned char op;
+    // constant index
+    unsigned char arg;
+} expr_instr_t;
+
+/**
+ * Compiled function of x.
+ * Code runs on a stack of EXPR_BATCH wide vectors.
+ */
+typedef struct expr_t
+{
+    expr_instr_t code[EXPR_MAX_CODE];
+    int n_code;
+    double consts[EXPR_MAX_CONSTS];
+    int n_consts;
+    int max_stack;
+} expr_t;
+
+/**
+ * Compile expression of variable x.
+ * Supported are numbers, x, pi, e, + - * / ^ (power),
+ * parentheses and functions sin, cos, tan, asin, acos, atan,
+ * sinh, cosh, tanh, exp, log, sqrt, abs and pow(a, b).
+ *
+ * @param expr Output expression.
+ * @param src Source text.
+ * @param err_pos Output, position of error in src, may be NULL.
+ * @return 0 or negative error.
+ */
+int expr_compile(expr_t *expr, const char *src, int *err_pos);
+
+/**
+ * Evaluate expression for n values.
+ * Safe to call from many threads at once.
+ *
+ * @param expr Compiled expression.
+ * @param x Input values.
+ * @param y Output values.
+ * @param n Number of values.
+ */
+void expr_eval(const expr_t *expr, const double *x, double *y, int n);
+
+#endif
@@ -1,37 +1,165 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <string.h>
+#include <unistd.h>
 #include "calculator.h"
+#include "bench.h"
 
 static const char HELP[] =
         "SO Lab3 Zad2 - Jakub Karbowski\n"
         "Usage:\n"
-        "%s DX N - calculate with rectangle "
-        "width DX using N processes\n";
+        "%s [-b BACKEND] [-m MODE] [-s SUM] [-f EXPR] [-v] DX N - calculate with rectangle "
+        "width DX using N workers\n"
+        "%s -q METHOD [-b BACKEND] [-m MODE] [-s SUM] [-f EXPR] TOL N - calculate with "
+        "adaptive METHOD to absolute error TOL\n"
+        "BACKEND - fork (default) or thread\n"
+        "MODE - how fork workers return results: shm (default) or file\n"
+        "METHOD - midpoint (default), simpson or gk (Gauss-Kronrod 7-15)\n"
+        "SUM - summation: kahan (compensated, default) or naive\n"
+        "-f EXPR - integrand of x on [0, 1], e.g. 'sin(x)^2 + exp(-x)',\n"
+        "          default is the built-in 4/(x^2+1)\n"
+        "-v - print result with all digits and number of evaluations\n"
+        "%s -B [-r REPS] [-b BACKEND] [-m MODE] [-s SUM] [-f EXPR] DX N - "
+        "print CSV of strong and weak scaling for up to N workers, "
+        "median of REPS (default 5) runs\n"
+        "%s -B -a [-r REPS] [-b BACKEND] [-m MODE] [-f EXPR] DX N - "
+        "print CSV of kahan and naive summation error and speed "
+        "on N workers for widths DX, DX/10, DX/100 and DX/1000\n";
 
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    static expr_t fun;
+    int bench = 0;
+    int bench_sum = 0;
+    long reps = 5;
+    char *endptr;
+    calc_config_t cfg = {
+        .backend = CALC_FORK,
+        .mode = CALC_SHM,
+        .method = CALC_MIDPOINT,
+        .sum = CALC_SUM_KAHAN,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:m:q:s:f:vBar:")) != -1)
     {
-        fprintf(stderr, HELP, argv[0]);
+        switch (opt)
+        {
+            case 'b':
+                if (!strcmp("fork", optarg)) cfg.backend = CALC_FORK;
+                else if (!strcmp("thread", optarg)) cfg.backend = CALC_THREAD;
+                else
+                {
+                    fprintf(stderr, "Invalid BACKEND: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'm':
+                if (!strcmp("shm", optarg)) cfg.mode = CALC_SHM;
+                else if (!strcmp("file", optarg)) cfg.mode = CALC_FILE;
+                else
+                {
+                    fprintf(stderr, "Invalid MODE: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'q':
+                if (!strcmp("midpoint", optarg)) cfg.method = CALC_MIDPOINT;
+                else if (!strcmp("simpson", optarg)) cfg.method = CALC_SIMPSON;
+                else if (!strcmp("gk", optarg)) cfg.method = CALC_GK;
+                else
+                {
+                    fprintf(stderr, "Invalid METHOD: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 's':
+                if (!strcmp("kahan", optarg)) cfg.sum = CALC_SUM_KAHAN;
+                else if (!strcmp("naive", optarg)) cfg.sum = CALC_SUM_NAIVE;
+                else
+                {
+                    fprintf(stderr, "Invalid SUM: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'f':
+            {
+                int pos;
+                if (expr_compile(&fun, optarg, &pos))
+                {
+                    fprintf(stderr, "Invalid EXPR at %d: %s\n", pos, optarg + pos);
+                    return -1;
+                }
+                cfg.fun = &fun;
+                break;
+            }
+
+            case 'v':
+                cfg.verbose = 1;
+                break;
+
+            case 'B':
+                bench = 1;
+                break;
+
+            case 'a':
+                bench_sum = 1;
+                break;
+
+            case 'r':
+                reps = strtol(optarg, &endptr, 10);
+                if (*endptr || reps <= 0 || reps > INT_MAX)
+                {
+                    fprintf(stderr, "Invalid REPS: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            default:
+                fprintf(stderr, HELP, argv[0], argv[0], argv[0], argv[0]);
+                return -1;
+        }
+    }
+
+    if (argc - optind != 2 || (bench_sum && !bench))
+    {
+        fprintf(stderr, HELP, argv[0], argv[0], argv[0], argv[0]);
         return -1;
     }
 
-    char *endptr;
-    double dx = strtod(argv[1], &endptr);
-    if (*endptr || dx <= 0)
+    if (bench && cfg.method != CALC_MIDPOINT)
+    {
+        fprintf(stderr, "Benchmark supports midpoint method only\n");
+        return -1;
+    }
+
+    // DX or TOL depending on method
+    double val = strtod(argv[optind], &endptr);
+    if (*endptr || val <= 0)
     {
-        fprintf(stderr, "Invalid DX: %s\n", argv[1]);
+        fprintf(stderr, "Invalid %s: %s\n",
+                cfg.method == CALC_MIDPOINT ? "DX" : "TOL", argv[optind]);
         return -1;
     }
-    long n = strtol(argv[2], &endptr, 10);
+    if (cfg.method == CALC_MIDPOINT) cfg.dx = val;
+    else cfg.tol = val;
+    long n = strtol(argv[optind + 1], &endptr, 10);
     if (*endptr || n <= 0 || n > INT_MAX)
     {
-        fprintf(stderr, "Invalid N: %s\n", argv[2]);
+        fprintf(stderr, "Invalid N: %s\n", argv[optind + 1]);
         return -1;
     }
+    cfg.n_workers = (int) n;
 
-    int err = run_calculator(dx, (int) n);
+    int err;
+    if (bench_sum) err = run_bench_sum(&cfg, cfg.n_workers, (int) reps);
+    else if (bench) err = run_bench(&cfg, cfg.n_workers, (int) reps);
+    else err = run_calculator(&cfg);
     if (err) fprintf(stderr, "Error!\n");
 
     return err;
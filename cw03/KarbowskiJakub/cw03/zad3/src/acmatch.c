@@ -0,0 +1,474 @@
+#include "acmatch.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define TRIE_INIT_CAP (64)
+// set in dense table cells of states reporting a match
+#define AC_OUT (1u << 31)
+
+struct ac_matcher_t
+{
+    // input class of every byte, 0 for bytes in no pattern
+    unsigned char cls[256];
+    int n_cls;
+    int dense;
+
+    // first pattern ending exactly in state, -1 if none
+    int *term;
+    // next pattern equal to this one, -1 if none
+    int *pat_next;
+    // nearest state on failure chain with term, -1 if none
+    int *dict;
+    // first state reporting a match when state is entered, -1 if none
+    int *rep;
+
+    // dense, row offset of next state for every state and class
+    unsigned *table;
+
+    // double-array, child of s by class c is base[s] + c if check of it is s
+    int *base;
+    int *check;
+    int *fail;
+};
+
+/**
+ * Trie with child lists used during construction.
+ */
+typedef struct trie_t
+{
+    int *child;
+    int *sibling;
+    int *label;
+    int *fail;
+    int *term;
+    int *dict;
+    int n;
+    int cap;
+} trie_t;
+
+static void trie_free(trie_t *t)
+{
+    free(t->child);
+    free(t->sibling);
+    free(t->label);
+    free(t->fail);
+    free(t->term);
+    free(t->dict);
+}
+
+static int trie_grow(int **arr, int cap)
+{
+    int *p = realloc(*arr, cap * sizeof *p);
+    if (!p) return -1;
+    *arr = p;
+    return 0;
+}
+
+static int trie_node(trie_t *t, int label)
+{
+    if (t->n == t->cap)
+    {
+        int cap = t->cap ? 2 * t->cap : TRIE_INIT_CAP;
+        if (trie_grow(&t->child, cap) || trie_grow(&t->sibling, cap)
+            || trie_grow(&t->label, cap) || trie_grow(&t->fail, cap)
+            || trie_grow(&t->term, cap) || trie_grow(&t->dict, cap))
+            return -1;
+        t->cap = cap;
+    }
+
+    int s = t->n++;
+    t->child[s] = -1;
+    t->sibling[s] = -1;
+    t->label[s] = label;
+    t->fail[s] = 0;
+    t->term[s] = -1;
+    t->dict[s] = -1;
+    return s;
+}
+
+static int trie_goto(const trie_t *t, int s, int label)
+{
+    for (int c = t->child[s]; c >= 0; c = t->sibling[c])
+        if (t->label[c] == label) return c;
+    return -1;
+}
+
+/**
+ * Insert patterns and compute failure and dictionary links.
+ * order receives states in breadth first order.
+ */
+static int trie_build(trie_t *t, ac_matcher_t *ac, const char *const pats[],
+                      const size_t lens[], int n_pats, int **order)
+{
+    if (trie_node(t, 0) < 0) return -1;
+
+    for (int p = 0; p < n_pats; ++p)
+    {
+        int s = 0;
+        for (size_t i = 0; i < lens[p]; ++i)
+        {
+            int label = ac->cls[(unsigned char) pats[p][i]];
+            int next = trie_goto(t, s, label);
+            if (next < 0)
+            {
+                next = trie_node(t, label);
+                if (next < 0) return -1;
+                t->sibling[next] = t->child[s];
+                t->child[s] = next;
+            }
+            s = next;
+        }
+
+        // duplicates are chained in order
+        ac->pat_next[p] = -1;
+        if (t->term[s] < 0) t->term[s] = p;
+        else
+        {
+            int q = t->term[s];
+            while (ac->pat_next[q] >= 0) q = ac->pat_next[q];
+            ac->pat_next[q] = p;
+        }
+    }
+
+    *order = malloc(t->n * sizeof **order);
+    if (!*order) return -1;
+
+    int head = 0, tail = 0;
+    (*order)[tail++] = 0;
+    while (head < tail)
+    {
+        int u = (*order)[head++];
+        for (int v = t->child[u]; v >= 0; v = t->sibling[v])
+        {
+            (*order)[tail++] = v;
+
+            int f = 0;
+            if (u)
+            {
+                // longest proper suffix which is in the trie
+                f = t->fail[u];
+                int g;
+                while ((g = trie_goto(t, f, t->label[v])) < 0 && f)
+                    f = t->fail[f];
+                if (g >= 0) f = g;
+            }
+            t->fail[v] = f;
+            t->dict[v] = t->term[f] >= 0 ? f : t->dict[f];
+        }
+    }
+
+    return 0;
+}
+
+static int build_dense(ac_matcher_t *ac, const trie_t *t, const int *order)
+{
+    size_t n_cls = ac->n_cls;
+    ac->table = malloc((size_t) t->n * n_cls * sizeof *ac->table);
+    if (!ac->table) return -1;
+
+    // rows hold next states first, parents come before children
+    for (int i = 0; i < t->n; ++i)
+    {
+        int s = order[i];
+        unsigned *row = ac->table + s * n_cls;
+        if (s) memcpy(row, ac->table + t->fail[s] * n_cls, n_cls * sizeof *row);
+        else memset(row, 0, n_cls * sizeof *row);
+
+        for (int c = t->child[s]; c >= 0; c = t->sibling[c])
+            row[t->label[c]] = c;
+    }
+
+    for (size_t i = 0; i < (size_t) t->n * n_cls; ++i)
+    {
+        unsigned s = ac->table[i];
+        ac->table[i] = s * n_cls | (ac->rep[s] >= 0 ? AC_OUT : 0);
+    }
+
+    return 0;
+}
+
+static int da_reserve(ac_matcher_t *ac, size_t *cap, size_t need)
+{
+    if (need <= *cap) return 0;
+
+    size_t new_cap = *cap;
+    while (new_cap < need) new_cap *= 2;
+
+    int *base = realloc(ac->base, new_cap * sizeof *base);
+    if (!base) return -1;
+    ac->base = base;
+    int *check = realloc(ac->check, new_cap * sizeof *check);
+    if (!check) return -1;
+    ac->check = check;
+
+    for (size_t i = *cap; i < new_cap; ++i)
+    {
+        ac->base[i] = 0;
+        ac->check[i] = -1;
+    }
+    *cap = new_cap;
+
+    return 0;
+}
+
+static int build_double_array(ac_matcher_t *ac, const trie_t *t, const int *order)
+{
+    int err = 0;
+    size_t cap = 0;
+    int *pos = malloc(t->n * sizeof *pos);
+    if (!pos) return -1;
+
+    cap = 2 * ac->n_cls;
+    ac->base = malloc(cap * sizeof *ac->base);
+    ac->check = malloc(cap * sizeof *ac->check);
+    if (!ac->base || !ac->check) err = -1;
+
+    if (!err)
+    {
+        for (size_t i = 0; i < cap; ++i)
+        {
+            ac->base[i] = 0;
+            ac->check[i] = -1;
+        }
+        // root never is a child
+        ac->check[0] = -2;
+        pos[0] = 0;
+    }
+
+    size_t first_free = 1;
+    size_t n_slots = ac->n_cls;
+
+    for (int i = 0; i < t->n && !err; ++i)
+    {
+        int s = order[i];
+        if (t->child[s] < 0) continue;
+
+        int min_label = ac->n_cls;
+        for (int c = t->child[s]; c >= 0; c = t->sibling[c])
+            if (t->label[c] < min_label) min_label = t->label[c];
+
+        while (first_free < cap && ac->check[first_free] != -1) first_free++;
+
+        // lowest base placing all children in free slots
+        size_t b = first_free > (size_t) min_label ? first_free - min_label : 1;
+        for (;; ++b)
+        {
+            if (da_reserve(ac, &cap, b + ac->n_cls))
+            {
+                err = -1;
+                break;
+            }
+
+            int fits = 1;
+            for (int c = t->child[s]; c >= 0 && fits; c = t->sibling[c])
+                fits = ac->check[b + t->label[c]] == -1;
+            if (fits) break;
+        }
+        if (err) break;
+
+        ac->base[pos[s]] = (int) b;
+        for (int c = t->child[s]; c >= 0; c = t->sibling[c])
+        {
+            pos[c] = (int) b + t->label[c];
+            ac->check[pos[c]] = pos[s];
+        }
+        if (b + ac->n_cls > n_slots) n_slots = b + ac->n_cls;
+    }
+
+    // state arrays are indexed by slot
+    int *fail = NULL, *term = NULL, *dict = NULL, *rep = NULL;
+    if (!err)
+    {
+        fail = malloc(n_slots * sizeof *fail);
+        term = malloc(n_slots * sizeof *term);
+        dict = malloc(n_slots * sizeof *dict);
+        rep = malloc(n_slots * sizeof *rep);
+        if (!fail || !term || !dict || !rep) err = -1;
+    }
+
+    if (!err)
+    {
+        for (size_t i = 0; i < n_slots; ++i)
+        {
+            fail[i] = 0;
+            term[i] = -1;
+            dict[i] = -1;
+            rep[i] = -1;
+        }
+        for (int s = 0; s < t->n; ++s)
+        {
+            fail[pos[s]] = pos[t->fail[s]];
+            term[pos[s]] = t->term[s];
+            dict[pos[s]] = t->dict[s] >= 0 ? pos[t->dict[s]] : -1;
+            rep[pos[s]] = ac->rep[s] >= 0 ? pos[ac->rep[s]] : -1;
+        }
+
+        free(ac->term);
+        free(ac->dict);
+        free(ac->rep);
+        ac->fail = fail;
+        ac->term = term;
+        ac->dict = dict;
+        ac->rep = rep;
+    }
+    else
+    {
+        free(fail);
+        free(term);
+        free(dict);
+        free(rep);
+    }
+
+    free(pos);
+    return err;
+}
+
+ac_matcher_t* ac_build(const char *const pats[], const size_t lens[], int n_pats)
+{
+    if (!pats || !lens || n_pats < 1) return NULL;
+    for (int p = 0; p < n_pats; ++p)
+        if (!pats[p] || !lens[p]) return NULL;
+
+    ac_matcher_t *ac = calloc(1, sizeof *ac);
+    if (!ac) return NULL;
+
+    // classes numbered in order of byte value
+    int used[256] = {0};
+    for (int p = 0; p < n_pats; ++p)
+        for (size_t i = 0; i < lens[p]; ++i)
+            used[(unsigned char) pats[p][i]] = 1;
+    ac->n_cls = 1;
+    for (int b = 0; b < 256; ++b)
+        ac->cls[b] = used[b] ? ac->n_cls++ : 0;
+
+    trie_t t = {0};
+    int *order = NULL;
+    int err = 0;
+
+    do
+    {
+        ac->pat_next = malloc(n_pats * sizeof *ac->pat_next);
+        if (!ac->pat_next || trie_build(&t, ac, pats, lens, n_pats, &order))
+        {
+            err = -1;
+            break;
+        }
+
+        ac->term = malloc(t.n * sizeof *ac->term);
+        ac->dict = malloc(t.n * sizeof *ac->dict);
+        ac->rep = malloc(t.n * sizeof *ac->rep);
+        if (!ac->term || !ac->dict || !ac->rep)
+        {
+            err = -1;
+            break;
+        }
+        for (int s = 0; s < t.n; ++s)
+        {
+            ac->term[s] = t.term[s];
+            ac->dict[s] = t.dict[s];
+            ac->rep[s] = t.term[s] >= 0 ? s : t.dict[s];
+        }
+
+        ac->dense = (size_t) t.n * ac->n_cls * sizeof *ac->table <= AC_DENSE_MAX_BYTES;
+        if (ac->dense) err = build_dense(ac, &t, order);
+        else err = build_double_array(ac, &t, order);
+    } while (0);
+
+    free(order);
+    trie_free(&t);
+
+    if (err)
+    {
+        ac_free(ac);
+        return NULL;
+    }
+
+    return ac;
+}
+
+void ac_free(ac_matcher_t *ac)
+{
+    if (!ac) return;
+
+    free(ac->term);
+    free(ac->pat_next);
+    free(ac->dict);
+    free(ac->rep);
+    free(ac->table);
+    free(ac->base);
+    free(ac->check);
+    free(ac->fail);
+    free(ac);
+}
+
+/**
+ * Report patterns ending in state s and on its dictionary chain.
+ */
+static int report(const ac_matcher_t *ac, int s, size_t end, ac_match_cb_t cb, void *arg)
+{
+    for (int r = ac->rep[s]; r >= 0; r = ac->dict[r])
+    {
+        for (int p = ac->term[r]; p >= 0; p = ac->pat_next[p])
+        {
+            int ret = cb(end, p, arg);
+            if (ret) return ret;
+        }
+    }
+    return 0;
+}
+
+int ac_scan(const ac_matcher_t *ac, const char *buf, size_t len, ac_match_cb_t cb, void *arg)
+{
+    const unsigned char *data = (const unsigned char*) buf;
+
+    if (ac->dense)
+    {
+        const unsigned *table = ac->table;
+        unsigned row = 0;
+        for (size_t i = 0; i < len; ++i)
+        {
+            row = table[(row & ~AC_OUT) + ac->cls[data[i]]];
+            if (row & AC_OUT)
+            {
+                int ret = report(ac, (row & ~AC_OUT) / ac->n_cls, i + 1, cb, arg);
+                if (ret) return ret;
+            }
+        }
+        return 0;
+    }
+
+    const int *base = ac->base;
+    const int *check = ac->check;
+    int s = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        int c = ac->cls[data[i]];
+        if (!c)
+        {
+            // byte in no pattern
+            s = 0;
+            continue;
+        }
+
+        for (;;)
+        {
+            int next = base[s] + c;
+            if (check[next] == s)
+            {
+                s = next;
+                break;
+            }
+            if (!s) break;
+            s = ac->fail[s];
+        }
+
+        if (ac->rep[s] >= 0)
+        {
+            int ret = report(ac, s, i + 1, cb, arg);
+            if (ret) return ret;
+        }
+    }
+
+    return 0;
+}
@@ -9,193 +9,48 @@
 #include <string.h>
 #include <limits.h>
 #include <stdlib.h>
+#include "searchfile.h"
+#include "results.h"
 
-/**
- * Surround string with single quotes.
- */
-static int quote_string(char *out, size_t n, const char *in)
-{
-    if (!out || !in || out == in) return -1;
-
-    // count characters to escape
-    size_t out_size = 3; // start with "''\0" (3 chars)
-    for (size_t i = 0; in[i]; ++i)
-    {
-        switch (in[i])
-        {
-            case '\'':
-            case '\\':
-                // escape with backslash
-                out_size += 2;
-                break;
-
-            default:
-                out_size++;
-                break;
-        }
-    }
-
-    if (out_size > n) return -1;
-
-    // write quoted string
-    size_t written = 0;
-    out[written++] = '\'';
-    for (size_t i = 0; in[i]; ++i)
-    {
-        switch (in[i])
-        {
-            case '\'':
-            case '\\':
-                // escape next char
-                out[written++] = '\\';
-
-            default:
-                out[written++] = in[i];
-                break;
-        }
-    }
-    out[written++] = '\'';
-    out[written++] = 0;
+int process_dir(const char path[], size_t root_path_len, const search_query_t *query, long depth);
 
-    return 0;
-}
-
-/**
- * Check if given file is a text file
- * using the file command to check
- * the mime type.
- * Returns 1 if mime type is text*.
- */
-static int is_text_file(const char path[])
-{
-    char path_quoted[PATH_MAX];
-    if (quote_string(path_quoted, sizeof path_quoted, path))
-        return 0;
-
-    char cmd[PATH_MAX + 64];
-    sprintf(cmd, "file --brief --mime -- %s", path_quoted);
-
-    FILE *f = popen(cmd, "r");
-    if (!f) return 0;
-
-    char mime[5];
-    int err = fread(mime, 1, 4, f) == 4 ? 0 : -1;
-    mime[4] = 0;
-
-    pclose(f);
-
-    if (err) return 0;
-
-    return !strcmp("text", mime);
-}
-
-/**
- * Searches given file for given pattern.
- * Prints the filename, line number
- * and column number of pattern occurrences.
- */
-static int search_file(const char path[], size_t root_path_len, const char pattern[])
-{
-    if (!is_text_file(path)) return 0;
-
-    FILE *f = fopen(path, "r");
-    if (!f) return -1;
-
-    int err = 0;
-    char *buf = NULL;
-
-    do
-    {
-        size_t pat_len = strlen(pattern);
-        buf = malloc(pat_len + 1);
-        if (!buf)
-        {
-            err = -1;
-            break;
-        }
-        buf[pat_len] = 0;
-
-        int line_num = 1;
-        int col_num = 1;
-
-        while (!feof(f))
-        {
-            long match_start = ftell(f);
-            if (match_start < 0)
-            {
-                err = -1;
-                break;
-            }
-
-            err = fread(buf, 1, pat_len, f) == pat_len ? 0 : -1;
-            if (err)
-            {
-                if (feof(f)) err = 0;
-                break;
-            }
-
-            if (!memcmp(pattern, buf, pat_len))
-            {
-                printf("(PID %lld) %s:%d:%d\n",
-                       (long long) getpid(),
-                       path + root_path_len + 1,
-                       line_num,
-                       col_num
-                       );
-            }
-
-            err = fseek(f, match_start + 1, SEEK_SET);
-            if (err) break;
-
-            if (buf[0] == '\n')
-            {
-                line_num++;
-                col_num = 1;
-            }
-            else col_num++;
-        }
-    } while (0);
-
-    free(buf);
-    fclose(f);
-
-    return err;
-}
-
-int process_dir(const char path[], size_t root_path_len, const char pattern[], long depth);
-
-static int process_path(const char path[], size_t root_path_len, const char pattern[], long depth, DIR *parent_dir)
+static int process_path(const char path[], size_t root_path_len, const search_query_t *query, long depth, DIR *parent_dir)
 {
     struct stat stat;
     if (lstat(path, &stat)) return -1;
 
     if (S_ISDIR(stat.st_mode) && depth > 0)
     {
+        // child would send them again
+        if (results_flush()) return -1;
+
         pid_t pid = fork();
         if (pid < 0) return -1;
 
         if (!pid)
         {
             if (parent_dir) closedir(parent_dir);
-            int err = process_dir(path, root_path_len, pattern, depth - 1);
+            int err = process_dir(path, root_path_len, query, depth - 1);
+            if (results_flush()) err = -1;
             exit(err);
         }
     }
     else
     {
-        if (search_file(path, root_path_len, pattern)) return -1;
+        if (search_file(path, &stat, root_path_len, query)) return -1;
     }
 
     return 0;
 }
 
-int process_dir(const char path[], size_t root_path_len, const char pattern[], long depth)
+int process_dir(const char path[], size_t root_path_len, const search_query_t *query, long depth)
 {
     int err = 0;
     DIR *root_dir = opendir(path);
     if (!root_dir) return -1;
 
-    for (;;)
+    // remaining entries are cancelled when enough results are found
+    while (!results_done())
     {
         struct dirent *ent = readdir(root_dir);
         if (!ent) break;
@@ -214,7 +69,7 @@ int process_dir(const char path[], size_t root_path_len, const char pattern[], l
         strcat(ent_path, "/");
         strcat(ent_path, ent->d_name);
 
-        err = process_path(ent_path, root_path_len, pattern, depth, root_dir);
+        err = process_path(ent_path, root_path_len, query, depth, root_dir);
         if (err) break;
     }
 
@@ -231,11 +86,11 @@ int process_dir(const char path[], size_t root_path_len, const char pattern[], l
 }
 
 
-int fork_search(const char path[], const char pattern[], long depth)
+int fork_search(const char path[], const search_query_t *query, long depth)
 {
-    if (!path || !pattern) return -1;
+    if (!path || !query) return -1;
 
-    int err = process_path(path, strlen(path), pattern, depth, NULL);
+    int err = process_path(path, strlen(path), query, depth, NULL);
 
     int status;
     while (wait(&status) >= 0)
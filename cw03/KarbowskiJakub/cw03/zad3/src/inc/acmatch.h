@@ -0,0 +1,52 @@
+#ifndef JK_03_03_ACMATCH_H
+#define JK_03_03_ACMATCH_H
+
+#include <stddef.h>
+
+// largest transition table kept dense
+#ifndef AC_DENSE_MAX_BYTES
+#define AC_DENSE_MAX_BYTES (1024 * 1024)
+#endif
+
+/**
+ * Aho-Corasick automaton matching many strings in one pass.
+ * Bytes not used by any pattern share one input class,
+ * so the alphabet is the number of distinct pattern bytes plus one.
+ * Small automata use a dense table of all transitions,
+ * larger ones a double-array trie with failure links.
+ * Read only after ac_build, may be used by many threads.
+ */
+typedef struct ac_matcher_t ac_matcher_t;
+
+/**
+ * Called for every match.
+ *
+ * @param end Offset just past the last byte of the match.
+ * @param pat Index of the matched pattern.
+ * @param arg Argument passed to ac_scan.
+ * @return 0 to continue, nonzero stops the scan.
+ */
+typedef int (*ac_match_cb_t)(size_t end, int pat, void *arg);
+
+/**
+ * Build automaton.
+ *
+ * @param pats Patterns.
+ * @param lens Pattern lengths, at least 1.
+ * @param n_pats Number of patterns.
+ * @return Automaton or NULL on error.
+ */
+ac_matcher_t* ac_build(const char *const pats[], const size_t lens[], int n_pats);
+
+void ac_free(ac_matcher_t *ac);
+
+/**
+ * Report all, possibly overlapping, matches in buffer.
+ * Matches are reported in order of their end,
+ * longer patterns first for the same end.
+ *
+ * @return 0 or value returned by cb.
+ */
+int ac_scan(const ac_matcher_t *ac, const char *buf, size_t len, ac_match_cb_t cb, void *arg);
+
+#endif
@@ -1,6 +1,20 @@
 #ifndef JK_03_03_FORK_SEARCH_H
 #define JK_03_03_FORK_SEARCH_H
 
-int fork_search(const char path[], const char pattern[], long depth);
+#include "searchfile.h"
+
+/**
+ * Search directory tree for query patterns,
+ * every directory is searched by a new process.
+ * Matches are passed to results_add, so it has to run in results_run.
+ * Processes stop searching when results_done.
+ * Directories deeper than depth are not entered.
+ *
+ * @param path Root directory.
+ * @param query Searched patterns.
+ * @param depth Maximum search depth.
+ * @return 0 or negative error.
+ */
+int fork_search(const char path[], const search_query_t *query, long depth);
 
 #endif
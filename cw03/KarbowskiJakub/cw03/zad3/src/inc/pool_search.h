@@ -0,0 +1,25 @@
+#ifndef JK_03_03_POOL_SEARCH_H
+#define JK_03_03_POOL_SEARCH_H
+
+#include "searchfile.h"
+
+/**
+ * Search like fork_search using a fixed number of threads.
+ * Directories and files are queued on per worker deques,
+ * idle workers steal from others.
+ * Matches are passed to results_add, so it has to run in results_run.
+ * Workers stop searching when results_done.
+ * A path that cannot be searched fails the search but,
+ * unlike in fork_search which skips the rest of its directory,
+ * all other paths are still searched.
+ * Directories deeper than depth are not entered.
+ *
+ * @param path Root directory.
+ * @param query Searched patterns.
+ * @param depth Maximum search depth.
+ * @param n_workers Number of threads.
+ * @return 0 or negative error.
+ */
+int pool_search(const char path[], const search_query_t *query, long depth, int n_workers);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef JK_03_03_REMATCH_H
+#define JK_03_03_REMATCH_H
+
+#include <stddef.h>
+
+// longest required literal kept
+#define RE_LIT_MAX (64)
+// largest repetition count in {m,n}
+#define RE_MAX_REPEAT (255)
+// largest compiled program
+#define RE_MAX_NODES (1 << 16)
+// lazy DFA is flushed when it grows past this
+#ifndef RE_DFA_MAX_STATES
+#define RE_DFA_MAX_STATES (4096)
+#endif
+
+/**
+ * Compiled extended regular expression.
+ * Supported syntax: literals, ., [...] with ranges, negation
+ * and [:class:], \d \w \s and negations, ^ $, (), |, * + ? {m,n}.
+ * Matches never span lines, . and negated sets exclude the newline.
+ * Read only after compilation, may be used by many threads.
+ */
+typedef struct re_prog_t re_prog_t;
+
+/**
+ * DFA built lazily from a program.
+ * Holds a state cache, so every thread needs its own.
+ */
+typedef struct re_dfa_t re_dfa_t;
+
+/**
+ * Compile expression.
+ *
+ * @param pattern Expression.
+ * @return Program or NULL if pattern is invalid or too large.
+ */
+re_prog_t* re_compile(const char *pattern);
+
+void re_free(re_prog_t *prog);
+
+/**
+ * Get string contained in every match,
+ * usable to skip lines which cannot match.
+ *
+ * @param prog Program.
+ * @param len Output length, 0 when there is no such string.
+ * @return Literal, not terminated.
+ */
+const char* re_literal(const re_prog_t *prog, size_t *len);
+
+/**
+ * Create empty DFA cache for program.
+ *
+ * @return DFA or NULL on error.
+ */
+re_dfa_t* re_dfa_new(const re_prog_t *prog);
+
+void re_dfa_free(re_dfa_t *dfa);
+
+/**
+ * Find leftmost longest non-empty match starting at or after from.
+ * Lines are separated by '\n', len is treated as the end of a line.
+ * Bytes before from are only used to check for the line start.
+ *
+ * @param dfa DFA.
+ * @param buf Searched data.
+ * @param len Size of data.
+ * @param from First possible start of match.
+ * @param start Output offset of match.
+ * @param end Output offset just past the match.
+ * @return 1 if found, 0 if not or negative error.
+ */
+int re_find(re_dfa_t *dfa, const char *buf, size_t len, size_t from, size_t *start, size_t *end);
+
+#endif
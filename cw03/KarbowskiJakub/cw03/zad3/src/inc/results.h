@@ -0,0 +1,63 @@
+#ifndef JK_03_03_RESULTS_H
+#define JK_03_03_RESULTS_H
+
+// results buffered by every thread before sending
+#define RESULTS_BUF_SIZE (64 * 1024)
+// stdout buffer of the aggregating process
+#define RESULTS_OUT_BUF_SIZE (256 * 1024)
+
+/**
+ * Run search in a child process and print results of its workers.
+ * Workers append matches to private buffers which are sent
+ * to this process through a pipe in chunks written atomically,
+ * so lines of different workers never mix.
+ * Lines are "(PID id) path:line:col" followed by ":pattern"
+ * if patterns are given, id is the thread which found the match.
+ *
+ * @param search Search run in the child process, 0 on success.
+ * @param arg Argument of search.
+ * @param patterns Pattern strings by index or NULL to print none.
+ * @param sorted Nonzero to print results after the search ends,
+ *               sorted by path, line, column and pattern,
+ *               without the "(PID id) " prefix.
+ * @param max_count Maximum number of results of the whole search, 0 for no limit.
+ *                  Counter is shared by all processes of the search.
+ * @return 0 or negative error, also if search failed.
+ */
+int results_run(int (*search)(void *arg), void *arg, const char *const patterns[], int sorted,
+                long max_count);
+
+/**
+ * Add match to buffer of the calling thread.
+ * The buffer is sent when full.
+ *
+ * @param path Path printed for the match.
+ * @param line Line number.
+ * @param col Column number.
+ * @param pat Index of the pattern.
+ * @return 0, 1 if the result limit is reached and match is dropped, or negative error.
+ */
+int results_add(const char *path, long long line, long long col, int pat);
+
+/**
+ * Check if the result limit is reached, so the search can stop.
+ * Cheap enough to call for every file.
+ *
+ * @return Nonzero if no more results are accepted.
+ */
+int results_done(void);
+
+/**
+ * Send buffered results of the calling thread.
+ * Must be called before fork and before the thread exits.
+ *
+ * @return 0 or negative error.
+ */
+int results_flush(void);
+
+/**
+ * Free buffer of the calling thread, unsent results are lost.
+ */
+void results_thread_free(void);
+
+#endif
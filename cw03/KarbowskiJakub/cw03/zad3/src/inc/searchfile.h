@@ -0,0 +1,80 @@
+#ifndef JK_03_03_SEARCHFILE_H
+#define JK_03_03_SEARCHFILE_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include "acmatch.h"
+#include "rematch.h"
+#include "tgindex.h"
+
+/**
+ * Set of searched strings or regular expressions.
+ * Single string is searched with str_find,
+ * more of them with one Aho-Corasick pass.
+ * Every regular expression is searched with its own lazy DFA,
+ * on lines containing its required literal.
+ * With an index, files which cannot contain a match are skipped.
+ */
+typedef struct search_query_t
+{
+    const char *const *patterns;
+    size_t *pattern_lens;
+    int n_patterns;
+    // strings only, NULL for single pattern
+    ac_matcher_t *ac;
+    // regular expressions only, compiled patterns
+    re_prog_t **progs;
+    // candidate files, NULL to search all
+    const tg_index_t *index;
+} search_query_t;
+
+/**
+ * Prepare query.
+ * Patterns are not copied and must outlive the query.
+ *
+ * @param query Output query.
+ * @param patterns Searched strings, not empty.
+ * @param n_patterns Number of patterns, at least 1.
+ * @param regex Nonzero if patterns are extended regular expressions.
+ * @return 0 or negative error, also for invalid expressions.
+ */
+int search_query_init(search_query_t *query, const char *const patterns[], int n_patterns, int regex);
+
+void search_query_free(search_query_t *query);
+
+/**
+ * Search only candidate files of index.
+ * Candidates contain trigrams of a pattern,
+ * or of the required literal of a regular expression.
+ * Index is modified and must outlive the query.
+ *
+ * @param query Query.
+ * @param index Index of the searched tree.
+ * @return Number of candidates or negative error.
+ */
+long search_query_set_index(search_query_t *query, tg_index_t *index);
+
+/**
+ * Free search caches and result buffer of the calling thread.
+ */
+void search_thread_free(void);
+
+/**
+ * Searches given file for query patterns.
+ * Filename, line number and column number
+ * of pattern occurrences are passed to results_add,
+ * overlapping occurrences included.
+ * Regular expressions report leftmost longest
+ * non-empty matches which do not overlap.
+ * Files which are not regular or not text are skipped,
+ * so are unchanged files of the index which are not candidates.
+ *
+ * @param path File path.
+ * @param st lstat of the file.
+ * @param root_path_len Length of path prefix not printed.
+ * @param query Searched patterns.
+ * @return 0 or negative error.
+ */
+int search_file(const char path[], const struct stat *st, size_t root_path_len, const search_query_t *query);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef JK_03_03_STRSEARCH_H
+#define JK_03_03_STRSEARCH_H
+
+#include <stddef.h>
+
+/**
+ * Find first occurrence of pattern in buffer.
+ * Candidates are positions where both the first
+ * and the last byte of pattern match, checked 16 at a time.
+ *
+ * @param buf Searched data.
+ * @param len Size of data.
+ * @param pat Pattern.
+ * @param pat_len Size of pattern, at least 1.
+ * @return Pointer to match or NULL.
+ */
+const char* str_find(const char *buf, size_t len, const char *pat, size_t pat_len);
+
+/**
+ * Line and column counter advanced lazily
+ * from one position to the next.
+ */
+typedef struct line_counter_t
+{
+    const char *buf;
+    // everything before pos is counted
+    size_t pos;
+    // start of line containing pos
+    size_t line_start;
+    long long line;
+} line_counter_t;
+
+/**
+ * Start counting lines in buffer.
+ */
+void line_counter_init(line_counter_t *lc, const char *buf);
+
+/**
+ * Get 1-based line and column of byte at pos.
+ * Positions must not decrease between calls.
+ */
+void line_counter_get(line_counter_t *lc, size_t pos, long long *line, long long *col);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef JK_03_03_TEXTDETECT_H
+#define JK_03_03_TEXTDETECT_H
+
+#include <sys/stat.h>
+
+// bytes read from the beginning of file
+#define TEXT_PROBE_SIZE (4096)
+
+typedef enum text_kind_t
+{
+    TEXT_BINARY = 0,
+    TEXT_ASCII,
+    // bytes >= 0x80, UTF-8 or any other 8-bit encoding
+    TEXT_8BIT,
+} text_kind_t;
+
+/**
+ * Check if regular file contains text.
+ * First TEXT_PROBE_SIZE bytes must be non empty
+ * and without NUL and other binary control characters,
+ * like the file command does.
+ * Results are cached by device and inode in a per thread cache.
+ * Forked children start with a copy of the cache and what they add
+ * is not shared back, so in fork mode it only hits for hard links
+ * met by one process.
+ *
+ * @param fd Open file, offset is not changed.
+ * @param st Stat of the file.
+ * @return Kind of text, TEXT_BINARY (0) if not text or negative error.
+ */
+int text_detect(int fd, const struct stat *st);
+
+/**
+ * Free cache of the calling thread.
+ */
+void text_detect_clear(void);
+
+#endif
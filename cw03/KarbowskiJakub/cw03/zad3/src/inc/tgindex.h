@@ -0,0 +1,61 @@
+#ifndef JK_03_03_TGINDEX_H
+#define JK_03_03_TGINDEX_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+/**
+ * Trigram index of files in a directory tree.
+ * Every trigram present in a text file has a posting list
+ * of file ids, stored as varint deltas in a file mapped into memory.
+ * Files are stored with size and mtime, so changed ones
+ * are recognized, searched and indexed again.
+ * Read only after tg_select, may be used by many threads.
+ */
+typedef struct tg_index_t tg_index_t;
+
+/**
+ * Load index from file and bring it up to date with the tree.
+ * New and changed files are indexed, deleted ones are dropped
+ * and the file is rewritten only if something changed.
+ * Index of another root is built from scratch.
+ *
+ * @param index_path Index file, created if missing.
+ * @param root Indexed directory.
+ * @param depth Maximum depth, same as for the search.
+ * @param n_indexed Output number of files read, may be NULL.
+ * @return Index or NULL on error, also for invalid index file.
+ */
+tg_index_t* tg_update(const char index_path[], const char root[], long depth, long *n_indexed);
+
+void tg_free(tg_index_t *idx);
+
+/**
+ * Get number of files in index.
+ */
+long tg_size(const tg_index_t *idx);
+
+/**
+ * Select candidate files containing all trigrams
+ * of at least one of the strings.
+ * Strings shorter than a trigram select all files.
+ *
+ * @param idx Index.
+ * @param strs Strings, every match contains one of them.
+ * @param lens String lengths.
+ * @param n Number of strings.
+ * @return Number of candidates or negative error.
+ */
+long tg_select(tg_index_t *idx, const char *const strs[], const size_t lens[], int n);
+
+/**
+ * Check if file has to be searched.
+ *
+ * @param idx Index.
+ * @param rel_path Path relative to the root.
+ * @param st lstat of the file.
+ * @return 0 if file is indexed, unchanged and not a candidate, 1 otherwise.
+ */
+int tg_may_match(const tg_index_t *idx, const char rel_path[], const struct stat *st);
+
+#endif
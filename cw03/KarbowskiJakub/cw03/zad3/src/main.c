@@ -1,31 +1,341 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <getopt.h>
 #include "fork_search.h"
+#include "pool_search.h"
+#include "results.h"
+#include "tgindex.h"
 
 static const char HELP[] =
         "SO Lab3 Zad3 - Jakub Karbowski\n"
         "Usage:\n"
-        "%s DIR PATTERN DEPTH - search DIR for files containing PATTERN "
-        "with maximum search depth DEPTH\n";
+        "%s [-p] [-j N] [-s] [-m N] [-E] [-i INDEX] DIR PATTERN DEPTH - search DIR for files containing PATTERN "
+        "with maximum search depth DEPTH\n"
+        "%s [-p] [-j N] [-s] [-m N] [-E] [-i INDEX] -e PATTERN... [-f FILE] DIR DEPTH - search for many patterns "
+        "in one pass, matched pattern is printed after the column\n"
+        "%s -b -i INDEX DIR DEPTH - build or update trigram index of DIR and exit\n"
+        "Directories are searched by new processes unless:\n"
+        "-p - use one thread per CPU core\n"
+        "-j N - use N threads\n"
+        "-s - print results sorted by path, without PIDs, after the search ends\n"
+        "-m N, --max-count N - stop the whole search after N matches\n"
+        "--first - same as -m 1, to check if any file matches\n"
+        "Patterns:\n"
+        "-e PATTERN - add pattern, may be repeated\n"
+        "-f FILE - add patterns from FILE, one per line, empty lines are skipped\n"
+        "-E - patterns are extended regular expressions, matches do not overlap\n"
+        "Index:\n"
+        "-i INDEX - search only files which may match according to trigram index INDEX, "
+        "changed files are indexed again before the search\n"
+        "-b - only build the index\n";
 
-int main(int argc, char **argv)
+// long options without short equivalent
+enum
+{
+    OPT_FIRST = 256,
+};
+
+static const struct option LONG_OPTIONS[] = {
+    { "max-count", required_argument, NULL, 'm' },
+    { "first", no_argument, NULL, OPT_FIRST },
+    { 0 },
+};
+
+/**
+ * Search run by results_run.
+ */
+typedef struct search_args_t
+{
+    const char *dir;
+    const search_query_t *query;
+    long depth;
+    long n_workers;
+} search_args_t;
+
+/**
+ * Growing list of patterns.
+ */
+typedef struct pattern_list_t
+{
+    const char **items;
+    int size;
+    int cap;
+    // contents of pattern files
+    char **bufs;
+    int n_bufs;
+} pattern_list_t;
+
+static int add_pattern(pattern_list_t *list, const char *pattern)
+{
+    if (!*pattern) return -1;
+
+    if (list->size == list->cap)
+    {
+        int cap = list->cap ? 2 * list->cap : 16;
+        const char **items = realloc(list->items, cap * sizeof *items);
+        if (!items) return -1;
+        list->items = items;
+        list->cap = cap;
+    }
+
+    list->items[list->size++] = pattern;
+    return 0;
+}
+
+static int load_patterns(pattern_list_t *list, const char *path)
 {
-    if (argc != 4)
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    char *buf = NULL;
+    size_t size = 0;
+    int err = 0;
+
+    do
     {
-        fprintf(stderr, HELP, argv[0]);
+        if (fseek(file, 0, SEEK_END)) err = -1;
+        long file_size = err ? -1 : ftell(file);
+        if (file_size < 0 || fseek(file, 0, SEEK_SET))
+        {
+            err = -1;
+            break;
+        }
+
+        size = file_size;
+        buf = malloc(size + 1);
+        if (!buf || fread(buf, 1, size, file) != size)
+        {
+            err = -1;
+            break;
+        }
+        buf[size] = 0;
+
+        char **bufs = realloc(list->bufs, (list->n_bufs + 1) * sizeof *bufs);
+        if (!bufs)
+        {
+            err = -1;
+            break;
+        }
+        list->bufs = bufs;
+        list->bufs[list->n_bufs++] = buf;
+    } while (0);
+
+    fclose(file);
+    if (err)
+    {
+        free(buf);
         return -1;
     }
 
+    // split in place
+    char *line = buf;
+    while (line < buf + size)
+    {
+        char *nl = memchr(line, '\n', buf + size - line);
+        if (!nl) nl = buf + size;
+        *nl = 0;
+        if (*line && add_pattern(list, line)) return -1;
+        line = nl + 1;
+    }
+
+    return 0;
+}
+
+static void free_patterns(pattern_list_t *list)
+{
+    for (int i = 0; i < list->n_bufs; ++i)
+        free(list->bufs[i]);
+    free(list->bufs);
+    free(list->items);
+}
+
+static int run_search(void *arg)
+{
+    const search_args_t *args = arg;
+    if (args->n_workers)
+        return pool_search(args->dir, args->query, args->depth, (int) args->n_workers);
+    return fork_search(args->dir, args->query, args->depth);
+}
+
+int main(int argc, char **argv)
+{
     char *endptr;
-    long depth = strtol(argv[3], &endptr, 10);
+    long n_workers = 0;
+    // patterns given with -e or -f
+    int explicit_patterns = 0;
+    int regex = 0;
+    int sorted = 0;
+    long max_count = 0;
+    const char *index_path = NULL;
+    int build_index = 0;
+    pattern_list_t patterns = {0};
+    int err = 0;
+
+    int opt;
+    while (!err && (opt = getopt_long(argc, argv, "pj:sm:e:f:Ei:b", LONG_OPTIONS, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+                if (n_workers < 1) n_workers = 1;
+                break;
+
+            case 'j':
+                n_workers = strtol(optarg, &endptr, 10);
+                if (*endptr || n_workers <= 0 || n_workers > INT_MAX)
+                {
+                    fprintf(stderr, "Invalid N: %s\n", optarg);
+                    err = -1;
+                }
+                break;
+
+            case 's':
+                sorted = 1;
+                break;
+
+            case 'm':
+                max_count = strtol(optarg, &endptr, 10);
+                if (*endptr || max_count <= 0)
+                {
+                    fprintf(stderr, "Invalid N: %s\n", optarg);
+                    err = -1;
+                }
+                break;
+
+            case OPT_FIRST:
+                max_count = 1;
+                break;
+
+            case 'E':
+                regex = 1;
+                break;
+
+            case 'i':
+                index_path = optarg;
+                break;
+
+            case 'b':
+                build_index = 1;
+                break;
+
+            case 'e':
+                explicit_patterns = 1;
+                if (add_pattern(&patterns, optarg))
+                {
+                    fprintf(stderr, "Invalid pattern: empty\n");
+                    err = -1;
+                }
+                break;
+
+            case 'f':
+                explicit_patterns = 1;
+                if (load_patterns(&patterns, optarg))
+                {
+                    fprintf(stderr, "Cannot read patterns: %s\n", optarg);
+                    err = -1;
+                }
+                break;
+
+            default:
+                fprintf(stderr, HELP, argv[0], argv[0], argv[0]);
+                err = -1;
+        }
+    }
+
+    int n_args = explicit_patterns || build_index ? 2 : 3;
+    if (!err && (argc - optind != n_args || (build_index && (!index_path || explicit_patterns))))
+    {
+        fprintf(stderr, HELP, argv[0], argv[0], argv[0]);
+        err = -1;
+    }
+
+    if (err)
+    {
+        free_patterns(&patterns);
+        return -1;
+    }
+
+    const char *dir = argv[optind];
+    const char *depth_arg = argv[optind + n_args - 1];
+
+    long depth = strtol(depth_arg, &endptr, 10);
     if (*endptr || depth < 0)
     {
-        fprintf(stderr, "Invalid depth: %s\n", argv[3]);
+        fprintf(stderr, "Invalid depth: %s\n", depth_arg);
+        free_patterns(&patterns);
+        return -1;
+    }
+
+    tg_index_t *index = NULL;
+    if (index_path)
+    {
+        long n_indexed;
+        index = tg_update(index_path, dir, depth, &n_indexed);
+        if (!index)
+        {
+            fprintf(stderr, "Cannot update index: %s\n", index_path);
+            free_patterns(&patterns);
+            return -1;
+        }
+
+        if (build_index)
+        {
+            printf("%ld files indexed, %ld in index\n", n_indexed, tg_size(index));
+            tg_free(index);
+            return 0;
+        }
+    }
+
+    if (!explicit_patterns && add_pattern(&patterns, argv[optind + 1]))
+    {
+        fprintf(stderr, "Invalid pattern: empty\n");
+        tg_free(index);
+        return -1;
+    }
+
+    if (!patterns.size)
+    {
+        fprintf(stderr, "No patterns\n");
+        tg_free(index);
+        free_patterns(&patterns);
         return -1;
     }
 
-    int err = fork_search(argv[1], argv[2], depth);
+    search_query_t query;
+    if (search_query_init(&query, patterns.items, patterns.size, regex))
+    {
+        fprintf(stderr, regex ? "Invalid regular expression\n" : "Cannot compile patterns\n");
+        tg_free(index);
+        free_patterns(&patterns);
+        return -1;
+    }
+
+    if (index && search_query_set_index(&query, index) < 0)
+    {
+        fprintf(stderr, "Cannot read index: %s\n", index_path);
+        search_query_free(&query);
+        tg_free(index);
+        free_patterns(&patterns);
+        return -1;
+    }
+
+    search_args_t args = {
+        .dir = dir,
+        .query = &query,
+        .depth = depth,
+        .n_workers = n_workers,
+    };
+    const char *const *printed = query.n_patterns > 1 ? patterns.items : NULL;
+    err = results_run(run_search, &args, printed, sorted, max_count);
     if (err) fprintf(stderr, "Error!\n");
 
+    search_query_free(&query);
+    tg_free(index);
+    free_patterns(&patterns);
+
     return err;
 }
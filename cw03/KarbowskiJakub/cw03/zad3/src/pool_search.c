@@ -0,0 +1,371 @@
+#include "pool_search.h"
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "searchfile.h"
+#include "results.h"
+
+#define DEQUE_INIT_CAP (64)
+
+/**
+ * Path waiting to be searched.
+ */
+typedef struct work_t
+{
+    char *path;
+    // remaining depth, directories are entered if positive
+    long depth;
+} work_t;
+
+/**
+ * Double ended queue of pending paths.
+ * Owner pushes and pops at the tail,
+ * thieves steal from the head.
+ */
+typedef struct deque_t
+{
+    pthread_mutex_t lock;
+    work_t *items;
+    size_t cap;
+    size_t head;
+    size_t size;
+} deque_t;
+
+struct search_ctx_t;
+
+typedef struct worker_t
+{
+    struct search_ctx_t *ctx;
+    int id;
+    pthread_t thread;
+    deque_t dq;
+} worker_t;
+
+typedef struct search_ctx_t
+{
+    worker_t *workers;
+    int n_workers;
+    const search_query_t *query;
+    size_t root_path_len;
+    // paths pushed but not yet processed
+    long pending;
+    // stops all workers
+    int err;
+    // some path could not be searched
+    int failed;
+    // workers without work sleep here
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    int n_idle;
+} search_ctx_t;
+
+static int deque_init(deque_t *dq)
+{
+    dq->items = malloc(DEQUE_INIT_CAP * sizeof *dq->items);
+    if (!dq->items) return -1;
+    dq->cap = DEQUE_INIT_CAP;
+    dq->head = 0;
+    dq->size = 0;
+    pthread_mutex_init(&dq->lock, NULL);
+    return 0;
+}
+
+static void deque_free(deque_t *dq)
+{
+    if (!dq->items) return;
+    for (size_t i = 0; i < dq->size; ++i)
+        free(dq->items[(dq->head + i) % dq->cap].path);
+    free(dq->items);
+    dq->items = NULL;
+    pthread_mutex_destroy(&dq->lock);
+}
+
+static int deque_push(deque_t *dq, work_t item)
+{
+    int err = 0;
+    pthread_mutex_lock(&dq->lock);
+
+    if (dq->size == dq->cap)
+    {
+        // grow and unwrap the ring
+        work_t *items = malloc(2 * dq->cap * sizeof *items);
+        if (items)
+        {
+            for (size_t i = 0; i < dq->size; ++i)
+                items[i] = dq->items[(dq->head + i) % dq->cap];
+            free(dq->items);
+            dq->items = items;
+            dq->cap *= 2;
+            dq->head = 0;
+        }
+        else err = -1;
+    }
+
+    if (!err)
+    {
+        dq->items[(dq->head + dq->size) % dq->cap] = item;
+        dq->size++;
+    }
+
+    pthread_mutex_unlock(&dq->lock);
+    return err;
+}
+
+static int deque_pop(deque_t *dq, work_t *item)
+{
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->size)
+    {
+        dq->size--;
+        *item = dq->items[(dq->head + dq->size) % dq->cap];
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static int deque_steal(deque_t *dq, work_t *item)
+{
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->size)
+    {
+        *item = dq->items[dq->head];
+        dq->head = (dq->head + 1) % dq->cap;
+        dq->size--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static void wake_all(search_ctx_t *ctx)
+{
+    pthread_mutex_lock(&ctx->idle_lock);
+    pthread_cond_broadcast(&ctx->idle_cond);
+    pthread_mutex_unlock(&ctx->idle_lock);
+}
+
+static int push_work(worker_t *w, const char *path, long depth)
+{
+    search_ctx_t *ctx = w->ctx;
+    work_t item = {
+        .path = strdup(path),
+        .depth = depth,
+    };
+    if (!item.path) return -1;
+
+    __atomic_add_fetch(&ctx->pending, 1, __ATOMIC_SEQ_CST);
+    if (deque_push(&w->dq, item))
+    {
+        __atomic_sub_fetch(&ctx->pending, 1, __ATOMIC_SEQ_CST);
+        free(item.path);
+        return -1;
+    }
+
+    // waiter counts itself before looking at the deques
+    if (__atomic_load_n(&ctx->n_idle, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&ctx->idle_lock);
+        pthread_cond_signal(&ctx->idle_cond);
+        pthread_mutex_unlock(&ctx->idle_lock);
+    }
+    return 0;
+}
+
+/**
+ * Queue entries of directory.
+ */
+static int process_dir(worker_t *w, const char *path, long depth)
+{
+    int err = 0;
+    DIR *dir = opendir(path);
+    if (!dir) return -1;
+
+    size_t path_len = strlen(path);
+
+    for (;;)
+    {
+        struct dirent *ent = readdir(dir);
+        if (!ent) break;
+
+        // skip . and ..
+        if (!strcmp(".", ent->d_name) || !strcmp("..", ent->d_name))
+            continue;
+
+        size_t name_len = strlen(ent->d_name);
+        if (path_len + name_len + 2 > PATH_MAX)
+        {
+            err = -1;
+            break;
+        }
+        char ent_path[PATH_MAX];
+        memcpy(ent_path, path, path_len);
+        ent_path[path_len] = '/';
+        memcpy(ent_path + path_len + 1, ent->d_name, name_len + 1);
+
+        err = push_work(w, ent_path, depth);
+        if (err) break;
+    }
+
+    closedir(dir);
+
+    return err;
+}
+
+/**
+ * Same rules as process_path of fork_search.
+ */
+static int process_work(worker_t *w, const work_t *item)
+{
+    struct stat st;
+    if (lstat(item->path, &st)) return -1;
+
+    if (S_ISDIR(st.st_mode) && item->depth > 0)
+        return process_dir(w, item->path, item->depth - 1);
+
+    return search_file(item->path, &st, w->ctx->root_path_len, w->ctx->query);
+}
+
+/**
+ * Take work from own deque or steal from others.
+ */
+static int find_work(worker_t *w, work_t *item)
+{
+    if (deque_pop(&w->dq, item)) return 1;
+
+    search_ctx_t *ctx = w->ctx;
+    for (int i = 1; i < ctx->n_workers; ++i)
+    {
+        worker_t *victim = &ctx->workers[(w->id + i) % ctx->n_workers];
+        if (deque_steal(&victim->dq, item)) return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Sleep until work shows up.
+ *
+ * @return 1 if item was found, 0 when the search is over.
+ */
+static int wait_work(worker_t *w, work_t *item)
+{
+    search_ctx_t *ctx = w->ctx;
+    int found;
+
+    pthread_mutex_lock(&ctx->idle_lock);
+    __atomic_add_fetch(&ctx->n_idle, 1, __ATOMIC_SEQ_CST);
+    while (!(found = find_work(w, item)))
+    {
+        if (__atomic_load_n(&ctx->err, __ATOMIC_SEQ_CST)
+            || !__atomic_load_n(&ctx->pending, __ATOMIC_SEQ_CST) || results_done())
+            break;
+        pthread_cond_wait(&ctx->idle_cond, &ctx->idle_lock);
+    }
+    __atomic_sub_fetch(&ctx->n_idle, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ctx->idle_lock);
+
+    return found;
+}
+
+static void* worker_task(void *arg)
+{
+    worker_t *w = arg;
+    search_ctx_t *ctx = w->ctx;
+
+    // queued work is dropped when enough results are found
+    while (!__atomic_load_n(&ctx->err, __ATOMIC_SEQ_CST) && !results_done())
+    {
+        work_t item;
+        if (!find_work(w, &item) && !wait_work(w, &item)) break;
+
+        int err = process_work(w, &item);
+        free(item.path);
+
+        // only this path is skipped, the rest of the tree is searched
+        if (err) __atomic_store_n(&ctx->failed, 1, __ATOMIC_RELAXED);
+
+        // last path done or limit reached, release sleeping workers
+        if (!__atomic_sub_fetch(&ctx->pending, 1, __ATOMIC_SEQ_CST) || results_done())
+            wake_all(ctx);
+    }
+
+    if (results_flush())
+    {
+        __atomic_store_n(&ctx->err, 1, __ATOMIC_SEQ_CST);
+        wake_all(ctx);
+    }
+    search_thread_free();
+    return NULL;
+}
+
+int pool_search(const char path[], const search_query_t *query, long depth, int n_workers)
+{
+    if (!path || !query || n_workers < 1) return -1;
+
+    search_ctx_t ctx = {
+        .n_workers = n_workers,
+        .query = query,
+        .root_path_len = strlen(path),
+        .pending = 0,
+        .err = 0,
+        .failed = 0,
+    };
+
+    ctx.workers = calloc(n_workers, sizeof *ctx.workers);
+    if (!ctx.workers) return -1;
+    pthread_mutex_init(&ctx.idle_lock, NULL);
+    pthread_cond_init(&ctx.idle_cond, NULL);
+
+    int err = 0;
+    int n_started = 0;
+
+    do
+    {
+        for (int i = 0; i < n_workers; ++i)
+        {
+            worker_t *w = &ctx.workers[i];
+            w->ctx = &ctx;
+            w->id = i;
+            if (deque_init(&w->dq))
+            {
+                err = -1;
+                break;
+            }
+        }
+        if (err) break;
+
+        err = push_work(&ctx.workers[0], path, depth);
+        if (err) break;
+
+        for (; n_started < n_workers; ++n_started)
+        {
+            worker_t *w = &ctx.workers[n_started];
+            if (pthread_create(&w->thread, NULL, worker_task, w)) break;
+        }
+        // started threads steal from deques of the others
+        if (!n_started) err = -1;
+    } while (0);
+
+    for (int i = 0; i < n_started; ++i)
+        pthread_join(ctx.workers[i].thread, NULL);
+
+    if (ctx.err || ctx.failed) err = -1;
+
+    for (int i = 0; i < n_workers; ++i)
+        deque_free(&ctx.workers[i].dq);
+    free(ctx.workers);
+    pthread_mutex_destroy(&ctx.idle_lock);
+    pthread_cond_destroy(&ctx.idle_cond);
+
+    return err;
+}
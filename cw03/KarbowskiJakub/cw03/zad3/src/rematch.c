@@ -0,0 +1,1203 @@
+#include "rematch.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#define HASH_INIT_CAP (256)
+
+typedef struct charset_t
+{
+    unsigned char bits[32];
+} charset_t;
+
+typedef enum ast_type_t
+{
+    AST_SET,
+    AST_CAT,
+    AST_ALT,
+    AST_REPEAT,
+    AST_BOL,
+    AST_EOL,
+    AST_EMPTY,
+} ast_type_t;
+
+/**
+ * Parsed expression.
+ */
+typedef struct ast_t
+{
+    ast_type_t type;
+    // CAT and ALT use both, REPEAT only left
+    struct ast_t *left;
+    struct ast_t *right;
+    // REPEAT bounds, max -1 for unbounded
+    int min;
+    int max;
+    charset_t set;
+} ast_t;
+
+typedef struct parser_t
+{
+    const char *p;
+    int err;
+} parser_t;
+
+typedef enum nfa_type_t
+{
+    NFA_SET,
+    NFA_SPLIT,
+    NFA_BOL,
+    NFA_EOL,
+    NFA_MATCH,
+} nfa_type_t;
+
+typedef struct nfa_node_t
+{
+    nfa_type_t type;
+    int out;
+    // SPLIT only
+    int out1;
+    // SET only, index of charset
+    int set;
+} nfa_node_t;
+
+struct re_prog_t
+{
+    nfa_node_t *nodes;
+    int n_nodes;
+    int cap_nodes;
+    int start;
+
+    charset_t *sets;
+    int n_sets;
+    int cap_sets;
+
+    // input class of every byte, bytes in the same sets share it
+    unsigned char cls[256];
+    int n_cls;
+    // some byte of every class
+    unsigned char cls_rep[256];
+
+    char literal[RE_LIT_MAX];
+    size_t literal_len;
+};
+
+// dfa state flags
+#define DFA_MATCH (1)
+#define DFA_EOL_MATCH (2)
+#define DFA_DEAD (4)
+
+/**
+ * States of one DFA, each is a sorted set of NFA nodes.
+ */
+typedef struct dfa_cache_t
+{
+    // no implicit .* before the expression
+    int anchored;
+
+    int n_states;
+    int cap_states;
+    // encoded next state for state and class, -1 if not built yet,
+    // state s has row s * n_cls
+    int *trans;
+    unsigned char *flags;
+    size_t *set_off;
+    int *set_len;
+
+    int *pool;
+    size_t pool_size;
+    size_t pool_cap;
+
+    // open addressing, state indices or -1
+    int *hash;
+    size_t hash_cap;
+
+    // start state by line start, -1 if not built yet
+    int start[2];
+    // bumped on every flush
+    unsigned long flushes;
+} dfa_cache_t;
+
+struct re_dfa_t
+{
+    const re_prog_t *prog;
+    // unanchored search and anchored longest match
+    dfa_cache_t cache[2];
+
+    // closure scratch
+    int *stack;
+    int *list;
+    int *eol_list;
+    unsigned *mark;
+    unsigned gen;
+};
+
+static void cs_add(charset_t *cs, int b)
+{
+    cs->bits[b >> 3] |= 1 << (b & 7);
+}
+
+static int cs_has(const charset_t *cs, int b)
+{
+    return cs->bits[b >> 3] >> (b & 7) & 1;
+}
+
+static int cs_count(const charset_t *cs, int *last)
+{
+    int n = 0;
+    for (int b = 0; b < 256; ++b)
+    {
+        if (cs_has(cs, b))
+        {
+            n++;
+            *last = b;
+        }
+    }
+    return n;
+}
+
+static void ast_free(ast_t *ast)
+{
+    if (!ast) return;
+    ast_free(ast->left);
+    ast_free(ast->right);
+    free(ast);
+}
+
+static ast_t* ast_new(parser_t *ps, ast_type_t type, ast_t *left, ast_t *right)
+{
+    ast_t *ast = calloc(1, sizeof *ast);
+    if (!ast)
+    {
+        ps->err = 1;
+        ast_free(left);
+        ast_free(right);
+        return NULL;
+    }
+    ast->type = type;
+    ast->left = left;
+    ast->right = right;
+    return ast;
+}
+
+/**
+ * Add \d \w \s style class, upper case letter negates.
+ * Returns 0 if c is not a class letter.
+ */
+static int add_escape_class(charset_t *cs, char c)
+{
+    int (*test)(int);
+    switch (tolower((unsigned char) c))
+    {
+        case 'd': test = isdigit; break;
+        case 'w': test = isalnum; break;
+        case 's': test = isspace; break;
+        default: return 0;
+    }
+
+    int neg = isupper((unsigned char) c);
+    for (int b = 0; b < 256; ++b)
+    {
+        int in = test(b) || (tolower((unsigned char) c) == 'w' && b == '_');
+        // only ASCII is classified
+        if (b >= 128) in = 0;
+        if (in != neg) cs_add(cs, b);
+    }
+    return 1;
+}
+
+static int escape_char(char c)
+{
+    switch (c)
+    {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        default: return (unsigned char) c;
+    }
+}
+
+static int add_named_class(charset_t *cs, const char *name, size_t len)
+{
+    static const struct
+    {
+        const char *name;
+        int (*test)(int);
+    } CLASSES[] = {
+        {"alpha", isalpha}, {"digit", isdigit}, {"alnum", isalnum},
+        {"space", isspace}, {"upper", isupper}, {"lower", islower},
+        {"punct", ispunct}, {"xdigit", isxdigit}, {"blank", isblank},
+        {"cntrl", iscntrl}, {"print", isprint}, {"graph", isgraph},
+    };
+
+    for (size_t i = 0; i < sizeof CLASSES / sizeof *CLASSES; ++i)
+    {
+        if (strlen(CLASSES[i].name) != len || memcmp(CLASSES[i].name, name, len))
+            continue;
+        for (int b = 0; b < 128; ++b)
+            if (CLASSES[i].test(b)) cs_add(cs, b);
+        return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * Parse one member of bracket expression.
+ * Returns byte or -1 when a whole class was added.
+ */
+static int parse_class_char(parser_t *ps, charset_t *cs)
+{
+    char c = *ps->p++;
+    if (c != '\\') return (unsigned char) c;
+
+    c = *ps->p;
+    if (!c)
+    {
+        ps->err = 1;
+        return -1;
+    }
+    ps->p++;
+    if (add_escape_class(cs, c)) return -1;
+    return escape_char(c);
+}
+
+static ast_t* parse_class(parser_t *ps)
+{
+    ast_t *ast = ast_new(ps, AST_SET, NULL, NULL);
+    if (!ast) return NULL;
+
+    charset_t set = {{0}};
+    int neg = *ps->p == '^';
+    if (neg) ps->p++;
+
+    // ] right after [ or [^ is literal
+    int first = 1;
+    while (*ps->p && (*ps->p != ']' || first) && !ps->err)
+    {
+        first = 0;
+
+        if (ps->p[0] == '[' && ps->p[1] == ':')
+        {
+            const char *end = strstr(ps->p + 2, ":]");
+            if (!end || add_named_class(&set, ps->p + 2, end - ps->p - 2))
+            {
+                ps->err = 1;
+                break;
+            }
+            ps->p = end + 2;
+            continue;
+        }
+
+        int lo = parse_class_char(ps, &set);
+        if (lo < 0) continue;
+
+        if (ps->p[0] == '-' && ps->p[1] && ps->p[1] != ']')
+        {
+            ps->p++;
+            int hi = parse_class_char(ps, &set);
+            if (hi < lo)
+            {
+                ps->err = 1;
+                break;
+            }
+            for (int b = lo; b <= hi; ++b)
+                cs_add(&set, b);
+        }
+        else cs_add(&set, lo);
+    }
+
+    if (*ps->p != ']') ps->err = 1;
+    else ps->p++;
+
+    for (int i = 0; i < 32; ++i)
+        ast->set.bits[i] = neg ? ~set.bits[i] : set.bits[i];
+    // lines are matched separately
+    ast->set.bits['\n' >> 3] &= ~(1 << ('\n' & 7));
+
+    return ast;
+}
+
+static ast_t* parse_alt(parser_t *ps);
+
+static ast_t* parse_atom(parser_t *ps)
+{
+    char c = *ps->p;
+    ast_t *ast;
+
+    switch (c)
+    {
+        case '(':
+            ps->p++;
+            ast = parse_alt(ps);
+            if (*ps->p != ')') ps->err = 1;
+            else ps->p++;
+            return ast;
+
+        case '[':
+            ps->p++;
+            return parse_class(ps);
+
+        case '^':
+            ps->p++;
+            return ast_new(ps, AST_BOL, NULL, NULL);
+
+        case '$':
+            ps->p++;
+            return ast_new(ps, AST_EOL, NULL, NULL);
+
+        case '*':
+        case '+':
+        case '?':
+            // nothing to repeat
+            ps->err = 1;
+            return NULL;
+    }
+
+    ast = ast_new(ps, AST_SET, NULL, NULL);
+    if (!ast) return NULL;
+    ps->p++;
+
+    if (c == '.')
+    {
+        for (int b = 0; b < 256; ++b)
+            if (b != '\n') cs_add(&ast->set, b);
+    }
+    else if (c == '\\')
+    {
+        c = *ps->p;
+        if (!c) ps->err = 1;
+        else
+        {
+            ps->p++;
+            if (!add_escape_class(&ast->set, c))
+                cs_add(&ast->set, escape_char(c));
+        }
+    }
+    else cs_add(&ast->set, (unsigned char) c);
+
+    return ast;
+}
+
+/**
+ * Parse {m}, {m,} or {m,n}.
+ * Returns 0 and leaves input unchanged if there is no valid bound.
+ */
+static int parse_bounds(parser_t *ps, int *min, int *max)
+{
+    const char *p = ps->p + 1;
+    if (!isdigit((unsigned char) *p)) return 0;
+
+    char *end;
+    long lo = strtol(p, &end, 10);
+    long hi = lo;
+    if (*end == ',')
+    {
+        p = end + 1;
+        if (*p == '}') hi = -1;
+        else
+        {
+            if (!isdigit((unsigned char) *p)) return 0;
+            hi = strtol(p, &end, 10);
+        }
+    }
+    if (hi < 0) end = (char*) p;
+    if (*end != '}') return 0;
+
+    if (lo > RE_MAX_REPEAT || hi > RE_MAX_REPEAT || (hi >= 0 && hi < lo))
+    {
+        ps->err = 1;
+        return 0;
+    }
+
+    *min = (int) lo;
+    *max = (int) hi;
+    ps->p = end + 1;
+    return 1;
+}
+
+static ast_t* parse_repeat(parser_t *ps)
+{
+    ast_t *ast = parse_atom(ps);
+
+    while (!ps->err)
+    {
+        int min, max;
+        char c = *ps->p;
+        if (c == '*') min = 0, max = -1;
+        else if (c == '+') min = 1, max = -1;
+        else if (c == '?') min = 0, max = 1;
+        else if (c != '{' || !parse_bounds(ps, &min, &max)) break;
+
+        if (c != '{') ps->p++;
+
+        ast = ast_new(ps, AST_REPEAT, ast, NULL);
+        if (!ast) break;
+        ast->min = min;
+        ast->max = max;
+    }
+
+    return ast;
+}
+
+static ast_t* parse_cat(parser_t *ps)
+{
+    ast_t *ast = NULL;
+
+    while (*ps->p && *ps->p != '|' && *ps->p != ')' && !ps->err)
+    {
+        ast_t *next = parse_repeat(ps);
+        if (ps->err)
+        {
+            ast_free(next);
+            break;
+        }
+        ast = ast ? ast_new(ps, AST_CAT, ast, next) : next;
+    }
+
+    if (!ast && !ps->err) ast = ast_new(ps, AST_EMPTY, NULL, NULL);
+    return ast;
+}
+
+static ast_t* parse_alt(parser_t *ps)
+{
+    ast_t *ast = parse_cat(ps);
+
+    while (*ps->p == '|' && !ps->err)
+    {
+        ps->p++;
+        ast_t *right = parse_cat(ps);
+        ast = ast_new(ps, AST_ALT, ast, right);
+    }
+
+    return ast;
+}
+
+/**
+ * Literal facts of a subexpression.
+ */
+typedef struct lit_info_t
+{
+    // every match equals exact
+    int is_exact;
+    char exact[RE_LIT_MAX];
+    size_t exact_len;
+    // every match starts with prefix and ends with suffix
+    char prefix[RE_LIT_MAX];
+    size_t prefix_len;
+    char suffix[RE_LIT_MAX];
+    size_t suffix_len;
+    // every match contains req
+    char req[RE_LIT_MAX];
+    size_t req_len;
+} lit_info_t;
+
+static void lit_best_req(lit_info_t *info, const char *s, size_t len)
+{
+    if (len <= info->req_len) return;
+    memcpy(info->req, s, len);
+    info->req_len = len;
+}
+
+static void lit_extract(const ast_t *ast, lit_info_t *info)
+{
+    memset(info, 0, sizeof *info);
+
+    switch (ast->type)
+    {
+        case AST_BOL:
+        case AST_EOL:
+        case AST_EMPTY:
+            info->is_exact = 1;
+            break;
+
+        case AST_SET:
+        {
+            int b = 0;
+            if (cs_count(&ast->set, &b) != 1) break;
+            info->is_exact = 1;
+            info->exact[0] = info->prefix[0] = info->suffix[0] = info->req[0] = (char) b;
+            info->exact_len = info->prefix_len = info->suffix_len = info->req_len = 1;
+            break;
+        }
+
+        case AST_CAT:
+        {
+            lit_info_t a, b;
+            lit_extract(ast->left, &a);
+            lit_extract(ast->right, &b);
+
+            // joined strings may be cut, any part of them stays required
+            char joined[2 * RE_LIT_MAX];
+
+            memcpy(joined, a.prefix, a.prefix_len);
+            size_t len = a.prefix_len;
+            if (a.is_exact)
+            {
+                memcpy(joined + len, b.prefix, b.prefix_len);
+                len += b.prefix_len;
+            }
+            info->prefix_len = len < RE_LIT_MAX ? len : RE_LIT_MAX;
+            memcpy(info->prefix, joined, info->prefix_len);
+
+            len = 0;
+            if (b.is_exact)
+            {
+                memcpy(joined, a.suffix, a.suffix_len);
+                len = a.suffix_len;
+            }
+            memcpy(joined + len, b.suffix, b.suffix_len);
+            len += b.suffix_len;
+            info->suffix_len = len < RE_LIT_MAX ? len : RE_LIT_MAX;
+            memcpy(info->suffix, joined + len - info->suffix_len, info->suffix_len);
+
+            if (a.is_exact && b.is_exact && a.exact_len + b.exact_len <= RE_LIT_MAX)
+            {
+                info->is_exact = 1;
+                memcpy(info->exact, a.exact, a.exact_len);
+                memcpy(info->exact + a.exact_len, b.exact, b.exact_len);
+                info->exact_len = a.exact_len + b.exact_len;
+            }
+
+            lit_best_req(info, a.req, a.req_len);
+            lit_best_req(info, b.req, b.req_len);
+            memcpy(joined, a.suffix, a.suffix_len);
+            memcpy(joined + a.suffix_len, b.prefix, b.prefix_len);
+            len = a.suffix_len + b.prefix_len;
+            lit_best_req(info, joined, len < RE_LIT_MAX ? len : RE_LIT_MAX);
+            lit_best_req(info, info->prefix, info->prefix_len);
+            lit_best_req(info, info->suffix, info->suffix_len);
+            break;
+        }
+
+        case AST_ALT:
+        {
+            lit_info_t a, b;
+            lit_extract(ast->left, &a);
+            lit_extract(ast->right, &b);
+
+            if (a.is_exact && b.is_exact && a.exact_len == b.exact_len
+                && !memcmp(a.exact, b.exact, a.exact_len))
+            {
+                *info = a;
+                break;
+            }
+
+            size_t n = 0;
+            while (n < a.prefix_len && n < b.prefix_len && a.prefix[n] == b.prefix[n]) n++;
+            memcpy(info->prefix, a.prefix, n);
+            info->prefix_len = n;
+
+            n = 0;
+            while (n < a.suffix_len && n < b.suffix_len
+                   && a.suffix[a.suffix_len - 1 - n] == b.suffix[b.suffix_len - 1 - n])
+                n++;
+            memcpy(info->suffix, a.suffix + a.suffix_len - n, n);
+            info->suffix_len = n;
+
+            lit_best_req(info, info->prefix, info->prefix_len);
+            lit_best_req(info, info->suffix, info->suffix_len);
+            break;
+        }
+
+        case AST_REPEAT:
+        {
+            if (!ast->max) info->is_exact = 1;
+            if (!ast->min) break;
+
+            lit_extract(ast->left, info);
+            if (ast->min != 1 || ast->max != 1) info->is_exact = 0;
+            break;
+        }
+    }
+}
+
+static int prog_node(re_prog_t *prog, nfa_type_t type, int out, int out1)
+{
+    if (prog->n_nodes == RE_MAX_NODES) return -1;
+
+    if (prog->n_nodes == prog->cap_nodes)
+    {
+        int cap = prog->cap_nodes ? 2 * prog->cap_nodes : 64;
+        nfa_node_t *nodes = realloc(prog->nodes, cap * sizeof *nodes);
+        if (!nodes) return -1;
+        prog->nodes = nodes;
+        prog->cap_nodes = cap;
+    }
+
+    int id = prog->n_nodes++;
+    prog->nodes[id].type = type;
+    prog->nodes[id].out = out;
+    prog->nodes[id].out1 = out1;
+    prog->nodes[id].set = -1;
+    return id;
+}
+
+static int prog_set(re_prog_t *prog, const charset_t *set)
+{
+    if (prog->n_sets == prog->cap_sets)
+    {
+        int cap = prog->cap_sets ? 2 * prog->cap_sets : 16;
+        charset_t *sets = realloc(prog->sets, cap * sizeof *sets);
+        if (!sets) return -1;
+        prog->sets = sets;
+        prog->cap_sets = cap;
+    }
+
+    prog->sets[prog->n_sets] = *set;
+    return prog->n_sets++;
+}
+
+/**
+ * Compile subexpression continuing with node next.
+ * Returns entry node or -1.
+ */
+static int compile(re_prog_t *prog, const ast_t *ast, int next)
+{
+    if (next < 0) return -1;
+
+    switch (ast->type)
+    {
+        case AST_EMPTY:
+            return next;
+
+        case AST_BOL:
+            return prog_node(prog, NFA_BOL, next, -1);
+
+        case AST_EOL:
+            return prog_node(prog, NFA_EOL, next, -1);
+
+        case AST_SET:
+        {
+            int set = prog_set(prog, &ast->set);
+            if (set < 0) return -1;
+            int id = prog_node(prog, NFA_SET, next, -1);
+            if (id >= 0) prog->nodes[id].set = set;
+            return id;
+        }
+
+        case AST_CAT:
+            return compile(prog, ast->left, compile(prog, ast->right, next));
+
+        case AST_ALT:
+        {
+            int a = compile(prog, ast->left, next);
+            int b = compile(prog, ast->right, next);
+            if (a < 0 || b < 0) return -1;
+            return prog_node(prog, NFA_SPLIT, a, b);
+        }
+
+        case AST_REPEAT:
+        {
+            int id = next;
+            if (ast->max < 0)
+            {
+                // loop back through split
+                id = prog_node(prog, NFA_SPLIT, -1, next);
+                if (id < 0) return -1;
+                int body = compile(prog, ast->left, id);
+                if (body < 0) return -1;
+                prog->nodes[id].out = body;
+            }
+            else
+            {
+                // optional copies, skipping any of them ends the repetition
+                for (int i = 0; i < ast->max - ast->min && id >= 0; ++i)
+                {
+                    int body = compile(prog, ast->left, id);
+                    if (body < 0) return -1;
+                    id = prog_node(prog, NFA_SPLIT, body, next);
+                }
+            }
+
+            for (int i = 0; i < ast->min && id >= 0; ++i)
+                id = compile(prog, ast->left, id);
+            return id;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Split bytes into classes not separated by any set.
+ */
+static void compute_classes(re_prog_t *prog)
+{
+    memset(prog->cls, 0, sizeof prog->cls);
+    prog->n_cls = 1;
+
+    for (int s = -1; s < prog->n_sets; ++s)
+    {
+        // class of (old class, membership), newline first
+        int remap[256][2];
+        for (int i = 0; i < 256; ++i)
+            remap[i][0] = remap[i][1] = -1;
+
+        int n = 0;
+        for (int b = 0; b < 256; ++b)
+        {
+            int in = s < 0 ? b == '\n' : cs_has(&prog->sets[s], b);
+            int *cls = &remap[prog->cls[b]][in];
+            if (*cls < 0) *cls = n++;
+            prog->cls[b] = *cls;
+        }
+        prog->n_cls = n;
+    }
+
+    for (int b = 255; b >= 0; --b)
+        prog->cls_rep[prog->cls[b]] = b;
+}
+
+re_prog_t* re_compile(const char *pattern)
+{
+    if (!pattern) return NULL;
+
+    parser_t ps = {
+        .p = pattern,
+        .err = 0,
+    };
+    ast_t *ast = parse_alt(&ps);
+    // unmatched )
+    if (*ps.p) ps.err = 1;
+    if (ps.err || !ast)
+    {
+        ast_free(ast);
+        return NULL;
+    }
+
+    re_prog_t *prog = calloc(1, sizeof *prog);
+    int err = !prog;
+
+    if (!err)
+    {
+        int match = prog_node(prog, NFA_MATCH, -1, -1);
+        prog->start = compile(prog, ast, match);
+        err = match < 0 || prog->start < 0;
+    }
+
+    if (!err)
+    {
+        compute_classes(prog);
+
+        lit_info_t info;
+        lit_extract(ast, &info);
+        memcpy(prog->literal, info.req, info.req_len);
+        prog->literal_len = info.req_len;
+    }
+
+    ast_free(ast);
+
+    if (err)
+    {
+        re_free(prog);
+        return NULL;
+    }
+
+    return prog;
+}
+
+void re_free(re_prog_t *prog)
+{
+    if (!prog) return;
+    free(prog->nodes);
+    free(prog->sets);
+    free(prog);
+}
+
+const char* re_literal(const re_prog_t *prog, size_t *len)
+{
+    *len = prog->literal_len;
+    return prog->literal;
+}
+
+static void cache_flush(dfa_cache_t *c)
+{
+    c->n_states = 0;
+    c->pool_size = 0;
+    for (size_t i = 0; i < c->hash_cap; ++i)
+        c->hash[i] = -1;
+    c->start[0] = c->start[1] = -1;
+    c->flushes++;
+}
+
+static int cache_init(dfa_cache_t *c, int anchored)
+{
+    memset(c, 0, sizeof *c);
+    c->anchored = anchored;
+    c->hash = malloc(HASH_INIT_CAP * sizeof *c->hash);
+    if (!c->hash) return -1;
+    c->hash_cap = HASH_INIT_CAP;
+    cache_flush(c);
+    return 0;
+}
+
+static void cache_free(dfa_cache_t *c)
+{
+    free(c->trans);
+    free(c->flags);
+    free(c->set_off);
+    free(c->set_len);
+    free(c->pool);
+    free(c->hash);
+}
+
+re_dfa_t* re_dfa_new(const re_prog_t *prog)
+{
+    if (!prog) return NULL;
+
+    re_dfa_t *dfa = calloc(1, sizeof *dfa);
+    if (!dfa) return NULL;
+    dfa->prog = prog;
+
+    int n = prog->n_nodes;
+    // every node expanded once, pushing at most two
+    dfa->stack = malloc((3 * n + 2) * sizeof *dfa->stack);
+    dfa->list = malloc(n * sizeof *dfa->list);
+    dfa->eol_list = malloc(n * sizeof *dfa->eol_list);
+    dfa->mark = calloc(n, sizeof *dfa->mark);
+
+    if (!dfa->stack || !dfa->list || !dfa->eol_list || !dfa->mark
+        || cache_init(&dfa->cache[0], 0) || cache_init(&dfa->cache[1], 1))
+    {
+        re_dfa_free(dfa);
+        return NULL;
+    }
+
+    return dfa;
+}
+
+void re_dfa_free(re_dfa_t *dfa)
+{
+    if (!dfa) return;
+    cache_free(&dfa->cache[0]);
+    cache_free(&dfa->cache[1]);
+    free(dfa->stack);
+    free(dfa->list);
+    free(dfa->eol_list);
+    free(dfa->mark);
+    free(dfa);
+}
+
+/**
+ * Add nodes reachable from node without consuming input.
+ * Nodes already marked in this generation are skipped.
+ */
+static void closure_add(re_dfa_t *dfa, int node, int bol, int eol, int *list, int *n)
+{
+    const nfa_node_t *nodes = dfa->prog->nodes;
+    int top = 0;
+    dfa->stack[top++] = node;
+
+    while (top)
+    {
+        int s = dfa->stack[--top];
+        if (dfa->mark[s] == dfa->gen) continue;
+        dfa->mark[s] = dfa->gen;
+
+        switch (nodes[s].type)
+        {
+            case NFA_SPLIT:
+                dfa->stack[top++] = nodes[s].out1;
+                dfa->stack[top++] = nodes[s].out;
+                break;
+
+            case NFA_BOL:
+                if (bol) dfa->stack[top++] = nodes[s].out;
+                break;
+
+            case NFA_EOL:
+                // kept until the end of line is known
+                if (eol) dfa->stack[top++] = nodes[s].out;
+                else list[(*n)++] = s;
+                break;
+
+            case NFA_SET:
+            case NFA_MATCH:
+                list[(*n)++] = s;
+                break;
+        }
+    }
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    return *(const int*) a - *(const int*) b;
+}
+
+static size_t hash_set(const int *set, int n)
+{
+    size_t h = 14695981039346656037ull;
+    for (int i = 0; i < n; ++i)
+    {
+        h ^= (unsigned) set[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static int cache_rehash(dfa_cache_t *c)
+{
+    size_t cap = 2 * c->hash_cap;
+    int *hash = malloc(cap * sizeof *hash);
+    if (!hash) return -1;
+    for (size_t i = 0; i < cap; ++i)
+        hash[i] = -1;
+
+    for (int s = 0; s < c->n_states; ++s)
+    {
+        size_t h = hash_set(c->pool + c->set_off[s], c->set_len[s]) & (cap - 1);
+        while (hash[h] >= 0) h = (h + 1) & (cap - 1);
+        hash[h] = s;
+    }
+
+    free(c->hash);
+    c->hash = hash;
+    c->hash_cap = cap;
+    return 0;
+}
+
+static int cache_grow(dfa_cache_t *c, int n_cls)
+{
+    int cap = c->cap_states ? 2 * c->cap_states : 64;
+
+    int *trans = realloc(c->trans, (size_t) cap * n_cls * sizeof *trans);
+    if (!trans) return -1;
+    c->trans = trans;
+    unsigned char *flags = realloc(c->flags, cap * sizeof *flags);
+    if (!flags) return -1;
+    c->flags = flags;
+    size_t *set_off = realloc(c->set_off, cap * sizeof *set_off);
+    if (!set_off) return -1;
+    c->set_off = set_off;
+    int *set_len = realloc(c->set_len, cap * sizeof *set_len);
+    if (!set_len) return -1;
+    c->set_len = set_len;
+
+    c->cap_states = cap;
+    return 0;
+}
+
+/**
+ * Find or add state for node set in dfa->list.
+ * Returns state index or -1.
+ */
+static int cache_state(re_dfa_t *dfa, dfa_cache_t *c, int n)
+{
+    const re_prog_t *prog = dfa->prog;
+    int *set = dfa->list;
+    qsort(set, n, sizeof *set, compare_ints);
+
+    size_t h = hash_set(set, n);
+    for (size_t i = h & (c->hash_cap - 1); c->hash[i] >= 0; i = (i + 1) & (c->hash_cap - 1))
+    {
+        int s = c->hash[i];
+        if (c->set_len[s] == n && !memcmp(c->pool + c->set_off[s], set, n * sizeof *set))
+            return s;
+    }
+
+    if (c->n_states == RE_DFA_MAX_STATES) cache_flush(c);
+    if (c->n_states == c->cap_states && cache_grow(c, prog->n_cls)) return -1;
+    if (2 * (c->n_states + 1) > (int) c->hash_cap && cache_rehash(c)) return -1;
+
+    if (c->pool_size + n > c->pool_cap)
+    {
+        size_t cap = c->pool_cap ? 2 * c->pool_cap : 1024;
+        while (cap < c->pool_size + n) cap *= 2;
+        int *pool = realloc(c->pool, cap * sizeof *pool);
+        if (!pool) return -1;
+        c->pool = pool;
+        c->pool_cap = cap;
+    }
+
+    int s = c->n_states++;
+    c->set_off[s] = c->pool_size;
+    c->set_len[s] = n;
+    memcpy(c->pool + c->pool_size, set, n * sizeof *set);
+    c->pool_size += n;
+
+    for (int i = 0; i < prog->n_cls; ++i)
+        c->trans[(size_t) s * prog->n_cls + i] = -1;
+
+    // match at the end of line through pending $
+    unsigned char flags = n ? 0 : DFA_DEAD;
+    int n_eol = 0;
+    dfa->gen++;
+    for (int i = 0; i < n; ++i)
+    {
+        const nfa_node_t *node = &prog->nodes[set[i]];
+        if (node->type == NFA_MATCH) flags |= DFA_MATCH | DFA_EOL_MATCH;
+        else if (node->type == NFA_EOL)
+            closure_add(dfa, node->out, 0, 1, dfa->eol_list, &n_eol);
+    }
+    for (int i = 0; i < n_eol; ++i)
+        if (prog->nodes[dfa->eol_list[i]].type == NFA_MATCH) flags |= DFA_EOL_MATCH;
+    c->flags[s] = flags;
+
+    size_t i = h & (c->hash_cap - 1);
+    while (c->hash[i] >= 0) i = (i + 1) & (c->hash_cap - 1);
+    c->hash[i] = s;
+
+    return s;
+}
+
+static int dfa_start(re_dfa_t *dfa, dfa_cache_t *c, int bol)
+{
+    if (c->start[bol] >= 0) return c->start[bol];
+
+    int n = 0;
+    dfa->gen++;
+    closure_add(dfa, dfa->prog->start, bol, 0, dfa->list, &n);
+    int s = cache_state(dfa, c, n);
+    if (s >= 0) c->start[bol] = s;
+    return s;
+}
+
+/**
+ * Build transition missing from the cache.
+ * Returns encoded transition or -1.
+ */
+static int dfa_build(re_dfa_t *dfa, dfa_cache_t *c, int s, int cls)
+{
+    const re_prog_t *prog = dfa->prog;
+    int n = 0;
+    int byte = prog->cls_rep[cls];
+    const int *set = c->pool + c->set_off[s];
+    dfa->gen++;
+    for (int i = 0; i < c->set_len[s]; ++i)
+    {
+        const nfa_node_t *node = &prog->nodes[set[i]];
+        if (node->type == NFA_SET && cs_has(&prog->sets[node->set], byte))
+            closure_add(dfa, node->out, 0, 0, dfa->list, &n);
+    }
+    // search may start at any later position
+    if (!c->anchored)
+        closure_add(dfa, prog->start, 0, 0, dfa->list, &n);
+
+    unsigned long flushes = c->flushes;
+    int next = cache_state(dfa, c, n);
+    if (next < 0) return -1;
+
+    int trans = next * prog->n_cls << 1 | (c->flags[next] & DFA_MATCH);
+    // s is gone after flush
+    if (flushes == c->flushes)
+        c->trans[(size_t) s * prog->n_cls + cls] = trans;
+
+    return trans;
+}
+
+/**
+ * Get encoded transition, row of next state in the table
+ * shifted left by one with DFA_MATCH in the lowest bit.
+ */
+static inline int dfa_next(re_dfa_t *dfa, dfa_cache_t *c, int s, int cls)
+{
+    int trans = c->trans[(size_t) s * dfa->prog->n_cls + cls];
+    return trans >= 0 ? trans : dfa_build(dfa, c, s, cls);
+}
+
+/**
+ * Check if line part may contain a match.
+ */
+static int line_has_match(re_dfa_t *dfa, const unsigned char *data, size_t pos, size_t end)
+{
+    dfa_cache_t *c = &dfa->cache[0];
+    const unsigned char *cls = dfa->prog->cls;
+    size_t n_cls = dfa->prog->n_cls;
+
+    int s = dfa_start(dfa, c, !pos || data[pos - 1] == '\n');
+    if (s < 0) return -1;
+    if (c->flags[s] & DFA_MATCH) return 1;
+
+    // rows save a multiplication on the critical path,
+    // table moves only when a transition is built
+    const int *table = c->trans;
+    size_t row = s * n_cls;
+    for (size_t i = pos; i < end; ++i)
+    {
+        int trans = table[row + cls[data[i]]];
+        if (trans < 0)
+        {
+            trans = dfa_build(dfa, c, row / n_cls, cls[data[i]]);
+            if (trans < 0) return -1;
+            table = c->trans;
+        }
+        if (trans & DFA_MATCH) return 1;
+        row = trans >> 1;
+    }
+
+    return c->flags[row / n_cls] & DFA_EOL_MATCH ? 1 : 0;
+}
+
+/**
+ * Find end of longest match starting at pos.
+ */
+static int longest_at(re_dfa_t *dfa, const unsigned char *data, size_t pos, size_t end, size_t *match_end)
+{
+    dfa_cache_t *c = &dfa->cache[1];
+    const unsigned char *cls = dfa->prog->cls;
+    int found = 0;
+
+    int s = dfa_start(dfa, c, !pos || data[pos - 1] == '\n');
+    if (s < 0) return -1;
+
+    size_t i = pos;
+    for (;;)
+    {
+        if (c->flags[s] & DFA_DEAD) return found;
+        if (c->flags[s] & DFA_MATCH)
+        {
+            found = 1;
+            *match_end = i;
+        }
+        if (i == end) break;
+
+        int trans = dfa_next(dfa, c, s, cls[data[i++]]);
+        if (trans < 0) return -1;
+        s = (trans >> 1) / dfa->prog->n_cls;
+    }
+
+    if (c->flags[s] & DFA_EOL_MATCH)
+    {
+        found = 1;
+        *match_end = end;
+    }
+
+    return found;
+}
+
+int re_find(re_dfa_t *dfa, const char *buf, size_t len, size_t from, size_t *start, size_t *end)
+{
+    if (!dfa || !buf || !start || !end) return -1;
+
+    const unsigned char *data = (const unsigned char*) buf;
+    size_t pos = from;
+
+    while (pos < len)
+    {
+        const unsigned char *nl = memchr(data + pos, '\n', len - pos);
+        size_t line_end = nl ? (size_t) (nl - data) : len;
+
+        int res = line_has_match(dfa, data, pos, line_end);
+        if (res < 0) return -1;
+
+        // leftmost start with non-empty match
+        for (size_t p = pos; res && p < line_end; ++p)
+        {
+            size_t e;
+            int found = longest_at(dfa, data, p, line_end, &e);
+            if (found < 0) return -1;
+            if (found && e > p)
+            {
+                *start = p;
+                *end = e;
+                return 1;
+            }
+        }
+
+        pos = line_end + 1;
+    }
+
+    return 0;
+}
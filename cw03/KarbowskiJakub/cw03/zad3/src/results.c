@@ -0,0 +1,497 @@
+#define _GNU_SOURCE
+#include "results.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#define READ_BUF_SIZE (1024 * 1024)
+
+/**
+ * Header of data written to the pipe at once.
+ * Whole chunk fits PIPE_BUF, so the write is atomic.
+ */
+typedef struct chunk_hdr_t
+{
+    uint32_t len;
+    // last record continues in the next chunk of the same writer
+    uint32_t more;
+    int64_t writer;
+} chunk_hdr_t;
+
+#define CHUNK_DATA_MAX (PIPE_BUF - sizeof(chunk_hdr_t))
+
+/**
+ * Match as sent through the pipe, followed by path.
+ */
+typedef struct record_t
+{
+    int64_t line;
+    int64_t col;
+    int32_t pat;
+    uint32_t path_len;
+} record_t;
+
+/**
+ * Match kept for sorted output.
+ */
+typedef struct entry_t
+{
+    int64_t line;
+    int64_t col;
+    int32_t pat;
+    uint32_t path_len;
+    size_t path_off;
+} entry_t;
+
+/**
+ * Record split across chunks, collected until complete.
+ */
+typedef struct partial_t
+{
+    int64_t writer;
+    char *data;
+    size_t len;
+} partial_t;
+
+/**
+ * Result counter in memory shared by all processes.
+ */
+typedef struct limit_t
+{
+    long count;
+    long max;
+} limit_t;
+
+typedef struct aggregator_t
+{
+    const char *const *patterns;
+    int sorted;
+
+    entry_t *entries;
+    size_t n_entries;
+    size_t cap_entries;
+    char *paths;
+    size_t paths_len;
+    size_t paths_cap;
+
+    partial_t *partials;
+    int n_partials;
+} aggregator_t;
+
+// write end of the pipe, inherited by all workers
+static int RESULTS_FD = -1;
+// NULL if results are not limited
+static limit_t *LIMIT = NULL;
+
+// chunks waiting to be sent, writer ids are filled when sent
+static __thread char *BUF = NULL;
+static __thread size_t BUF_LEN = 0;
+// offset of the last chunk in BUF, -1 if none
+static __thread long CHUNK = -1;
+
+static int write_all(int fd, const char *data, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int results_flush(void)
+{
+    int err = 0;
+    int64_t writer = gettid();
+
+    for (size_t off = 0; off < BUF_LEN;)
+    {
+        chunk_hdr_t hdr;
+        memcpy(&hdr, BUF + off, sizeof hdr);
+        hdr.writer = writer;
+        memcpy(BUF + off, &hdr, sizeof hdr);
+
+        if (!err) err = write_all(RESULTS_FD, BUF + off, sizeof hdr + hdr.len);
+        off += sizeof hdr + hdr.len;
+    }
+
+    BUF_LEN = 0;
+    CHUNK = -1;
+    return err;
+}
+
+void results_thread_free(void)
+{
+    free(BUF);
+    BUF = NULL;
+    BUF_LEN = 0;
+    CHUNK = -1;
+}
+
+/**
+ * Send record larger than a chunk in pieces.
+ */
+static int send_split(const record_t *rec, const char *path)
+{
+    if (results_flush()) return -1;
+
+    size_t len = sizeof *rec + rec->path_len;
+    char *data = malloc(len);
+    if (!data) return -1;
+    memcpy(data, rec, sizeof *rec);
+    memcpy(data + sizeof *rec, path, rec->path_len);
+
+    int err = 0;
+    char chunk[PIPE_BUF];
+    for (size_t off = 0; off < len && !err;)
+    {
+        size_t n = len - off < CHUNK_DATA_MAX ? len - off : CHUNK_DATA_MAX;
+        chunk_hdr_t hdr = {
+            .len = n,
+            .more = off + n < len,
+            .writer = gettid(),
+        };
+        memcpy(chunk, &hdr, sizeof hdr);
+        memcpy(chunk + sizeof hdr, data + off, n);
+        err = write_all(RESULTS_FD, chunk, sizeof hdr + n);
+        off += n;
+    }
+
+    free(data);
+    return err;
+}
+
+int results_done(void)
+{
+    return LIMIT && __atomic_load_n(&LIMIT->count, __ATOMIC_RELAXED) >= LIMIT->max;
+}
+
+int results_add(const char *path, long long line, long long col, int pat)
+{
+    if (RESULTS_FD < 0 || !path) return -1;
+
+    // every accepted match takes one slot, late ones get none
+    if (LIMIT && __atomic_fetch_add(&LIMIT->count, 1, __ATOMIC_RELAXED) >= LIMIT->max)
+        return 1;
+
+    if (!BUF)
+    {
+        BUF = malloc(RESULTS_BUF_SIZE);
+        if (!BUF) return -1;
+    }
+
+    record_t rec = {
+        .line = line,
+        .col = col,
+        .pat = pat,
+        .path_len = strlen(path),
+    };
+    size_t rec_len = sizeof rec + rec.path_len;
+    if (rec_len > CHUNK_DATA_MAX) return send_split(&rec, path);
+
+    chunk_hdr_t hdr;
+    if (BUF_LEN + rec_len > RESULTS_BUF_SIZE && results_flush()) return -1;
+    if (CHUNK >= 0) memcpy(&hdr, BUF + CHUNK, sizeof hdr);
+
+    // chunks hold whole records
+    if (CHUNK < 0 || hdr.len + rec_len > CHUNK_DATA_MAX)
+    {
+        if (BUF_LEN + sizeof hdr + rec_len > RESULTS_BUF_SIZE && results_flush())
+            return -1;
+
+        CHUNK = BUF_LEN;
+        hdr.len = 0;
+        hdr.more = 0;
+        hdr.writer = 0;
+        BUF_LEN += sizeof hdr;
+    }
+
+    memcpy(BUF + BUF_LEN, &rec, sizeof rec);
+    memcpy(BUF + BUF_LEN + sizeof rec, path, rec.path_len);
+    BUF_LEN += rec_len;
+
+    hdr.len += rec_len;
+    memcpy(BUF + CHUNK, &hdr, sizeof hdr);
+
+    return 0;
+}
+
+static int store_entry(aggregator_t *agg, const record_t *rec, const char *path)
+{
+    if (agg->n_entries == agg->cap_entries)
+    {
+        size_t cap = agg->cap_entries ? 2 * agg->cap_entries : 1024;
+        entry_t *entries = realloc(agg->entries, cap * sizeof *entries);
+        if (!entries) return -1;
+        agg->entries = entries;
+        agg->cap_entries = cap;
+    }
+
+    if (agg->paths_len + rec->path_len > agg->paths_cap)
+    {
+        size_t cap = agg->paths_cap ? 2 * agg->paths_cap : 64 * 1024;
+        while (cap < agg->paths_len + rec->path_len) cap *= 2;
+        char *paths = realloc(agg->paths, cap);
+        if (!paths) return -1;
+        agg->paths = paths;
+        agg->paths_cap = cap;
+    }
+
+    entry_t *ent = &agg->entries[agg->n_entries++];
+    ent->line = rec->line;
+    ent->col = rec->col;
+    ent->pat = rec->pat;
+    ent->path_len = rec->path_len;
+    ent->path_off = agg->paths_len;
+    memcpy(agg->paths + agg->paths_len, path, rec->path_len);
+    agg->paths_len += rec->path_len;
+
+    return 0;
+}
+
+static void print_line(const aggregator_t *agg, int64_t writer, int64_t line, int64_t col,
+                       int pat, const char *path, size_t path_len)
+{
+    // writers differ between runs, sorted output is kept deterministic
+    if (!agg->sorted) printf("(PID %lld) ", (long long) writer);
+    printf("%.*s:%lld:%lld", (int) path_len, path, (long long) line, (long long) col);
+    if (agg->patterns)
+    {
+        putchar(':');
+        fputs(agg->patterns[pat], stdout);
+    }
+    putchar('\n');
+}
+
+/**
+ * Print or store all records of complete data.
+ */
+static int process_records(aggregator_t *agg, int64_t writer, const char *data, size_t len)
+{
+    size_t off = 0;
+    while (off < len)
+    {
+        record_t rec;
+        if (len - off < sizeof rec) return -1;
+        memcpy(&rec, data + off, sizeof rec);
+        off += sizeof rec;
+        if (len - off < rec.path_len) return -1;
+
+        const char *path = data + off;
+        off += rec.path_len;
+
+        if (agg->sorted)
+        {
+            if (store_entry(agg, &rec, path)) return -1;
+        }
+        else print_line(agg, writer, rec.line, rec.col, rec.pat, path, rec.path_len);
+    }
+
+    return 0;
+}
+
+static int process_chunk(aggregator_t *agg, const chunk_hdr_t *hdr, const char *data)
+{
+    int i = 0;
+    while (i < agg->n_partials && agg->partials[i].writer != hdr->writer) ++i;
+
+    if (i == agg->n_partials)
+    {
+        if (!hdr->more) return process_records(agg, hdr->writer, data, hdr->len);
+
+        partial_t *partials = realloc(agg->partials, (i + 1) * sizeof *partials);
+        if (!partials) return -1;
+        agg->partials = partials;
+        agg->partials[i].writer = hdr->writer;
+        agg->partials[i].data = NULL;
+        agg->partials[i].len = 0;
+        agg->n_partials++;
+    }
+
+    partial_t *p = &agg->partials[i];
+    char *pdata = realloc(p->data, p->len + hdr->len);
+    if (!pdata) return -1;
+    p->data = pdata;
+    memcpy(p->data + p->len, data, hdr->len);
+    p->len += hdr->len;
+    if (hdr->more) return 0;
+
+    int err = process_records(agg, hdr->writer, p->data, p->len);
+    free(p->data);
+    *p = agg->partials[--agg->n_partials];
+
+    return err;
+}
+
+/**
+ * Read chunks until all writers close the pipe.
+ */
+static int aggregate(aggregator_t *agg, int fd)
+{
+    char *buf = malloc(READ_BUF_SIZE);
+    if (!buf) return -1;
+
+    int err = 0;
+    size_t have = 0;
+
+    for (;;)
+    {
+        ssize_t n = read(fd, buf + have, READ_BUF_SIZE - have);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            err = -1;
+            break;
+        }
+        if (!n) break;
+
+        // drained so that writers are not blocked
+        if (err) continue;
+        have += n;
+
+        size_t off = 0;
+        while (!err && have - off >= sizeof(chunk_hdr_t))
+        {
+            chunk_hdr_t hdr;
+            memcpy(&hdr, buf + off, sizeof hdr);
+            if (hdr.len > CHUNK_DATA_MAX)
+            {
+                err = -1;
+                break;
+            }
+            if (have - off < sizeof hdr + hdr.len) break;
+
+            err = process_chunk(agg, &hdr, buf + off + sizeof hdr);
+            off += sizeof hdr + hdr.len;
+        }
+        memmove(buf, buf + off, have - off);
+        have -= off;
+    }
+
+    // writer died in the middle of a chunk or record
+    if (have || agg->n_partials) err = -1;
+
+    free(buf);
+    return err;
+}
+
+static int compare_entries(const void *a, const void *b, void *arg)
+{
+    const entry_t *x = a, *y = b;
+    const char *paths = arg;
+
+    size_t len = x->path_len < y->path_len ? x->path_len : y->path_len;
+    int cmp = memcmp(paths + x->path_off, paths + y->path_off, len);
+    if (cmp) return cmp;
+    if (x->path_len != y->path_len) return x->path_len < y->path_len ? -1 : 1;
+    if (x->line != y->line) return x->line < y->line ? -1 : 1;
+    if (x->col != y->col) return x->col < y->col ? -1 : 1;
+    return x->pat - y->pat;
+}
+
+static void print_sorted(aggregator_t *agg)
+{
+    qsort_r(agg->entries, agg->n_entries, sizeof *agg->entries, compare_entries, agg->paths);
+
+    for (size_t i = 0; i < agg->n_entries; ++i)
+    {
+        const entry_t *ent = &agg->entries[i];
+        print_line(agg, 0, ent->line, ent->col, ent->pat,
+                   agg->paths + ent->path_off, ent->path_len);
+    }
+}
+
+int results_run(int (*search)(void *arg), void *arg, const char *const patterns[], int sorted,
+                long max_count)
+{
+    if (!search || max_count < 0) return -1;
+
+    if (max_count)
+    {
+        LIMIT = mmap(NULL, sizeof *LIMIT, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (LIMIT == MAP_FAILED)
+        {
+            LIMIT = NULL;
+            return -1;
+        }
+        LIMIT->count = 0;
+        LIMIT->max = max_count;
+    }
+
+    int fds[2];
+    pid_t pid = -1;
+    if (!pipe(fds))
+    {
+        fflush(stdout);
+        pid = fork();
+        if (pid < 0)
+        {
+            close(fds[0]);
+            close(fds[1]);
+        }
+    }
+
+    if (pid < 0)
+    {
+        if (LIMIT) munmap(LIMIT, sizeof *LIMIT);
+        LIMIT = NULL;
+        return -1;
+    }
+
+    if (!pid)
+    {
+        close(fds[0]);
+        RESULTS_FD = fds[1];
+
+        int err = search(arg);
+        if (results_flush()) err = -1;
+        results_thread_free();
+        exit(err ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+
+    // batch output unless someone is watching
+    if (!isatty(STDOUT_FILENO))
+        setvbuf(stdout, NULL, _IOFBF, RESULTS_OUT_BUF_SIZE);
+
+    aggregator_t agg = {
+        .patterns = patterns,
+        .sorted = sorted,
+    };
+    int err = aggregate(&agg, fds[0]);
+    close(fds[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+        err = -1;
+
+    // results found before an error are printed too
+    if (sorted) print_sorted(&agg);
+    if (fflush(stdout)) err = -1;
+
+    for (int i = 0; i < agg.n_partials; ++i)
+        free(agg.partials[i].data);
+    free(agg.partials);
+    free(agg.entries);
+    free(agg.paths);
+
+    if (LIMIT) munmap(LIMIT, sizeof *LIMIT);
+    LIMIT = NULL;
+
+    return err;
+}
@@ -0,0 +1,421 @@
+#define _GNU_SOURCE
+#include "searchfile.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "textdetect.h"
+#include "strsearch.h"
+#include "rematch.h"
+#include "results.h"
+
+#define MATCHES_INIT_CAP (64)
+
+/**
+ * Match of one of many patterns.
+ */
+typedef struct match_t
+{
+    size_t start;
+    int pat;
+} match_t;
+
+typedef struct match_list_t
+{
+    const search_query_t *query;
+    match_t *items;
+    size_t size;
+    size_t cap;
+} match_list_t;
+
+/**
+ * Output of matches reported as found.
+ */
+typedef struct match_printer_t
+{
+    const char *path;
+    line_counter_t lc;
+} match_printer_t;
+
+// lazy DFAs of the calling thread, one per regex of DFA_QUERY
+static __thread const search_query_t *DFA_QUERY = NULL;
+static __thread re_dfa_t **DFAS = NULL;
+// contents of the file being searched, reused by the calling thread
+static __thread char *FILE_BUF = NULL;
+static __thread size_t FILE_BUF_CAP = 0;
+
+int search_query_init(search_query_t *query, const char *const patterns[], int n_patterns, int regex)
+{
+    if (!query || !patterns || n_patterns < 1) return -1;
+
+    query->patterns = patterns;
+    query->n_patterns = n_patterns;
+    query->ac = NULL;
+    query->progs = NULL;
+    query->index = NULL;
+    query->pattern_lens = malloc(n_patterns * sizeof *query->pattern_lens);
+    if (!query->pattern_lens) return -1;
+
+    for (int i = 0; i < n_patterns; ++i)
+    {
+        query->pattern_lens[i] = patterns[i] ? strlen(patterns[i]) : 0;
+        if (!query->pattern_lens[i])
+        {
+            search_query_free(query);
+            return -1;
+        }
+    }
+
+    if (regex)
+    {
+        query->progs = calloc(n_patterns, sizeof *query->progs);
+        if (!query->progs)
+        {
+            search_query_free(query);
+            return -1;
+        }
+
+        for (int i = 0; i < n_patterns; ++i)
+        {
+            query->progs[i] = re_compile(patterns[i]);
+            if (!query->progs[i])
+            {
+                search_query_free(query);
+                return -1;
+            }
+        }
+    }
+    else if (n_patterns > 1)
+    {
+        query->ac = ac_build(patterns, query->pattern_lens, n_patterns);
+        if (!query->ac)
+        {
+            search_query_free(query);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void search_query_free(search_query_t *query)
+{
+    if (!query) return;
+
+    free(query->pattern_lens);
+    query->pattern_lens = NULL;
+    ac_free(query->ac);
+    query->ac = NULL;
+
+    if (query->progs)
+    {
+        for (int i = 0; i < query->n_patterns; ++i)
+            re_free(query->progs[i]);
+        free(query->progs);
+        query->progs = NULL;
+    }
+}
+
+long search_query_set_index(search_query_t *query, tg_index_t *index)
+{
+    if (!query || !index) return -1;
+
+    const char **lits = malloc(query->n_patterns * sizeof *lits);
+    size_t *lens = malloc(query->n_patterns * sizeof *lens);
+    long count = -1;
+
+    if (lits && lens)
+    {
+        for (int i = 0; i < query->n_patterns; ++i)
+        {
+            if (query->progs) lits[i] = re_literal(query->progs[i], &lens[i]);
+            else
+            {
+                lits[i] = query->patterns[i];
+                lens[i] = query->pattern_lens[i];
+            }
+        }
+        count = tg_select(index, lits, lens, query->n_patterns);
+    }
+
+    free(lits);
+    free(lens);
+    if (count >= 0) query->index = index;
+    return count;
+}
+
+/**
+ * Free DFAs of the calling thread.
+ */
+static void dfas_free(void)
+{
+    if (DFAS)
+    {
+        for (int i = 0; i < DFA_QUERY->n_patterns; ++i)
+            re_dfa_free(DFAS[i]);
+        free(DFAS);
+    }
+    DFAS = NULL;
+    DFA_QUERY = NULL;
+}
+
+void search_thread_free(void)
+{
+    dfas_free();
+
+    free(FILE_BUF);
+    FILE_BUF = NULL;
+    FILE_BUF_CAP = 0;
+
+    text_detect_clear();
+    results_thread_free();
+}
+
+/**
+ * Get DFA of pattern for the calling thread.
+ */
+static re_dfa_t* thread_dfa(const search_query_t *query, int pat)
+{
+    if (DFA_QUERY != query)
+    {
+        // file being searched and unsent results are kept
+        dfas_free();
+        DFAS = calloc(query->n_patterns, sizeof *DFAS);
+        if (!DFAS) return NULL;
+        DFA_QUERY = query;
+    }
+
+    if (!DFAS[pat]) DFAS[pat] = re_dfa_new(query->progs[pat]);
+    return DFAS[pat];
+}
+
+static int report_match(const char path[], line_counter_t *lc, size_t pos, int pat)
+{
+    long long line_num, col_num;
+    line_counter_get(lc, pos, &line_num, &col_num);
+    return results_add(path, line_num, col_num, pat);
+}
+
+static int add_match(match_list_t *list, size_t start, int pat)
+{
+    if (list->size == list->cap)
+    {
+        size_t cap = list->cap ? 2 * list->cap : MATCHES_INIT_CAP;
+        match_t *items = realloc(list->items, cap * sizeof *items);
+        if (!items) return -1;
+        list->items = items;
+        list->cap = cap;
+    }
+
+    list->items[list->size].start = start;
+    list->items[list->size].pat = pat;
+    list->size++;
+
+    return 0;
+}
+
+static int collect_match(size_t end, int pat, void *arg)
+{
+    match_list_t *list = arg;
+    return add_match(list, end - list->query->pattern_lens[pat], pat);
+}
+
+static int collect_regex_match(size_t start, int pat, void *arg)
+{
+    return add_match(arg, start, pat);
+}
+
+static int report_regex_match(size_t start, int pat, void *arg)
+{
+    match_printer_t *out = arg;
+    return report_match(out->path, &out->lc, start, pat);
+}
+
+/**
+ * Report non-overlapping matches of one regex in order.
+ * Only lines containing the required literal are run through the DFA.
+ */
+static int scan_regex(const search_query_t *query, int pat, const char *data, size_t len,
+                      int (*cb)(size_t start, int pat, void *arg), void *arg)
+{
+    re_dfa_t *dfa = thread_dfa(query, pat);
+    if (!dfa) return -1;
+
+    size_t lit_len;
+    const char *lit = re_literal(query->progs[pat], &lit_len);
+
+    size_t pos = 0;
+    while (pos < len)
+    {
+        size_t region_end = len;
+        if (lit_len)
+        {
+            const char *cand = str_find(data + pos, len - pos, lit, lit_len);
+            if (!cand) break;
+
+            // pos is at a line start, region is the line with candidate
+            const char *line = memrchr(data + pos, '\n', cand - (data + pos));
+            if (line) pos = line + 1 - data;
+            const char *line_end = memchr(cand, '\n', data + len - cand);
+            region_end = line_end ? (size_t) (line_end - data) : len;
+        }
+
+        size_t start, end;
+        int res;
+        while ((res = re_find(dfa, data, region_end, pos, &start, &end)) > 0)
+        {
+            int ret = cb(start, pat, arg);
+            if (ret) return ret;
+            pos = end;
+        }
+        if (res < 0) return -1;
+
+        pos = region_end + 1;
+    }
+
+    return 0;
+}
+
+static int compare_matches(const void *a, const void *b)
+{
+    const match_t *x = a, *y = b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->pat - y->pat;
+}
+
+/**
+ * Report matches of all patterns ordered by position.
+ */
+static int search_many(const char path[], const char *data, size_t len, const search_query_t *query)
+{
+    match_list_t list = {
+        .query = query,
+    };
+
+    int err = 0;
+    if (query->progs)
+    {
+        for (int i = 0; i < query->n_patterns && !err; ++i)
+            err = scan_regex(query, i, data, len, collect_regex_match, &list) ? -1 : 0;
+    }
+    else err = ac_scan(query->ac, data, len, collect_match, &list) ? -1 : 0;
+
+    if (!err)
+    {
+        // ordered by end or by pattern, printed by start
+        qsort(list.items, list.size, sizeof *list.items, compare_matches);
+
+        line_counter_t lc;
+        line_counter_init(&lc, data);
+        for (size_t i = 0; i < list.size && !err; ++i)
+            err = report_match(path, &lc, list.items[i].start, list.items[i].pat);
+    }
+
+    free(list.items);
+    return err;
+}
+
+static int search_one(const char path[], const char *data, size_t len, const search_query_t *query)
+{
+    const char *pattern = query->patterns[0];
+    size_t pat_len = query->pattern_lens[0];
+    line_counter_t lc;
+    line_counter_init(&lc, data);
+
+    const char *p = data;
+    for (;;)
+    {
+        const char *match = str_find(p, data + len - p, pattern, pat_len);
+        if (!match) break;
+
+        int ret = report_match(path, &lc, match - data, 0);
+        if (ret) return ret;
+
+        // overlapping matches
+        p = match + 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Read open file into the thread buffer.
+ * File is read up to where it ends now,
+ * it may have changed since the walker's lstat.
+ *
+ * @return Number of bytes read or negative error.
+ */
+static ssize_t read_file(int fd, const char **data)
+{
+    struct stat st;
+    if (fstat(fd, &st)) return -1;
+
+    size_t size = st.st_size;
+    if (size > FILE_BUF_CAP)
+    {
+        char *buf = realloc(FILE_BUF, size);
+        if (!buf) return -1;
+        FILE_BUF = buf;
+        FILE_BUF_CAP = size;
+    }
+
+    size_t len = 0;
+    while (len < size)
+    {
+        ssize_t n = pread(fd, FILE_BUF + len, size - len, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        // shrunk since fstat
+        if (!n) break;
+        len += n;
+    }
+
+    *data = FILE_BUF;
+    return len;
+}
+
+int search_file(const char path[], const struct stat *st, size_t root_path_len, const search_query_t *query)
+{
+    // only regular files, symbolic links are not followed
+    if (!S_ISREG(st->st_mode)) return 0;
+
+    const char *rel_path = path + root_path_len + 1;
+    // root itself is never indexed
+    if (query->index && path[root_path_len] && !tg_may_match(query->index, rel_path, st))
+        return 0;
+
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (fd < 0) return -1;
+
+    int text = text_detect(fd, st);
+    if (text <= 0 || !st->st_size)
+    {
+        close(fd);
+        return text < 0 ? -1 : 0;
+    }
+
+    // read instead of mmap, truncated file would raise SIGBUS
+    const char *data;
+    ssize_t n_read = read_file(fd, &data);
+    close(fd);
+    if (n_read < 0) return -1;
+    size_t len = n_read;
+
+    int err = 0;
+    if (query->n_patterns > 1) err = search_many(rel_path, data, len, query);
+    else if (query->progs)
+    {
+        match_printer_t out = {
+            .path = rel_path,
+        };
+        line_counter_init(&out.lc, data);
+        err = scan_regex(query, 0, data, len, report_regex_match, &out);
+    }
+    else err = search_one(rel_path, data, len, query);
+
+    // positive if the result limit stopped the search
+    return err < 0 ? -1 : 0;
+}
@@ -0,0 +1,68 @@
+#include "strsearch.h"
+
+#include <string.h>
+#include <emmintrin.h>
+
+const char* str_find(const char *buf, size_t len, const char *pat, size_t pat_len)
+{
+    if (!pat_len || pat_len > len) return NULL;
+    if (pat_len == 1) return memchr(buf, pat[0], len);
+
+    // last possible start
+    size_t last = len - pat_len;
+    __m128i first_v = _mm_set1_epi8(pat[0]);
+    __m128i last_v = _mm_set1_epi8(pat[pat_len - 1]);
+
+    size_t i = 0;
+    for (; last - i >= 16; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*) (buf + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (buf + i + pat_len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first_v),
+                                                        _mm_cmpeq_epi8(b, last_v)));
+        while (mask)
+        {
+            int bit = __builtin_ctz(mask);
+            // ends already compared
+            if (!memcmp(buf + i + bit + 1, pat + 1, pat_len - 2))
+                return buf + i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    for (; i <= last; ++i)
+    {
+        if (buf[i] == pat[0] && buf[i + pat_len - 1] == pat[pat_len - 1]
+            && !memcmp(buf + i + 1, pat + 1, pat_len - 2))
+            return buf + i;
+    }
+
+    return NULL;
+}
+
+void line_counter_init(line_counter_t *lc, const char *buf)
+{
+    lc->buf = buf;
+    lc->pos = 0;
+    lc->line_start = 0;
+    lc->line = 1;
+}
+
+void line_counter_get(line_counter_t *lc, size_t pos, long long *line, long long *col)
+{
+    // count newlines only between previous and current position
+    const char *p = lc->buf + lc->pos;
+    const char *end = lc->buf + pos;
+    while (p < end)
+    {
+        const char *nl = memchr(p, '\n', end - p);
+        if (!nl) break;
+        lc->line++;
+        lc->line_start = nl + 1 - lc->buf;
+        p = nl + 1;
+    }
+    lc->pos = pos;
+
+    *line = lc->line;
+    *col = (long long) (pos - lc->line_start) + 1;
+}
@@ -0,0 +1,167 @@
+#include "textdetect.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <emmintrin.h>
+
+#define CACHE_INIT_CAP (1024)
+
+typedef struct cache_entry_t
+{
+    dev_t dev;
+    // 0 marks empty slot
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    int is_text;
+} cache_entry_t;
+
+// per thread, forked children get a copy and their additions are lost
+static __thread cache_entry_t *CACHE = NULL;
+static __thread size_t CACHE_CAP = 0;
+static __thread size_t CACHE_SIZE = 0;
+
+static size_t cache_hash(dev_t dev, ino_t ino)
+{
+    unsigned long long h = (unsigned long long) ino * 0x9E3779B97F4A7C15ull;
+    h ^= (unsigned long long) dev * 0xC2B2AE3D27D4EB4Full;
+    return (size_t) (h ^ (h >> 29));
+}
+
+static cache_entry_t* cache_slot(cache_entry_t *table, size_t cap, dev_t dev, ino_t ino)
+{
+    size_t i = cache_hash(dev, ino) & (cap - 1);
+    while (table[i].ino && (table[i].ino != ino || table[i].dev != dev))
+        i = (i + 1) & (cap - 1);
+    return &table[i];
+}
+
+static int cache_grow(void)
+{
+    size_t cap = CACHE_CAP ? 2 * CACHE_CAP : CACHE_INIT_CAP;
+    cache_entry_t *table = calloc(cap, sizeof *table);
+    if (!table) return -1;
+
+    for (size_t i = 0; i < CACHE_CAP; ++i)
+    {
+        if (!CACHE[i].ino) continue;
+        *cache_slot(table, cap, CACHE[i].dev, CACHE[i].ino) = CACHE[i];
+    }
+
+    free(CACHE);
+    CACHE = table;
+    CACHE_CAP = cap;
+    return 0;
+}
+
+/**
+ * Control characters text files may contain:
+ * \a \b \t \n \v \f \r and escape.
+ */
+static int allowed_control(unsigned char c)
+{
+    return (c >= 7 && c <= 13) || c == 27;
+}
+
+static int binary_byte(unsigned char c)
+{
+    return (c < 0x20 && !allowed_control(c)) || c == 0x7F;
+}
+
+/**
+ * Scan for binary bytes 16 at a time with SSE2.
+ * Returns -1 if binary, otherwise 1 if any byte >= 0x80.
+ */
+static int scan_bytes(const unsigned char *buf, size_t len)
+{
+    __m128i any_bad = _mm_setzero_si128();
+    __m128i any_high = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; len - i >= 16; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*) (buf + i));
+        __m128i zero = _mm_setzero_si128();
+        // unsigned v <= 0x1F
+        __m128i ctrl = _mm_cmpeq_epi8(_mm_subs_epu8(v, _mm_set1_epi8(0x1F)), zero);
+        // unsigned v - 7 <= 6
+        __m128i allowed = _mm_cmpeq_epi8(
+                _mm_subs_epu8(_mm_sub_epi8(v, _mm_set1_epi8(7)), _mm_set1_epi8(6)), zero);
+        allowed = _mm_or_si128(allowed, _mm_cmpeq_epi8(v, _mm_set1_epi8(27)));
+        __m128i del = _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F));
+
+        any_bad = _mm_or_si128(any_bad, _mm_or_si128(_mm_andnot_si128(allowed, ctrl), del));
+        any_high = _mm_or_si128(any_high, v);
+
+        // check every 64 bytes
+        if (!(i & 63) && _mm_movemask_epi8(any_bad)) return -1;
+    }
+
+    if (_mm_movemask_epi8(any_bad)) return -1;
+    int high = _mm_movemask_epi8(any_high) != 0;
+
+    for (; i < len; ++i)
+    {
+        if (binary_byte(buf[i])) return -1;
+        if (buf[i] >= 0x80) high = 1;
+    }
+
+    return high;
+}
+
+static int classify(int fd)
+{
+    unsigned char buf[TEXT_PROBE_SIZE];
+    ssize_t len = pread(fd, buf, sizeof buf, 0);
+    if (len < 0) return -1;
+    // file reports empty files as x-empty
+    if (!len) return TEXT_BINARY;
+
+    int res = scan_bytes(buf, len);
+    if (res < 0) return TEXT_BINARY;
+    // file --mime reports any 8-bit encoding as text too,
+    // so non-ASCII bytes are not validated
+    return res ? TEXT_8BIT : TEXT_ASCII;
+}
+
+int text_detect(int fd, const struct stat *st)
+{
+    if (fd < 0 || !st) return -1;
+    if (!S_ISREG(st->st_mode)) return TEXT_BINARY;
+
+    cache_entry_t *ent = NULL;
+    if (st->st_ino)
+    {
+        if (2 * (CACHE_SIZE + 1) > CACHE_CAP && cache_grow()) return -1;
+
+        ent = cache_slot(CACHE, CACHE_CAP, st->st_dev, st->st_ino);
+        if (ent->ino && ent->size == st->st_size
+            && ent->mtime.tv_sec == st->st_mtim.tv_sec
+            && ent->mtime.tv_nsec == st->st_mtim.tv_nsec)
+            return ent->is_text;
+    }
+
+    int res = classify(fd);
+    if (res < 0) return -1;
+
+    if (ent)
+    {
+        if (!ent->ino) CACHE_SIZE++;
+        ent->dev = st->st_dev;
+        ent->ino = st->st_ino;
+        ent->size = st->st_size;
+        ent->mtime = st->st_mtim;
+        ent->is_text = res;
+    }
+
+    return res;
+}
+
+void text_detect_clear(void)
+{
+    free(CACHE);
+    CACHE = NULL;
+    CACHE_CAP = 0;
+    CACHE_SIZE = 0;
+}
@@ -0,0 +1,965 @@
+#define _GNU_SOURCE
+#include "tgindex.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include "textdetect.h"
+
+#define TG_MAGIC "JKTRG01"
+#define TRIGRAM_BITS (24)
+#define N_TRIGRAMS (1u << TRIGRAM_BITS)
+// radix sort of pairs by trigram
+#define SORT_BITS (12)
+#define BUF_INIT_CAP (64 * 1024)
+#define NO_ID (UINT32_MAX)
+
+// file is text and has postings
+#define FILE_TEXT (1u)
+
+/**
+ * Start of index file.
+ * Sections follow in order: files, trigrams, postings, paths.
+ * Paths start with the absolute root.
+ */
+typedef struct tg_header_t
+{
+    char magic[8];
+    uint32_t n_files;
+    uint32_t n_tris;
+    uint32_t root_len;
+    uint32_t pad;
+    uint64_t files_off;
+    uint64_t tris_off;
+    uint64_t postings_off;
+    uint64_t postings_len;
+    uint64_t paths_off;
+    uint64_t paths_len;
+} tg_header_t;
+
+typedef struct tg_file_t
+{
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t size;
+    uint64_t path_off;
+    uint32_t path_len;
+    uint32_t flags;
+} tg_file_t;
+
+/**
+ * Trigram with its posting list, sorted by trigram.
+ */
+typedef struct tg_trigram_t
+{
+    uint32_t trigram;
+    uint32_t count;
+    uint64_t off;
+} tg_trigram_t;
+
+struct tg_index_t
+{
+    // mapped file, NULL for empty index
+    char *map;
+    size_t map_len;
+
+    const tg_file_t *files;
+    uint32_t n_files;
+    const tg_trigram_t *tris;
+    uint32_t n_tris;
+    const unsigned char *postings;
+    size_t postings_len;
+    const char *paths;
+    size_t paths_len;
+    uint32_t root_len;
+
+    // open addressing table of file id + 1, 0 if empty
+    uint32_t *slots;
+    size_t slots_mask;
+
+    // candidate bitmap, NULL if all files are candidates
+    unsigned char *cand;
+};
+
+typedef struct buf_t
+{
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} buf_t;
+
+typedef enum old_state_t
+{
+    OLD_UNSEEN = 0,
+    OLD_KEPT,
+    OLD_DROPPED,
+} old_state_t;
+
+/**
+ * State of index update.
+ */
+typedef struct builder_t
+{
+    tg_index_t *old;
+    // old_state_t of every old file
+    unsigned char *state;
+    const char *root;
+    size_t root_len;
+    char root_abs[PATH_MAX];
+
+    // paths of files to index, relative
+    char **todo;
+    size_t n_todo;
+    size_t cap_todo;
+
+    // (trigram, new id) of indexed files
+    uint64_t *pairs;
+    size_t n_pairs;
+    size_t cap_pairs;
+    // trigrams already seen in the current file
+    unsigned char *seen;
+
+    buf_t files;
+    buf_t tris;
+    buf_t postings;
+    buf_t paths;
+    uint32_t n_files;
+    long n_indexed;
+} builder_t;
+
+static void* buf_grow(buf_t *buf, size_t n)
+{
+    if (buf->cap - buf->len < n)
+    {
+        size_t cap = buf->cap ? buf->cap : BUF_INIT_CAP;
+        while (cap - buf->len < n) cap *= 2;
+        unsigned char *data = realloc(buf->data, cap);
+        if (!data) return NULL;
+        buf->data = data;
+        buf->cap = cap;
+    }
+
+    void *p = buf->data + buf->len;
+    buf->len += n;
+    return p;
+}
+
+static int buf_put_varint(buf_t *buf, uint32_t v)
+{
+    unsigned char bytes[5];
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        bytes[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    bytes[n++] = v;
+
+    unsigned char *p = buf_grow(buf, n);
+    if (!p) return -1;
+    memcpy(p, bytes, n);
+    return 0;
+}
+
+static int write_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static uint64_t hash_path(const char *path, size_t len)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char) path[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static int build_slots(tg_index_t *idx)
+{
+    size_t n_slots = 16;
+    while (n_slots < 2 * (size_t) idx->n_files) n_slots *= 2;
+
+    idx->slots = calloc(n_slots, sizeof *idx->slots);
+    if (!idx->slots) return -1;
+    idx->slots_mask = n_slots - 1;
+
+    for (uint32_t id = 0; id < idx->n_files; ++id)
+    {
+        const tg_file_t *f = &idx->files[id];
+        size_t i = hash_path(idx->paths + f->path_off, f->path_len) & idx->slots_mask;
+        while (idx->slots[i]) i = (i + 1) & idx->slots_mask;
+        idx->slots[i] = id + 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Get id of file, -1 if not indexed.
+ */
+static long find_file(const tg_index_t *idx, const char *path, size_t len)
+{
+    if (!idx->slots) return -1;
+
+    size_t i = hash_path(path, len) & idx->slots_mask;
+    for (; idx->slots[i]; i = (i + 1) & idx->slots_mask)
+    {
+        const tg_file_t *f = &idx->files[idx->slots[i] - 1];
+        if (f->path_len == len && !memcmp(idx->paths + f->path_off, path, len))
+            return idx->slots[i] - 1;
+    }
+
+    return -1;
+}
+
+static int file_fresh(const tg_file_t *f, const struct stat *st)
+{
+    return f->size == st->st_size
+           && f->mtime_sec == st->st_mtim.tv_sec
+           && f->mtime_nsec == st->st_mtim.tv_nsec;
+}
+
+/**
+ * Check that section of len bytes at off is inside the map.
+ */
+static int section_valid(const tg_index_t *idx, uint64_t off, uint64_t len, size_t align)
+{
+    return off <= idx->map_len && len <= idx->map_len - off && !(off % align);
+}
+
+static int validate(tg_index_t *idx)
+{
+    const tg_header_t *hdr = (const tg_header_t*) idx->map;
+    if (idx->map_len < sizeof *hdr || memcmp(hdr->magic, TG_MAGIC, sizeof hdr->magic))
+        return -1;
+
+    if (!section_valid(idx, hdr->files_off, (uint64_t) hdr->n_files * sizeof(tg_file_t), 8)
+        || !section_valid(idx, hdr->tris_off, (uint64_t) hdr->n_tris * sizeof(tg_trigram_t), 8)
+        || !section_valid(idx, hdr->postings_off, hdr->postings_len, 1)
+        || !section_valid(idx, hdr->paths_off, hdr->paths_len, 1)
+        || hdr->root_len > hdr->paths_len)
+        return -1;
+
+    idx->files = (const tg_file_t*) (idx->map + hdr->files_off);
+    idx->n_files = hdr->n_files;
+    idx->tris = (const tg_trigram_t*) (idx->map + hdr->tris_off);
+    idx->n_tris = hdr->n_tris;
+    idx->postings = (const unsigned char*) idx->map + hdr->postings_off;
+    idx->postings_len = hdr->postings_len;
+    idx->paths = idx->map + hdr->paths_off;
+    idx->paths_len = hdr->paths_len;
+    idx->root_len = hdr->root_len;
+
+    for (uint32_t i = 0; i < idx->n_files; ++i)
+    {
+        const tg_file_t *f = &idx->files[i];
+        if (f->path_off > idx->paths_len || f->path_len > idx->paths_len - f->path_off)
+            return -1;
+    }
+
+    // lists themselves are checked when decoded
+    for (uint32_t i = 0; i < idx->n_tris; ++i)
+    {
+        const tg_trigram_t *t = &idx->tris[i];
+        if (t->off > idx->postings_len || !t->count || t->count > idx->n_files
+            || t->trigram >= N_TRIGRAMS || (i && t->trigram <= idx->tris[i - 1].trigram))
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Load index file, missing file gives empty index.
+ */
+static tg_index_t* load_index(const char index_path[])
+{
+    tg_index_t *idx = calloc(1, sizeof *idx);
+    if (!idx) return NULL;
+
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0)
+    {
+        if (errno == ENOENT) return idx;
+        free(idx);
+        return NULL;
+    }
+
+    struct stat st;
+    int err = fstat(fd, &st);
+    if (!err && st.st_size > 0)
+    {
+        idx->map_len = st.st_size;
+        idx->map = mmap(NULL, idx->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (idx->map == MAP_FAILED)
+        {
+            idx->map = NULL;
+            err = -1;
+        }
+    }
+    close(fd);
+
+    if (err || !idx->map || validate(idx) || build_slots(idx))
+    {
+        tg_free(idx);
+        return NULL;
+    }
+
+    return idx;
+}
+
+void tg_free(tg_index_t *idx)
+{
+    if (!idx) return;
+
+    if (idx->map) munmap(idx->map, idx->map_len);
+    free(idx->slots);
+    free(idx->cand);
+    free(idx);
+}
+
+long tg_size(const tg_index_t *idx)
+{
+    return idx ? idx->n_files : 0;
+}
+
+/**
+ * Decode posting list into ids, which are checked to be increasing.
+ */
+static int decode_postings(const tg_index_t *idx, const tg_trigram_t *tri, uint32_t *ids)
+{
+    const unsigned char *p = idx->postings + tri->off;
+    const unsigned char *end = idx->postings + idx->postings_len;
+    uint64_t id = 0;
+
+    for (uint32_t i = 0; i < tri->count; ++i)
+    {
+        uint64_t delta = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            // ids fit 5 bytes
+            if (p == end || shift > 28) return -1;
+            unsigned char b = *p++;
+            delta |= (uint64_t) (b & 0x7f) << shift;
+            if (!(b & 0x80)) break;
+        }
+
+        if (i && !delta) return -1;
+        id += delta;
+        if (id >= idx->n_files) return -1;
+        ids[i] = id;
+    }
+
+    return 0;
+}
+
+static const tg_trigram_t* find_trigram(const tg_index_t *idx, uint32_t trigram)
+{
+    size_t lo = 0, hi = idx->n_tris;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->tris[mid].trigram < trigram) lo = mid + 1;
+        else hi = mid;
+    }
+
+    if (lo < idx->n_tris && idx->tris[lo].trigram == trigram) return &idx->tris[lo];
+    return NULL;
+}
+
+static int add_todo(builder_t *b, const char *rel_path)
+{
+    if (b->n_todo == b->cap_todo)
+    {
+        size_t cap = b->cap_todo ? 2 * b->cap_todo : 1024;
+        char **todo = realloc(b->todo, cap * sizeof *todo);
+        if (!todo) return -1;
+        b->todo = todo;
+        b->cap_todo = cap;
+    }
+
+    b->todo[b->n_todo] = strdup(rel_path);
+    if (!b->todo[b->n_todo]) return -1;
+    b->n_todo++;
+    return 0;
+}
+
+/**
+ * Compare regular file with the old index.
+ */
+static int visit_file(builder_t *b, const char *rel_path, const struct stat *st)
+{
+    long id = find_file(b->old, rel_path, strlen(rel_path));
+    if (id >= 0)
+    {
+        int fresh = file_fresh(&b->old->files[id], st);
+        b->state[id] = fresh ? OLD_KEPT : OLD_DROPPED;
+        if (fresh) return 0;
+    }
+
+    return add_todo(b, rel_path);
+}
+
+/**
+ * Same rules as process_path of fork_search.
+ */
+static int walk_path(builder_t *b, const char path[], long depth)
+{
+    struct stat st;
+    if (lstat(path, &st)) return -1;
+
+    size_t path_len = strlen(path);
+
+    if (S_ISDIR(st.st_mode) && depth > 0)
+    {
+        DIR *dir = opendir(path);
+        if (!dir) return -1;
+
+        int err = 0;
+        for (;;)
+        {
+            struct dirent *ent = readdir(dir);
+            if (!ent) break;
+
+            // skip . and ..
+            if (!strcmp(".", ent->d_name) || !strcmp("..", ent->d_name))
+                continue;
+
+            size_t name_len = strlen(ent->d_name);
+            if (path_len + name_len + 2 > PATH_MAX)
+            {
+                err = -1;
+                break;
+            }
+            char ent_path[PATH_MAX];
+            memcpy(ent_path, path, path_len);
+            ent_path[path_len] = '/';
+            memcpy(ent_path + path_len + 1, ent->d_name, name_len + 1);
+
+            err = walk_path(b, ent_path, depth - 1);
+            if (err) break;
+        }
+
+        closedir(dir);
+        return err;
+    }
+
+    // root itself has no relative path
+    if (!S_ISREG(st.st_mode) || path_len <= b->root_len) return 0;
+
+    return visit_file(b, path + b->root_len + 1, &st);
+}
+
+static int full_path(const builder_t *b, const char *rel_path, size_t rel_len, char out[PATH_MAX])
+{
+    if (b->root_len + rel_len + 2 > PATH_MAX) return -1;
+    memcpy(out, b->root, b->root_len);
+    out[b->root_len] = '/';
+    memcpy(out + b->root_len + 1, rel_path, rel_len);
+    out[b->root_len + 1 + rel_len] = 0;
+    return 0;
+}
+
+/**
+ * Check old files not reached by the walk, it may have been shallower.
+ */
+static int check_unseen(builder_t *b)
+{
+    const tg_index_t *old = b->old;
+
+    for (uint32_t id = 0; id < old->n_files; ++id)
+    {
+        if (b->state[id] != OLD_UNSEEN) continue;
+
+        const tg_file_t *f = &old->files[id];
+        const char *rel_path = old->paths + f->path_off;
+        char path[PATH_MAX];
+        struct stat st;
+
+        b->state[id] = OLD_DROPPED;
+        if (full_path(b, rel_path, f->path_len, path) || lstat(path, &st) || !S_ISREG(st.st_mode))
+            continue;
+
+        if (file_fresh(f, &st)) b->state[id] = OLD_KEPT;
+        else if (add_todo(b, path + b->root_len + 1)) return -1;
+    }
+
+    return 0;
+}
+
+static int add_file(builder_t *b, const char *rel_path, size_t rel_len, const struct stat *st, uint32_t flags)
+{
+    tg_file_t *f = buf_grow(&b->files, sizeof *f);
+    if (!f) return -1;
+    f->mtime_sec = st->st_mtim.tv_sec;
+    f->mtime_nsec = st->st_mtim.tv_nsec;
+    f->size = st->st_size;
+    f->path_off = b->paths.len;
+    f->path_len = rel_len;
+    f->flags = flags;
+
+    char *p = buf_grow(&b->paths, rel_len);
+    if (!p) return -1;
+    memcpy(p, rel_path, rel_len);
+
+    b->n_files++;
+    return 0;
+}
+
+static int add_pair(builder_t *b, uint32_t trigram, uint32_t id)
+{
+    if (b->n_pairs == b->cap_pairs)
+    {
+        size_t cap = b->cap_pairs ? 2 * b->cap_pairs : 64 * 1024;
+        uint64_t *pairs = realloc(b->pairs, cap * sizeof *pairs);
+        if (!pairs) return -1;
+        b->pairs = pairs;
+        b->cap_pairs = cap;
+    }
+
+    b->pairs[b->n_pairs++] = (uint64_t) trigram << 32 | id;
+    return 0;
+}
+
+/**
+ * Add distinct trigrams of data as pairs with file id.
+ */
+static int add_trigrams(builder_t *b, const unsigned char *data, size_t len, uint32_t id)
+{
+    size_t first = b->n_pairs;
+    uint32_t trigram = 0;
+    int err = 0;
+
+    for (size_t i = 0; i < len && !err; ++i)
+    {
+        trigram = ((trigram << 8) | data[i]) & (N_TRIGRAMS - 1);
+        if (i < 2) continue;
+
+        unsigned char bit = 1 << (trigram & 7);
+        if (b->seen[trigram >> 3] & bit) continue;
+        b->seen[trigram >> 3] |= bit;
+        err = add_pair(b, trigram, id);
+    }
+
+    // clear only what was set
+    for (size_t i = first; i < b->n_pairs; ++i)
+    {
+        uint32_t t = b->pairs[i] >> 32;
+        b->seen[t >> 3] &= ~(1 << (t & 7));
+    }
+
+    return err;
+}
+
+/**
+ * Read file and add it with its trigrams.
+ * Files which cannot be read are left out, search reports them.
+ */
+static int index_file(builder_t *b, const char *rel_path)
+{
+    size_t rel_len = strlen(rel_path);
+    char path[PATH_MAX];
+    if (full_path(b, rel_path, rel_len, path)) return 0;
+
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    int text = (fstat(fd, &st) || !S_ISREG(st.st_mode)) ? -1 : text_detect(fd, &st);
+    if (text < 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    const unsigned char *data = NULL;
+    size_t len = st.st_size;
+    if (text && len)
+    {
+        data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return 0;
+        }
+        madvise((void*) data, len, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    uint32_t id = b->n_files;
+    int err = add_file(b, rel_path, rel_len, &st, text ? FILE_TEXT : 0);
+    if (!err && data) err = add_trigrams(b, data, len, id);
+    if (data) munmap((void*) data, len);
+
+    b->n_indexed++;
+    return err;
+}
+
+/**
+ * Sort pairs by trigram, ids stay in order as the sort is stable.
+ */
+static int sort_pairs(uint64_t *pairs, size_t n)
+{
+    uint64_t *tmp = malloc(n * sizeof *tmp);
+    if (!tmp) return -1;
+
+    uint64_t *src = pairs, *dst = tmp;
+    for (int shift = 32; shift < 32 + TRIGRAM_BITS; shift += SORT_BITS)
+    {
+        size_t counts[1 << SORT_BITS] = {0};
+
+        for (size_t i = 0; i < n; ++i)
+            counts[(src[i] >> shift) & ((1 << SORT_BITS) - 1)]++;
+
+        size_t sum = 0;
+        for (size_t k = 0; k < (1 << SORT_BITS); ++k)
+        {
+            size_t c = counts[k];
+            counts[k] = sum;
+            sum += c;
+        }
+
+        for (size_t i = 0; i < n; ++i)
+            dst[counts[(src[i] >> shift) & ((1 << SORT_BITS) - 1)]++] = src[i];
+
+        uint64_t *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    // even number of passes ends in pairs
+    free(tmp);
+    return 0;
+}
+
+/**
+ * Merge old posting lists of kept files with pairs of indexed files.
+ * Kept files have the lowest new ids, so lists stay sorted.
+ */
+static int merge_postings(builder_t *b, const uint32_t *remap)
+{
+    const tg_index_t *old = b->old;
+    uint32_t *ids = malloc(((size_t) old->n_files + 1) * sizeof *ids);
+    if (!ids) return -1;
+
+    int err = 0;
+    size_t i = 0, j = 0;
+    while (!err && (i < old->n_tris || j < b->n_pairs))
+    {
+        uint32_t trigram = i < old->n_tris ? old->tris[i].trigram : N_TRIGRAMS;
+        if (j < b->n_pairs && b->pairs[j] >> 32 < trigram) trigram = b->pairs[j] >> 32;
+
+        uint64_t off = b->postings.len;
+        uint32_t count = 0;
+        uint32_t prev = 0;
+
+        if (i < old->n_tris && old->tris[i].trigram == trigram)
+        {
+            const tg_trigram_t *t = &old->tris[i++];
+            err = decode_postings(old, t, ids);
+            for (uint32_t k = 0; k < t->count && !err; ++k)
+            {
+                uint32_t id = remap[ids[k]];
+                if (id == NO_ID) continue;
+                err = buf_put_varint(&b->postings, id - prev);
+                prev = id;
+                count++;
+            }
+        }
+
+        for (; !err && j < b->n_pairs && b->pairs[j] >> 32 == trigram; ++j)
+        {
+            uint32_t id = (uint32_t) b->pairs[j];
+            err = buf_put_varint(&b->postings, id - prev);
+            prev = id;
+            count++;
+        }
+
+        if (!err && count)
+        {
+            tg_trigram_t *t = buf_grow(&b->tris, sizeof *t);
+            if (!t) err = -1;
+            else
+            {
+                t->trigram = trigram;
+                t->count = count;
+                t->off = off;
+            }
+        }
+    }
+
+    free(ids);
+    return err;
+}
+
+static int write_index(const builder_t *b, const char index_path[])
+{
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, sizeof tmp_path, "%s.%d.tmp", index_path, (int) getpid()) >= PATH_MAX)
+        return -1;
+
+    tg_header_t hdr = {
+        .magic = TG_MAGIC,
+        .n_files = b->n_files,
+        .n_tris = b->tris.len / sizeof(tg_trigram_t),
+        .root_len = strlen(b->root_abs),
+        .files_off = sizeof hdr,
+        .postings_len = b->postings.len,
+        .paths_len = b->paths.len,
+    };
+    hdr.tris_off = hdr.files_off + b->files.len;
+    hdr.postings_off = hdr.tris_off + b->tris.len;
+    hdr.paths_off = hdr.postings_off + b->postings.len;
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    int err = write_all(fd, &hdr, sizeof hdr)
+              || write_all(fd, b->files.data, b->files.len)
+              || write_all(fd, b->tris.data, b->tris.len)
+              || write_all(fd, b->postings.data, b->postings.len)
+              || write_all(fd, b->paths.data, b->paths.len);
+    if (close(fd)) err = 1;
+
+    // readers see either the old or the new index
+    if (err || rename(tmp_path, index_path))
+    {
+        unlink(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Write new index of kept old files and files to index.
+ */
+static int rebuild(builder_t *b, const char index_path[])
+{
+    const tg_index_t *old = b->old;
+
+    uint32_t *remap = malloc(((size_t) old->n_files + 1) * sizeof *remap);
+    b->seen = calloc(N_TRIGRAMS / 8, 1);
+    if (!remap || !b->seen)
+    {
+        free(remap);
+        return -1;
+    }
+
+    size_t root_len = strlen(b->root_abs);
+    int err = buf_grow(&b->paths, root_len) ? 0 : -1;
+    if (!err) memcpy(b->paths.data, b->root_abs, root_len);
+
+    for (uint32_t id = 0; id < old->n_files && !err; ++id)
+    {
+        remap[id] = NO_ID;
+        if (b->state[id] != OLD_KEPT) continue;
+
+        const tg_file_t *f = &old->files[id];
+        remap[id] = b->n_files;
+
+        // stat fields are all that is needed
+        struct stat st = {
+            .st_size = f->size,
+            .st_mtim = { .tv_sec = f->mtime_sec, .tv_nsec = f->mtime_nsec },
+        };
+        err = add_file(b, old->paths + f->path_off, f->path_len, &st, f->flags);
+    }
+
+    for (size_t i = 0; i < b->n_todo && !err; ++i)
+        err = index_file(b, b->todo[i]);
+
+    if (!err && b->n_pairs) err = sort_pairs(b->pairs, b->n_pairs);
+    if (!err) err = merge_postings(b, remap);
+    if (!err) err = write_index(b, index_path);
+
+    free(remap);
+    return err ? -1 : 0;
+}
+
+tg_index_t* tg_update(const char index_path[], const char root[], long depth, long *n_indexed)
+{
+    if (!index_path || !root) return NULL;
+
+    builder_t b = {
+        .root = root,
+        .root_len = strlen(root),
+    };
+    if (!realpath(root, b.root_abs)) return NULL;
+
+    b.old = load_index(index_path);
+    if (!b.old) return NULL;
+
+    // index of another tree is not reused
+    size_t root_len = strlen(b.root_abs);
+    if (b.old->root_len != root_len || memcmp(b.old->paths, b.root_abs, root_len))
+    {
+        tg_free(b.old);
+        b.old = calloc(1, sizeof *b.old);
+    }
+
+    int err = -1;
+    int changed = 0;
+    do
+    {
+        if (!b.old) break;
+
+        b.state = calloc((size_t) b.old->n_files + 1, 1);
+        if (!b.state) break;
+
+        if (walk_path(&b, root, depth) || check_unseen(&b)) break;
+
+        changed = !b.old->map || b.n_todo;
+        for (uint32_t id = 0; id < b.old->n_files && !changed; ++id)
+            changed = b.state[id] != OLD_KEPT;
+
+        err = changed ? rebuild(&b, index_path) : 0;
+    } while (0);
+
+    for (size_t i = 0; i < b.n_todo; ++i)
+        free(b.todo[i]);
+    free(b.todo);
+    free(b.state);
+    free(b.pairs);
+    free(b.seen);
+    free(b.files.data);
+    free(b.tris.data);
+    free(b.postings.data);
+    free(b.paths.data);
+    text_detect_clear();
+
+    if (err || !changed)
+    {
+        if (err)
+        {
+            tg_free(b.old);
+            return NULL;
+        }
+        if (n_indexed) *n_indexed = 0;
+        return b.old;
+    }
+
+    tg_free(b.old);
+    if (n_indexed) *n_indexed = b.n_indexed;
+    return load_index(index_path);
+}
+
+/**
+ * Intersect posting lists of trigrams of one string into candidates.
+ */
+static int select_string(tg_index_t *idx, const char *str, size_t len, uint32_t *ids, uint32_t *list)
+{
+    size_t n_tris = len - 2;
+    const tg_trigram_t **tris = malloc(n_tris * sizeof *tris);
+    if (!tris) return -1;
+
+    int err = 0;
+    int missing = 0;
+    size_t n_ids = 0;
+    size_t best = 0;
+    do
+    {
+        for (size_t i = 0; i < n_tris && !missing; ++i)
+        {
+            const unsigned char *s = (const unsigned char*) str + i;
+            tris[i] = find_trigram(idx, (uint32_t) s[0] << 16 | s[1] << 8 | s[2]);
+            // no file contains the string
+            missing = !tris[i];
+            if (!missing && tris[i]->count < tris[best]->count) best = i;
+        }
+        if (missing) break;
+
+        // start from the shortest list
+        if ((err = decode_postings(idx, tris[best], ids))) break;
+        n_ids = tris[best]->count;
+
+        for (size_t i = 0; i < n_tris && n_ids; ++i)
+        {
+            if (tris[i] == tris[best]) continue;
+            if ((err = decode_postings(idx, tris[i], list))) break;
+
+            size_t n = 0, k = 0;
+            for (size_t m = 0; m < n_ids; ++m)
+            {
+                while (k < tris[i]->count && list[k] < ids[m]) ++k;
+                if (k == tris[i]->count) break;
+                if (list[k] == ids[m]) ids[n++] = ids[m];
+            }
+            n_ids = n;
+        }
+
+        for (size_t m = 0; m < n_ids && !err; ++m)
+            idx->cand[ids[m] >> 3] |= 1 << (ids[m] & 7);
+    } while (0);
+
+    free(tris);
+    return err;
+}
+
+long tg_select(tg_index_t *idx, const char *const strs[], const size_t lens[], int n)
+{
+    if (!idx || !strs || !lens) return -1;
+
+    free(idx->cand);
+    idx->cand = NULL;
+
+    for (int i = 0; i < n; ++i)
+    {
+        // nothing to look up
+        if (lens[i] < 3) return idx->n_files;
+    }
+
+    size_t n_bytes = (idx->n_files + 7) / 8;
+    idx->cand = calloc(n_bytes + 1, 1);
+    uint32_t *ids = malloc(((size_t) idx->n_files + 1) * sizeof *ids);
+    uint32_t *list = malloc(((size_t) idx->n_files + 1) * sizeof *list);
+
+    int err = !idx->cand || !ids || !list ? -1 : 0;
+    for (int i = 0; i < n && !err; ++i)
+        err = select_string(idx, strs[i], lens[i], ids, list);
+
+    free(ids);
+    free(list);
+    if (err) return -1;
+
+    long count = 0;
+    for (size_t i = 0; i < n_bytes; ++i)
+        count += __builtin_popcount(idx->cand[i]);
+    return count;
+}
+
+int tg_may_match(const tg_index_t *idx, const char rel_path[], const struct stat *st)
+{
+    long id = find_file(idx, rel_path, strlen(rel_path));
+    if (id < 0) return 1;
+
+    const tg_file_t *f = &idx->files[id];
+    if (!file_fresh(f, st)) return 1;
+    // search would skip it as well
+    if (!(f->flags & FILE_TEXT)) return 0;
+
+    return !idx->cand || ((idx->cand[id >> 3] >> (id & 7)) & 1);
+}
@@ -0,0 +1,29 @@
+#!/usr/bin/env sh
+# Compare -E matches with grep in every search mode.
+# Every file has matches, so the first file of each worker is checked.
+EXE=${1:-build/out/exe}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+for d in a b c d/e d/f; do
+    mkdir -p "$DIR/$d"
+    for f in 1 2 3; do
+        printf 'hello world\n#include <x.h>\nhallo hello\n#include "y"\n#incx\n' > "$DIR/$d/$f.txt"
+    done
+done
+
+fail=0
+for mode in "" "-j 1" "-j 3"; do
+    for pat in 'hello' 'world' 'h(e|a)llo' '#inc[a-z]+'; do
+        got=$("$EXE" $mode -s -E "$DIR" "$pat" 3 | cut -d: -f1 | sort | uniq -c)
+        want=$(cd "$DIR" && grep -r -o -E "$pat" . | sed 's|^\./||' | cut -d: -f1 | sort | uniq -c)
+        if [ "$got" != "$want" ]; then
+            echo "FAIL: mode '$mode' pattern '$pat'"
+            fail=1
+        fi
+    done
+done
+
+[ $fail = 0 ] && echo "OK"
+exit $fail
@@ -0,0 +1,527 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
+#include "sigbench.h"
+#include "sigrecv.h"
+
+// latency histogram buckets are powers of two in nanoseconds
+#define HIST_BUCKETS (40)
+#define MAX_COUNTS (32)
+#define MAX_WINDOWS (32)
+#define POLL_NS (1000000)
+
+static const char HELP[] =
+        "SO Lab4 Zad3 benchmark - Jakub Karbowski\n"
+        "Usage:\n"
+        "%s [-d DIR] [-m MODES] [-R RECV] [-w WINDOWS] [-n COUNTS] [-r RUNS] [-t SECONDS] "
+        "[-H FILE] - run sender and catcher from DIR (default build/out) for every mode, "
+        "receive mode and count, print CSV\n"
+        "MODES - comma separated kill, sigqueue, sigrt and window (default all but window, "
+        "which only zad3b has)\n"
+        "RECV - comma separated handler and signalfd (default both)\n"
+        "WINDOWS - comma separated window sizes of window mode (default 1,4,16,64,256)\n"
+        "COUNTS - comma separated numbers of signals (default 1000,10000,100000)\n"
+        "-r RUNS - runs of every case (default 3)\n"
+        "-t SECONDS - run is killed after this time (default 10)\n"
+        "-H FILE - write latency histograms to FILE as CSV\n";
+
+static const char *const MODE_NAMES[] = {"kill", "sigqueue", "sigrt", "window"};
+#define N_MODES (4)
+#define MODE_WINDOW (3)
+
+static const char *const RECV_NAMES[] = {
+        [RECV_HANDLER] = "handler",
+        [RECV_SIGNALFD] = "signalfd",
+};
+#define N_RECVS (2)
+
+typedef enum run_status_t
+{
+    RUN_OK,
+    RUN_TIMEOUT,
+    RUN_FAILED,
+} run_status_t;
+
+static const char *const STATUS_NAMES[] = {
+        [RUN_OK] = "ok",
+        [RUN_TIMEOUT] = "timeout",
+        [RUN_FAILED] = "failed",
+};
+
+typedef struct bench_cfg_t
+{
+    const char *dir;
+    int modes[N_MODES];
+    int n_modes;
+    int recvs[N_RECVS];
+    int n_recvs;
+    long windows[MAX_WINDOWS];
+    int n_windows;
+    long counts[MAX_COUNTS];
+    int n_counts;
+    long runs;
+    long timeout;
+    // histogram output or NULL
+    FILE *hist;
+    struct utsname uts;
+} bench_cfg_t;
+
+typedef struct bench_case_t
+{
+    int mode;
+    int recv;
+    // unacknowledged signals in window mode, 0 otherwise
+    long window;
+    long n;
+    long run;
+} bench_case_t;
+
+typedef struct latency_t
+{
+    long n;
+    double p50_us;
+    double p99_us;
+    double max_us;
+    long hist[HIST_BUCKETS];
+} latency_t;
+
+static void sleep_ns(long ns)
+{
+    struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * Start program with quiet stdout and measurements in SIGBENCH_ENV.
+ */
+static pid_t spawn(const char *path, char *const argv[], int bench_fd)
+{
+    pid_t pid = fork();
+    if (pid) return pid;
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) dup2(null_fd, STDOUT_FILENO);
+
+    char fd_str[16];
+    snprintf(fd_str, sizeof fd_str, "%d", bench_fd);
+    setenv(SIGBENCH_ENV, fd_str, 1);
+
+    execv(path, argv);
+    perror(path);
+    _exit(127);
+}
+
+/**
+ * Wait for process, it is killed after deadline.
+ */
+static run_status_t wait_until(pid_t pid, int64_t deadline)
+{
+    for (;;)
+    {
+        int status;
+        pid_t ret = waitpid(pid, &status, WNOHANG);
+        if (ret < 0) return RUN_FAILED;
+        if (ret == pid)
+            return WIFEXITED(status) && !WEXITSTATUS(status) ? RUN_OK : RUN_FAILED;
+
+        if (sigbench_now() > deadline)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            return RUN_TIMEOUT;
+        }
+        sleep_ns(POLL_NS);
+    }
+}
+
+/**
+ * Wait until catcher installs its handlers.
+ */
+static run_status_t wait_ready(pid_t pid, const sigbench_t *b, int64_t deadline)
+{
+    while (!__atomic_load_n(&b->catcher_ready, __ATOMIC_ACQUIRE))
+    {
+        if (waitpid(pid, NULL, WNOHANG)) return RUN_FAILED;
+        if (sigbench_now() > deadline)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            return RUN_TIMEOUT;
+        }
+        sleep_ns(POLL_NS);
+    }
+    return RUN_OK;
+}
+
+static int compare_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t*) a, y = *(const int64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Latency of signals with both times taken.
+ */
+static int measure_latency(const int64_t *from, const int64_t *to, int64_t n, latency_t *lat)
+{
+    memset(lat, 0, sizeof *lat);
+
+    int64_t *samples = malloc((n ? n : 1) * sizeof *samples);
+    if (!samples) return -1;
+
+    for (int64_t i = 0; i < n; ++i)
+    {
+        if (!from[i] || !to[i] || to[i] < from[i]) continue;
+
+        int64_t d = to[i] - from[i];
+        samples[lat->n++] = d;
+        int bucket = d ? 63 - __builtin_clzll(d) : 0;
+        lat->hist[bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1]++;
+    }
+
+    if (lat->n)
+    {
+        qsort(samples, lat->n, sizeof *samples, compare_i64);
+        lat->p50_us = samples[lat->n / 2] * 1e-3;
+        lat->p99_us = samples[lat->n * 99 / 100] * 1e-3;
+        lat->max_us = samples[lat->n - 1] * 1e-3;
+    }
+
+    free(samples);
+    return 0;
+}
+
+static void print_latency(const latency_t *lat)
+{
+    if (lat->n) printf(",%.2f,%.2f,%.2f", lat->p50_us, lat->p99_us, lat->max_us);
+    else printf(",,,");
+}
+
+/**
+ * Print columns identifying the case.
+ */
+static void print_case(FILE *out, const bench_cfg_t *cfg, const bench_case_t *c)
+{
+    fprintf(out, "%s,%s,%s,%s,", cfg->uts.release, cfg->dir,
+            MODE_NAMES[c->mode], RECV_NAMES[c->recv]);
+    if (c->window) fprintf(out, "%ld", c->window);
+    fprintf(out, ",%ld,%ld", c->n, c->run);
+}
+
+static void print_hist(const bench_cfg_t *cfg, const bench_case_t *c,
+                       const char *kind, const latency_t *lat)
+{
+    for (int i = 0; i < HIST_BUCKETS; ++i)
+    {
+        if (!lat->hist[i]) continue;
+        print_case(cfg->hist, cfg, c);
+        fprintf(cfg->hist, ",%s,%lld,%lld,%ld\n", kind, i ? 1ll << i : 0, 2ll << i, lat->hist[i]);
+    }
+}
+
+static void report(const bench_cfg_t *cfg, const bench_case_t *c,
+                   run_status_t status, const sigbench_t *b)
+{
+    latency_t oneway, rtt;
+    const int64_t *sent = b->times;
+    const int64_t *received = b->times + b->n_slots;
+    const int64_t *confirmed = b->times + 2 * b->n_slots;
+    if (measure_latency(sent, received, b->n_slots, &oneway)
+        || measure_latency(sent, confirmed, b->n_slots, &rtt))
+        status = RUN_FAILED;
+
+    int64_t end = b->recv_last ? b->recv_last : b->send_end;
+    double seconds = end > b->send_start && b->send_start ? (end - b->send_start) * 1e-9 : 0;
+    double loss = b->n_sent ? 1 - (double) b->n_received / b->n_sent : 0;
+
+    print_case(stdout, cfg, c);
+    printf(",%s,%lld,%lld,%.4f,%.6f,%.0f", STATUS_NAMES[status],
+           (long long) b->n_sent, (long long) b->n_received, loss,
+           seconds, seconds > 0 ? b->n_received / seconds : 0);
+    print_latency(&oneway);
+    print_latency(&rtt);
+    putchar('\n');
+    fflush(stdout);
+
+    if (cfg->hist)
+    {
+        print_hist(cfg, c, "oneway", &oneway);
+        print_hist(cfg, c, "rtt", &rtt);
+    }
+}
+
+static int run_case(const bench_cfg_t *cfg, const bench_case_t *c)
+{
+    char catcher_path[PATH_MAX], sender_path[PATH_MAX];
+    if (snprintf(catcher_path, PATH_MAX, "%s/catcher", cfg->dir) >= PATH_MAX
+        || snprintf(sender_path, PATH_MAX, "%s/sender", cfg->dir) >= PATH_MAX)
+        return -1;
+
+    size_t size = sigbench_size(c->n);
+    int fd = memfd_create("sigbench", 0);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, size))
+    {
+        close(fd);
+        return -1;
+    }
+    sigbench_t *b = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (b == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+    b->n_slots = c->n;
+
+    int64_t deadline = sigbench_now() + cfg->timeout * 1000000000ll;
+    run_status_t status = RUN_FAILED;
+
+    // default receive mode is not passed, so programs without it can be run
+    char *recv_arg = c->recv == RECV_HANDLER ? NULL : (char*) RECV_NAMES[c->recv];
+    char *const catcher_argv[] = {catcher_path, recv_arg, NULL};
+    pid_t catcher = spawn(catcher_path, catcher_argv, fd);
+    if (catcher > 0) status = wait_ready(catcher, b, deadline);
+
+    if (status == RUN_OK)
+    {
+        char pid_str[16], n_str[24], window_str[24];
+        snprintf(pid_str, sizeof pid_str, "%lld", (long long) catcher);
+        snprintf(n_str, sizeof n_str, "%ld", c->n);
+        snprintf(window_str, sizeof window_str, "%ld", c->window);
+        // window mode takes the window size instead of receive mode
+        char *const sender_argv[] = {
+                sender_path, pid_str, n_str, (char*) MODE_NAMES[c->mode],
+                c->window ? window_str : recv_arg, NULL
+        };
+
+        pid_t sender = spawn(sender_path, sender_argv, fd);
+        if (sender < 0)
+        {
+            kill(catcher, SIGKILL);
+            waitpid(catcher, NULL, 0);
+            status = RUN_FAILED;
+        }
+        else
+        {
+            status = wait_until(sender, deadline);
+            // stuck catcher is killed at the same deadline
+            run_status_t catcher_status = wait_until(catcher, deadline);
+            if (status == RUN_OK) status = catcher_status;
+        }
+    }
+
+    report(cfg, c, status, b);
+
+    munmap(b, size);
+    close(fd);
+    return 0;
+}
+
+static int run_bench(const bench_cfg_t *cfg)
+{
+    printf("kernel,dir,mode,receive,window,signals,run,status,sent,received,loss,seconds,signals_per_s,"
+           "oneway_p50_us,oneway_p99_us,oneway_max_us,rtt_p50_us,rtt_p99_us,rtt_max_us\n");
+    if (cfg->hist) fprintf(cfg->hist, "kernel,dir,mode,receive,window,signals,run,kind,lo_ns,hi_ns,count\n");
+    fflush(stdout);
+
+    for (int c = 0; c < cfg->n_counts; ++c)
+    {
+        for (int m = 0; m < cfg->n_modes; ++m)
+        {
+            bench_case_t bc = { .mode = cfg->modes[m], .n = cfg->counts[c] };
+            // window sizes only apply to window mode
+            int n_windows = bc.mode == MODE_WINDOW ? cfg->n_windows : 1;
+
+            for (int v = 0; v < cfg->n_recvs; ++v)
+            {
+                bc.recv = cfg->recvs[v];
+                for (int w = 0; w < n_windows; ++w)
+                {
+                    bc.window = bc.mode == MODE_WINDOW ? cfg->windows[w] : 0;
+                    for (bc.run = 0; bc.run < cfg->runs; ++bc.run)
+                    {
+                        if (run_case(cfg, &bc)) return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int parse_modes(bench_cfg_t *cfg, char *list)
+{
+    cfg->n_modes = 0;
+    char *save;
+    for (char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+        int mode = 0;
+        while (mode < N_MODES && strcmp(MODE_NAMES[mode], tok)) ++mode;
+        if (mode == N_MODES || cfg->n_modes == N_MODES) return -1;
+        cfg->modes[cfg->n_modes++] = mode;
+    }
+    return cfg->n_modes ? 0 : -1;
+}
+
+static int parse_recvs(bench_cfg_t *cfg, char *list)
+{
+    cfg->n_recvs = 0;
+    char *save;
+    for (char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+        int recv = recv_mode_parse(tok);
+        if (recv < 0 || cfg->n_recvs == N_RECVS) return -1;
+        cfg->recvs[cfg->n_recvs++] = recv;
+    }
+    return cfg->n_recvs ? 0 : -1;
+}
+
+/**
+ * Parse comma separated numbers.
+ *
+ * @param min Smallest allowed number.
+ * @return Count or negative error.
+ */
+static int parse_longs(long *out, int max, long min, char *list)
+{
+    int count = 0;
+    char *save;
+    for (char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+        char *endptr;
+        long n = strtol(tok, &endptr, 10);
+        // sender takes an int
+        if (*endptr || n < min || n > INT_MAX || count == max) return -1;
+        out[count++] = n;
+    }
+    return count ? count : -1;
+}
+
+int main(int argc, char **argv)
+{
+    bench_cfg_t cfg = {
+        .dir = "build/out",
+        .modes = {0, 1, 2},
+        // window mode only in zad3b
+        .n_modes = MODE_WINDOW,
+        .recvs = {RECV_HANDLER, RECV_SIGNALFD},
+        .n_recvs = N_RECVS,
+        .windows = {1, 4, 16, 64, 256},
+        .n_windows = 5,
+        .counts = {1000, 10000, 100000},
+        .n_counts = 3,
+        .runs = 3,
+        .timeout = 10,
+    };
+    const char *hist_path = NULL;
+    char *endptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:m:R:w:n:r:t:H:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd':
+                cfg.dir = optarg;
+                break;
+
+            case 'm':
+                if (parse_modes(&cfg, optarg))
+                {
+                    fprintf(stderr, "Invalid MODES: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'R':
+                if (parse_recvs(&cfg, optarg))
+                {
+                    fprintf(stderr, "Invalid RECV: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'w':
+                cfg.n_windows = parse_longs(cfg.windows, MAX_WINDOWS, 1, optarg);
+                if (cfg.n_windows < 0)
+                {
+                    fprintf(stderr, "Invalid WINDOWS: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'n':
+                cfg.n_counts = parse_longs(cfg.counts, MAX_COUNTS, 0, optarg);
+                if (cfg.n_counts < 0)
+                {
+                    fprintf(stderr, "Invalid COUNTS: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'r':
+                cfg.runs = strtol(optarg, &endptr, 10);
+                if (*endptr || cfg.runs <= 0)
+                {
+                    fprintf(stderr, "Invalid RUNS: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 't':
+                cfg.timeout = strtol(optarg, &endptr, 10);
+                if (*endptr || cfg.timeout <= 0)
+                {
+                    fprintf(stderr, "Invalid SECONDS: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'H':
+                hist_path = optarg;
+                break;
+
+            default:
+                fprintf(stderr, HELP, argv[0]);
+                return -1;
+        }
+    }
+
+    if (optind != argc)
+    {
+        fprintf(stderr, HELP, argv[0]);
+        return -1;
+    }
+
+    if (uname(&cfg.uts))
+    {
+        fprintf(stderr, "Error!\n");
+        return -1;
+    }
+
+    if (hist_path)
+    {
+        cfg.hist = fopen(hist_path, "w");
+        if (!cfg.hist)
+        {
+            fprintf(stderr, "Cannot open %s\n", hist_path);
+            return -1;
+        }
+    }
+
+    int err = run_bench(&cfg);
+    if (cfg.hist && fclose(cfg.hist)) err = -1;
+    if (err) fprintf(stderr, "Error!\n");
+
+    return err;
+}
@@ -2,6 +2,8 @@
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
+#include "sigbench.h"
+#include "sigrecv.h"
 
 typedef enum send_mode_t
 {
@@ -10,45 +12,116 @@ typedef enum send_mode_t
     MODE_SIGRT,
 } send_mode_t;
 
+static const char HELP[] =
+        "SO Lab4 Zad3a - Jakub Karbowski\n"
+        "Usage:\n"
+        "%s [handler|signalfd] - receive with a signal handler (default) "
+        "or read blocked signals from signalfd in batches\n";
+
 static volatile int g_usr1_count = 0;
 static volatile int g_usr2_count = 0;
 static volatile send_mode_t g_sender_mode;
 static volatile pid_t g_sender_pid;
+// NULL unless run by the benchmark
+static sigbench_t *g_bench = NULL;
 
-static void handler(int sig, siginfo_t *info, void *ucontext)
+/**
+ * Sequence number of received ping for measurements.
+ */
+static int64_t ping_seq(int sig, int code, int value)
+{
+    if (code == SI_QUEUE) return value;
+    // real-time signals are queued in order
+    if (sig != SIGUSR1) return g_usr1_count;
+    // merged with pending ones, the newest is the best guess
+    return sigbench_newest(g_bench);
+}
+
+static void on_signal(int sig, int code, pid_t pid, int value)
 {
     // get sender's mode
     if (sig == SIGRTMIN + 0 || sig == SIGRTMIN + 1)
         g_sender_mode = MODE_SIGRT;
-    else if (info->si_code == SI_USER)
+    else if (code == SI_USER)
         g_sender_mode = MODE_KILL;
-    else if (info->si_code == SI_QUEUE)
+    else if (code == SI_QUEUE)
         g_sender_mode = MODE_SIGQUEUE;
 
-    g_sender_pid = info->si_pid;
+    // signals queued past RLIMIT_SIGPENDING come without sender,
+    // kill(0) would hit the whole process group
+    if (pid) g_sender_pid = pid;
 
     if (sig == SIGUSR1 || sig == SIGRTMIN + 0)
+    {
+        if (g_bench) sigbench_received(g_bench, ping_seq(sig, code, value));
         g_usr1_count++;
+    }
     else if (sig == SIGUSR2 || sig == SIGRTMIN + 1)
         g_usr2_count++;
 }
 
+static void handler(int sig, siginfo_t *info, void *ucontext)
+{
+    on_signal(sig, info->si_code, info->si_pid, info->si_value.sival_int);
+}
+
 int main(int argc, char **argv)
 {
+    recv_mode_t recv_mode = RECV_HANDLER;
+    if (argc > 2)
+    {
+        fprintf(stderr, HELP, argv[0]);
+        return -1;
+    }
+    if (argc == 2)
+    {
+        int mode = recv_mode_parse(argv[1]);
+        if (mode < 0)
+        {
+            fprintf(stderr, "Invalid receive mode: %s\n", argv[1]);
+            return -1;
+        }
+        recv_mode = mode;
+    }
+
     printf("PID: %lld\n", (long long) getpid());
 
     // SIGNAL SETUP
 
-    struct sigaction act = {0};
-    act.sa_sigaction = handler;
-    act.sa_flags = SA_SIGINFO;
-    sigaction(SIGUSR1, &act, NULL);
-    sigaction(SIGUSR2, &act, NULL);
-    sigaction(SIGRTMIN + 0, &act, NULL);
-    sigaction(SIGRTMIN + 1, &act, NULL);
+    sigset_t all_set;
+    sigemptyset(&all_set);
+    sigaddset(&all_set, SIGUSR1);
+    sigaddset(&all_set, SIGUSR2);
+    sigaddset(&all_set, SIGRTMIN + 0);
+    sigaddset(&all_set, SIGRTMIN + 1);
+
+    if (recv_mode == RECV_SIGNALFD)
+    {
+        // only read from signalfd, never delivered
+        sigprocmask(SIG_BLOCK, &all_set, NULL);
+    }
+    else
+    {
+        struct sigaction act = {0};
+        act.sa_sigaction = handler;
+        act.sa_flags = SA_SIGINFO;
+        sigaction(SIGUSR1, &act, NULL);
+        sigaction(SIGUSR2, &act, NULL);
+        sigaction(SIGRTMIN + 0, &act, NULL);
+        sigaction(SIGRTMIN + 1, &act, NULL);
+    }
+
+    g_bench = sigbench_attach();
+    if (g_bench) __atomic_store_n(&g_bench->catcher_ready, 1, __ATOMIC_RELEASE);
 
     // WAIT FOR PING
 
+    if (recv_mode == RECV_SIGNALFD && recv_signalfd(&all_set, on_signal, &g_usr2_count))
+    {
+        fprintf(stderr, "Error!\n");
+        return -1;
+    }
+
     sigset_t set, oldset;
     sigemptyset(&set);
     sigaddset(&set, SIGUSR2);
@@ -70,6 +143,7 @@ int main(int argc, char **argv)
     sigprocmask(SIG_SETMASK, &oldset, NULL);
 
     printf("Catcher got %d signals\n", g_usr1_count);
+    if (g_bench) g_bench->n_received = g_usr1_count;
 
     // SEND PONG
 
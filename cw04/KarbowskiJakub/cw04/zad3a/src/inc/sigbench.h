@@ -0,0 +1,68 @@
+#ifndef JK_04_03A_SIGBENCH_H
+#define JK_04_03A_SIGBENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// environment variable with descriptor of shared measurements
+#define SIGBENCH_ENV "SIGBENCH_FD"
+
+/**
+ * Measurements shared by the benchmark driver, sender and catcher.
+ * Times are CLOCK_MONOTONIC nanoseconds, 0 if not taken.
+ * Followed by three arrays of n_slots times indexed by sequence number:
+ * sent by sender, first received by catcher, confirmation received by sender.
+ */
+typedef struct sigbench_t
+{
+    int64_t n_slots;
+    // catcher handlers are installed
+    int64_t catcher_ready;
+    // signals sent so far
+    int64_t n_sent;
+    // signals counted by catcher
+    int64_t n_received;
+    int64_t send_start;
+    int64_t send_end;
+    // last receive by catcher
+    int64_t recv_last;
+    int64_t times[];
+} sigbench_t;
+
+int64_t sigbench_now(void);
+
+/**
+ * Size of shared memory for n_slots signals.
+ */
+size_t sigbench_size(int64_t n_slots);
+
+/**
+ * Map measurements passed by the driver in SIGBENCH_ENV.
+ *
+ * @return Measurements or NULL if not run by the driver.
+ */
+sigbench_t* sigbench_attach(void);
+
+/**
+ * Record that signal seq is about to be sent.
+ * Async-signal-safe, like the other record functions.
+ */
+void sigbench_sent(sigbench_t *b, int64_t seq);
+
+/**
+ * Record first receive of signal seq by catcher.
+ */
+void sigbench_received(sigbench_t *b, int64_t seq);
+
+/**
+ * Record confirmation of signal seq received by sender.
+ */
+void sigbench_confirmed(sigbench_t *b, int64_t seq);
+
+/**
+ * Get sequence number of the newest signal sent, -1 if none.
+ * Used for signals without value, which cannot be told apart.
+ */
+int64_t sigbench_newest(const sigbench_t *b);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef JK_04_03A_SIGRECV_H
+#define JK_04_03A_SIGRECV_H
+
+#include <signal.h>
+#include <sys/types.h>
+
+// records read from signalfd at once
+#define SIGRECV_BATCH (64)
+
+typedef enum recv_mode_t
+{
+    // SA_SIGINFO handler and sigsuspend
+    RECV_HANDLER,
+    // signals blocked and read from signalfd in an epoll loop
+    RECV_SIGNALFD,
+} recv_mode_t;
+
+/**
+ * Called for every received signal.
+ *
+ * @param sig Signal number.
+ * @param code si_code of the signal.
+ * @param pid Sender.
+ * @param value si_value.sival_int, valid for SI_QUEUE.
+ */
+typedef void (*recv_fn_t)(int sig, int code, pid_t pid, int value);
+
+/**
+ * Parse receive mode name.
+ *
+ * @return Mode or negative error.
+ */
+int recv_mode_parse(const char *str);
+
+/**
+ * Read signals of set in batches until stop is nonzero.
+ * Signals of set must be blocked by the caller,
+ * so no handler runs and fn is never interrupted.
+ * Pending signals are drained before returning,
+ * so lower signals sent before the stopping one are counted.
+ *
+ * @param set Received signals.
+ * @param fn Called for every signal.
+ * @param stop Set by fn to stop.
+ * @return 0 or negative error.
+ */
+int recv_signalfd(const sigset_t *set, recv_fn_t fn, volatile int *stop);
+
+#endif
@@ -2,6 +2,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
+#include "sigbench.h"
+#include "sigrecv.h"
 
 typedef enum send_mode_t
 {
@@ -13,21 +15,26 @@ typedef enum send_mode_t
 static const char HELP[] =
         "SO Lab4 Zad3a - Jakub Karbowski\n"
         "Usage:\n"
-        "%s CATCHER_PID NUM_SIGNALS kill|sigqueue|sigrt\n";
+        "%s CATCHER_PID NUM_SIGNALS kill|sigqueue|sigrt [handler|signalfd]\n";
 
 static volatile int g_usr1_count = 0;
 static volatile int g_usr2_count = 0;
 static volatile int g_catcher_received = -1;
 
-static void handler(int sig, siginfo_t *info, void *ucontext)
+static void on_signal(int sig, int code, pid_t pid, int value)
 {
     if (sig == SIGUSR1 || sig == SIGRTMIN + 0)
         g_usr1_count++;
     else if (sig == SIGUSR2 || sig == SIGRTMIN + 1)
         g_usr2_count++;
 
-    if (info->si_code == SI_QUEUE && sig == SIGUSR2)
-        g_catcher_received = info->si_value.sival_int;
+    if (code == SI_QUEUE && sig == SIGUSR2)
+        g_catcher_received = value;
+}
+
+static void handler(int sig, siginfo_t *info, void *ucontext)
+{
+    on_signal(sig, info->si_code, info->si_pid, info->si_value.sival_int);
 }
 
 int main(int argc, char **argv)
@@ -35,7 +42,7 @@ int main(int argc, char **argv)
 
     // ------------- ARG PARSING
 
-    if (argc != 4)
+    if (argc != 4 && argc != 5)
     {
         fprintf(stderr, HELP, argv[0]);
         return -1;
@@ -66,20 +73,53 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    recv_mode_t recv_mode = RECV_HANDLER;
+    if (argc == 5)
+    {
+        int m = recv_mode_parse(argv[4]);
+        if (m < 0)
+        {
+            fprintf(stderr, "Invalid receive mode: %s\n", argv[4]);
+            return -1;
+        }
+        recv_mode = m;
+    }
+
     // ------------- SIGNAL SETUP
 
-    struct sigaction act = {0};
-    act.sa_sigaction = handler;
-    act.sa_flags = SA_SIGINFO;
-    sigaction(SIGUSR1, &act, NULL);
-    sigaction(SIGUSR2, &act, NULL);
-    sigaction(SIGRTMIN + 0, &act, NULL);
-    sigaction(SIGRTMIN + 1, &act, NULL);
+    sigset_t all_set;
+    sigemptyset(&all_set);
+    sigaddset(&all_set, SIGUSR1);
+    sigaddset(&all_set, SIGUSR2);
+    sigaddset(&all_set, SIGRTMIN + 0);
+    sigaddset(&all_set, SIGRTMIN + 1);
+
+    if (recv_mode == RECV_SIGNALFD)
+    {
+        // pongs stay pending until read from signalfd
+        sigprocmask(SIG_BLOCK, &all_set, NULL);
+    }
+    else
+    {
+        struct sigaction act = {0};
+        act.sa_sigaction = handler;
+        act.sa_flags = SA_SIGINFO;
+        sigaction(SIGUSR1, &act, NULL);
+        sigaction(SIGUSR2, &act, NULL);
+        sigaction(SIGRTMIN + 0, &act, NULL);
+        sigaction(SIGRTMIN + 1, &act, NULL);
+    }
+
+    // NULL unless run by the benchmark
+    sigbench_t *bench = sigbench_attach();
 
     // ------------- SEND PING
 
+    if (bench) bench->send_start = sigbench_now();
     for (int i = 0; i < to_send; ++i)
     {
+        if (bench) sigbench_sent(bench, i);
+
         switch (mode)
         {
             case MODE_KILL:
@@ -87,7 +127,8 @@ int main(int argc, char **argv)
                 break;
 
             case MODE_SIGQUEUE:
-                sigqueue(catcher_pid, SIGUSR1, (union sigval) 0);
+                // sequence number
+                sigqueue(catcher_pid, SIGUSR1, (union sigval) i);
                 break;
 
             case MODE_SIGRT:
@@ -96,6 +137,8 @@ int main(int argc, char **argv)
         }
     }
 
+    if (bench) bench->send_end = sigbench_now();
+
     // ------------- SEND STOP
 
     switch (mode)
@@ -115,6 +158,12 @@ int main(int argc, char **argv)
 
     // ------------- WAIT FOR PONG
 
+    if (recv_mode == RECV_SIGNALFD && recv_signalfd(&all_set, on_signal, &g_usr2_count))
+    {
+        fprintf(stderr, "Error!\n");
+        return -1;
+    }
+
     sigset_t set, oldset;
     sigemptyset(&set);
     sigaddset(&set, SIGUSR2);
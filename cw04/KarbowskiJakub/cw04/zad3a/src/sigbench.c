@@ -0,0 +1,72 @@
+#include "sigbench.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int64_t sigbench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+size_t sigbench_size(int64_t n_slots)
+{
+    return sizeof(sigbench_t) + 3 * n_slots * sizeof(int64_t);
+}
+
+sigbench_t* sigbench_attach(void)
+{
+    const char *env = getenv(SIGBENCH_ENV);
+    if (!env) return NULL;
+
+    char *endptr;
+    int fd = (int) strtol(env, &endptr, 10);
+    struct stat st;
+    if (*endptr || fd < 0 || fstat(fd, &st) || st.st_size < (off_t) sizeof(sigbench_t))
+        return NULL;
+
+    sigbench_t *b = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (b == MAP_FAILED) return NULL;
+
+    if (b->n_slots < 0 || sigbench_size(b->n_slots) > (size_t) st.st_size)
+    {
+        munmap(b, st.st_size);
+        return NULL;
+    }
+
+    return b;
+}
+
+void sigbench_sent(sigbench_t *b, int64_t seq)
+{
+    if (seq < 0 || seq >= b->n_slots) return;
+
+    b->times[seq] = sigbench_now();
+    // catcher may read it as soon as the signal arrives
+    __atomic_store_n(&b->n_sent, seq + 1, __ATOMIC_RELEASE);
+}
+
+void sigbench_received(sigbench_t *b, int64_t seq)
+{
+    int64_t now = sigbench_now();
+    b->recv_last = now;
+
+    if (seq < 0 || seq >= b->n_slots) return;
+    int64_t *recv = b->times + b->n_slots;
+    if (!recv[seq]) recv[seq] = now;
+}
+
+void sigbench_confirmed(sigbench_t *b, int64_t seq)
+{
+    if (seq < 0 || seq >= b->n_slots) return;
+    int64_t *conf = b->times + 2 * b->n_slots;
+    if (!conf[seq]) conf[seq] = sigbench_now();
+}
+
+int64_t sigbench_newest(const sigbench_t *b)
+{
+    return __atomic_load_n(&b->n_sent, __ATOMIC_ACQUIRE) - 1;
+}
@@ -0,0 +1,69 @@
+#include "sigrecv.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+
+int recv_mode_parse(const char *str)
+{
+    if (!strcmp("handler", str)) return RECV_HANDLER;
+    if (!strcmp("signalfd", str)) return RECV_SIGNALFD;
+    return -1;
+}
+
+/**
+ * Pass all pending signals to fn.
+ */
+static int drain(int sfd, recv_fn_t fn)
+{
+    struct signalfd_siginfo batch[SIGRECV_BATCH];
+
+    for (;;)
+    {
+        ssize_t len = read(sfd, batch, sizeof batch);
+        if (len < 0)
+        {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN ? 0 : -1;
+        }
+
+        for (size_t i = 0; i < len / sizeof *batch; ++i)
+            fn(batch[i].ssi_signo, batch[i].ssi_code, batch[i].ssi_pid, batch[i].ssi_int);
+    }
+}
+
+int recv_signalfd(const sigset_t *set, recv_fn_t fn, volatile int *stop)
+{
+    int sfd = signalfd(-1, set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd < 0) return -1;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        close(sfd);
+        return -1;
+    }
+
+    int err = 0;
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data.fd = sfd,
+    };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev)) err = -1;
+
+    while (!err && !*stop)
+    {
+        if (epoll_wait(epfd, &ev, 1, -1) < 0)
+        {
+            if (errno != EINTR) err = -1;
+            continue;
+        }
+        err = drain(sfd, fn);
+    }
+
+    close(epfd);
+    close(sfd);
+    return err;
+}
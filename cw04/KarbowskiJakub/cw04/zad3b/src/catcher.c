@@ -2,23 +2,64 @@
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
+#include "sigbench.h"
 
 typedef enum send_mode_t
 {
     MODE_KILL,
     MODE_SIGQUEUE,
     MODE_SIGRT,
+    MODE_WINDOW,
 } send_mode_t;
 
 static volatile int g_usr1_count = 0;
 static volatile int g_usr2_count = 0;
 static volatile send_mode_t g_sender_mode;
 static volatile pid_t g_sender_pid;
+// NULL unless run by the benchmark
+static sigbench_t *g_bench = NULL;
+
+/**
+ * Sequence number of received ping for measurements.
+ */
+static int64_t ping_seq(int sig, const siginfo_t *info)
+{
+    if (info->si_code == SI_QUEUE) return info->si_value.sival_int;
+    // sender waits for confirmation, so it is the newest one
+    return sigbench_newest(g_bench);
+}
+
+/**
+ * Handle signal of window mode.
+ * Only the next signal in order is taken,
+ * so the sender goes back to the oldest unacknowledged one after a loss.
+ *
+ * @param seq Sequence number or -1 to stop.
+ */
+static void on_window(int seq)
+{
+    if (seq < 0)
+    {
+        g_usr2_count++;
+        return;
+    }
+
+    if (seq == g_usr1_count)
+    {
+        if (g_bench) sigbench_received(g_bench, seq);
+        g_usr1_count++;
+    }
+
+    // cumulative, a lost one is covered by the next
+    sigqueue(g_sender_pid, SIGRTMIN + 2, (union sigval) g_usr1_count);
+}
 
 static void handler(int sig, siginfo_t *info, void *ucontext)
 {
     // get sender's mode
-    if (sig == SIGRTMIN + 0 || sig == SIGRTMIN + 1)
+    if (sig == SIGRTMIN + 2)
+        g_sender_mode = MODE_WINDOW;
+    else if (sig == SIGRTMIN + 0 || sig == SIGRTMIN + 1)
         g_sender_mode = MODE_SIGRT;
     else if (info->si_code == SI_USER)
         g_sender_mode = MODE_KILL;
@@ -27,8 +68,11 @@ static void handler(int sig, siginfo_t *info, void *ucontext)
 
     g_sender_pid = info->si_pid;
 
-    if (sig == SIGUSR1 || sig == SIGRTMIN + 0)
+    if (sig == SIGRTMIN + 2)
+        on_window(info->si_value.sival_int);
+    else if (sig == SIGUSR1 || sig == SIGRTMIN + 0)
     {
+        if (g_bench) sigbench_received(g_bench, ping_seq(sig, info));
         g_usr1_count++;
         // send confirmation
         switch (g_sender_mode)
@@ -44,6 +88,9 @@ static void handler(int sig, siginfo_t *info, void *ucontext)
             case MODE_SIGRT:
                 kill(g_sender_pid, SIGRTMIN + 0);
                 break;
+
+            case MODE_WINDOW:
+                break;
         }
     }
     else if (sig == SIGUSR2 || sig == SIGRTMIN + 1)
@@ -63,6 +110,10 @@ int main(int argc, char **argv)
     sigaction(SIGUSR2, &act, NULL);
     sigaction(SIGRTMIN + 0, &act, NULL);
     sigaction(SIGRTMIN + 1, &act, NULL);
+    sigaction(SIGRTMIN + 2, &act, NULL);
+
+    g_bench = sigbench_attach();
+    if (g_bench) __atomic_store_n(&g_bench->catcher_ready, 1, __ATOMIC_RELEASE);
 
     // WAIT FOR PING
 
@@ -70,6 +121,8 @@ int main(int argc, char **argv)
     sigemptyset(&set);
     sigaddset(&set, SIGUSR2);
     sigaddset(&set, SIGRTMIN+1);
+    // stop of window mode
+    sigaddset(&set, SIGRTMIN+2);
     // block USR2 to safely access g_usr2_count
     sigprocmask(SIG_BLOCK, &set, &oldset);
     // -- critical section start
@@ -87,10 +140,12 @@ int main(int argc, char **argv)
     sigprocmask(SIG_SETMASK, &oldset, NULL);
 
     printf("Catcher got %d signals\n", g_usr1_count);
+    if (g_bench) g_bench->n_received = g_usr1_count;
 
     // SEND PONG
 
-    for (int i = 0; i < g_usr1_count; ++i)
+    // signals of window mode are already acknowledged
+    for (int i = 0; g_sender_mode != MODE_WINDOW && i < g_usr1_count; ++i)
     {
         switch (g_sender_mode)
         {
@@ -105,6 +160,9 @@ int main(int argc, char **argv)
             case MODE_SIGRT:
                 kill(g_sender_pid, SIGRTMIN + 0);
                 break;
+
+            case MODE_WINDOW:
+                break;
         }
     }
 
@@ -123,6 +181,10 @@ int main(int argc, char **argv)
         case MODE_SIGRT:
             kill(g_sender_pid, SIGRTMIN + 1);
             break;
+
+        case MODE_WINDOW:
+            sigqueue(g_sender_pid, SIGRTMIN + 1, (union sigval) g_usr1_count);
+            break;
     }
 
     return 0;
@@ -1,19 +1,31 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <signal.h>
+#include "sigbench.h"
+
+// unacknowledged signals in window mode
+#define DEFAULT_WINDOW (32)
+// no acknowledgement for this long means they were lost
+#define WINDOW_TIMEOUT_NS (100000000)
+// repeated acks of the same signal mean the one after it was lost
+#define WINDOW_DUP_ACKS (3)
 
 typedef enum send_mode_t
 {
     MODE_KILL,
     MODE_SIGQUEUE,
     MODE_SIGRT,
+    MODE_WINDOW,
 } send_mode_t;
 
 static const char HELP[] =
         "SO Lab4 Zad3b - Jakub Karbowski\n"
         "Usage:\n"
-        "%s CATCHER_PID NUM_SIGNALS kill|sigqueue|sigrt\n";
+        "%s CATCHER_PID NUM_SIGNALS kill|sigqueue|sigrt\n"
+        "%s CATCHER_PID NUM_SIGNALS window [WINDOW] - send up to WINDOW (default 32) "
+        "real-time signals before confirmation\n";
 
 static volatile int g_usr1_count = 0;
 static volatile int g_usr2_count = 0;
@@ -26,18 +38,95 @@ static void handler(int sig, siginfo_t *info, void *ucontext)
     else if (sig == SIGUSR2 || sig == SIGRTMIN + 1)
         g_usr2_count++;
 
-    if (info->si_code == SI_QUEUE && sig == SIGUSR2)
+    if (info->si_code == SI_QUEUE && (sig == SIGUSR2 || sig == SIGRTMIN + 1))
         g_catcher_received = info->si_value.sival_int;
 }
 
+/**
+ * Send signals with go-back-N sliding window.
+ * Signal SIGRTMIN + 2 carries sequence number,
+ * catcher answers every one with the number of signals received in order.
+ *
+ * @param bench Measurements or NULL.
+ * @param retransmitted Number of signals sent again.
+ * @return 0 or negative error.
+ */
+static int send_window(pid_t catcher_pid, int to_send, int window,
+                       sigbench_t *bench, int *retransmitted)
+{
+    sigset_t ack_set;
+    sigemptyset(&ack_set);
+    sigaddset(&ack_set, SIGRTMIN + 2);
+    // acks are taken with sigtimedwait
+    sigprocmask(SIG_BLOCK, &ack_set, NULL);
+
+    const struct timespec timeout = {
+        .tv_sec = WINDOW_TIMEOUT_NS / 1000000000,
+        .tv_nsec = WINDOW_TIMEOUT_NS % 1000000000,
+    };
+
+    // oldest unacknowledged, next to send, first never sent
+    int base = 0, next = 0, fresh = 0;
+    int dup_acks = 0;
+    *retransmitted = 0;
+
+    while (base < to_send)
+    {
+        while (next < to_send && next - base < window)
+        {
+            if (bench && next == fresh) sigbench_sent(bench, next);
+
+            if (sigqueue(catcher_pid, SIGRTMIN + 2, (union sigval) next))
+            {
+                if (errno != EAGAIN) return -1;
+                // queue limit reached, wait for acks
+                break;
+            }
+
+            if (next++ == fresh) fresh++;
+            else (*retransmitted)++;
+        }
+
+        siginfo_t info;
+        if (sigtimedwait(&ack_set, &info, &timeout) < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) return -1;
+            // timeout, send everything unacknowledged again
+            next = base;
+            continue;
+        }
+
+        int ack = info.si_value.sival_int;
+        if (ack > fresh) continue;
+        if (ack == base && base < next)
+        {
+            // catcher drops everything after the gap, do not wait for timeout
+            if (++dup_acks == WINDOW_DUP_ACKS) next = base;
+            continue;
+        }
+        if (ack > base) dup_acks = 0;
+        // catcher has it, no need to resend
+        if (ack > next) next = ack;
+        for (; base < ack; ++base)
+        {
+            if (bench) sigbench_confirmed(bench, base);
+        }
+    }
+
+    // drop pending late acks, so they do not fill the queue
+    signal(SIGRTMIN + 2, SIG_IGN);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
 
     // ------------- ARG PARSING
 
-    if (argc != 4)
+    if (argc != 4 && argc != 5)
     {
-        fprintf(stderr, HELP, argv[0]);
+        fprintf(stderr, HELP, argv[0], argv[0]);
         return -1;
     }
 
@@ -60,12 +149,24 @@ int main(int argc, char **argv)
     if (!strcmp("kill", argv[3])) mode = MODE_KILL;
     else if (!strcmp("sigqueue", argv[3])) mode = MODE_SIGQUEUE;
     else if (!strcmp("sigrt", argv[3])) mode = MODE_SIGRT;
+    else if (!strcmp("window", argv[3])) mode = MODE_WINDOW;
     else
     {
         fprintf(stderr, "Invalid mode: %s\n", argv[3]);
         return -1;
     }
 
+    int window = DEFAULT_WINDOW;
+    if (argc == 5)
+    {
+        window = (int) strtol(argv[4], &endptr, 10);
+        if (*endptr || window <= 0 || mode != MODE_WINDOW)
+        {
+            fprintf(stderr, "Invalid WINDOW: %s\n", argv[4]);
+            return -1;
+        }
+    }
+
     // ------------- SIGNAL SETUP
 
     struct sigaction act = {0};
@@ -76,10 +177,24 @@ int main(int argc, char **argv)
     sigaction(SIGRTMIN + 0, &act, NULL);
     sigaction(SIGRTMIN + 1, &act, NULL);
 
+    // NULL unless run by the benchmark
+    sigbench_t *bench = sigbench_attach();
+
     // ------------- SEND PING
 
-    for (int i = 0; i < to_send; ++i)
+    if (bench) bench->send_start = sigbench_now();
+
+    int retransmitted = 0;
+    if (mode == MODE_WINDOW && send_window(catcher_pid, to_send, window, bench, &retransmitted))
     {
+        fprintf(stderr, "Error!\n");
+        return -1;
+    }
+
+    for (int i = 0; mode != MODE_WINDOW && i < to_send; ++i)
+    {
+        if (bench) sigbench_sent(bench, i);
+
         switch (mode)
         {
             case MODE_KILL:
@@ -87,12 +202,16 @@ int main(int argc, char **argv)
                 break;
 
             case MODE_SIGQUEUE:
-                sigqueue(catcher_pid, SIGUSR1, (union sigval) 0);
+                // sequence number
+                sigqueue(catcher_pid, SIGUSR1, (union sigval) i);
                 break;
 
             case MODE_SIGRT:
                 kill(catcher_pid, SIGRTMIN + 0);
                 break;
+
+            case MODE_WINDOW:
+                break;
         }
 
         // WAIT FOR CONFIRMATION
@@ -118,8 +237,12 @@ int main(int argc, char **argv)
         // -- critical section end
         // restore original mask
         sigprocmask(SIG_SETMASK, &oldset, NULL);
+
+        if (bench) sigbench_confirmed(bench, i);
     }
 
+    if (bench) bench->send_end = sigbench_now();
+
     // ------------- SEND STOP
 
     switch (mode)
@@ -135,6 +258,11 @@ int main(int argc, char **argv)
         case MODE_SIGRT:
             kill(catcher_pid, SIGRTMIN + 1);
             break;
+
+        case MODE_WINDOW:
+            // queued after all data, catcher drains the queue
+            while (sigqueue(catcher_pid, SIGRTMIN + 2, (union sigval) -1) && errno == EAGAIN);
+            break;
     }
 
     // ------------- WAIT FOR PONG
@@ -159,10 +287,14 @@ int main(int argc, char **argv)
     // restore original mask
     sigprocmask(SIG_SETMASK, &oldset, NULL);
 
-    if (mode == MODE_SIGQUEUE)
+    if (mode == MODE_SIGQUEUE || mode == MODE_WINDOW)
         printf("Catcher got %d/%d signals\n", g_catcher_received, to_send);
 
-    printf("Sender got %d/%d signals\n", g_usr1_count, to_send);
+    if (mode == MODE_WINDOW)
+        printf("Sender got all %d confirmations, %d signals retransmitted\n",
+               to_send, retransmitted);
+    else
+        printf("Sender got %d/%d signals\n", g_usr1_count, to_send);
 
     return 0;
 }